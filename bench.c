@@ -0,0 +1,1027 @@
+#define _POSIX_C_SOURCE 200809L
+#define NONSTD_IMPLEMENTATION
+#include "nonstd.h"
+
+#include <time.h>
+
+// Benchmarks for nonstd.h. Build with optimizations: make bench
+//
+// Usage: ./bench [options]
+//   --filter SUBSTR    only run benchmarks whose name contains SUBSTR
+//   --repeat N         repetitions per benchmark, the fastest one is kept (default 3)
+//   --json FILE        write results as JSON ("-" for stdout)
+//   --csv FILE         write results as CSV ("-" for stdout)
+//   --compare FILE     compare against a baseline written with --json or --csv
+//   --threshold PCT    slowdown in percent reported as a regression (default 10)
+//
+// With --compare the exit status is 1 when any benchmark regressed.
+
+#define BENCH_MAX_RESULTS 128
+#define BENCH_NAME_SIZE 48
+
+typedef struct {
+	char name[BENCH_NAME_SIZE];
+	size_t ops;
+	double ns_per_op;
+	double gb_per_sec;
+} BenchResult;
+
+typedef struct {
+	char name[BENCH_NAME_SIZE];
+	size_t ops;
+	size_t bytes;
+	int rep;
+	double start;
+	double best;
+} BenchTimer;
+
+static volatile u64 bench_sink;
+static BenchResult bench_results[BENCH_MAX_RESULTS];
+static size_t bench_result_count = 0;
+static const char *bench_filter = NULL;
+static int bench_repeats = 3;
+static FILE *bench_out = NULL;
+
+static double bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void bench_record(const char *name, size_t ops, size_t bytes, double seconds) {
+	double ns_per_op = seconds * 1e9 / (double)ops;
+	double gb_per_sec = bytes ? (double)bytes / seconds / 1e9 : 0.0;
+	fprintf(bench_out, "  %-32s %12.2f ns/op", name, ns_per_op);
+	if (bytes) {
+		fprintf(bench_out, " %10.2f GB/s", gb_per_sec);
+	}
+	fprintf(bench_out, "\n");
+
+	if (bench_result_count < BENCH_MAX_RESULTS) {
+		BenchResult *r = &bench_results[bench_result_count++];
+		snprintf(r->name, sizeof(r->name), "%s", name);
+		r->ops = ops;
+		r->ns_per_op = ns_per_op;
+		r->gb_per_sec = gb_per_sec;
+	}
+}
+
+static BenchTimer bench_begin(const char *name, size_t ops, size_t bytes) {
+	BenchTimer t = {0};
+	snprintf(t.name, sizeof(t.name), "%s", name);
+	t.ops = ops;
+	t.bytes = bytes;
+	t.best = 1e300;
+	// Filtered out benchmarks run zero repetitions
+	if (bench_filter && !strstr(name, bench_filter)) {
+		t.rep = -1;
+	}
+	return t;
+}
+
+static int bench_next(BenchTimer *t) {
+	double now = bench_now();
+	if (t->rep < 0) {
+		return 0;
+	}
+	if (t->rep > 0) {
+		t->best = MIN(t->best, now - t->start);
+	}
+	if (t->rep++ == bench_repeats) {
+		bench_record(t->name, t->ops, t->bytes, t->best);
+		return 0;
+	}
+	t->start = bench_now();
+	return 1;
+}
+
+// Runs the following block bench_repeats times and records the fastest run.
+// The block is expected to perform `ops` operations touching `bytes` bytes.
+#define BENCH(t, name, ops, bytes) \
+	for (BenchTimer t = bench_begin(name, ops, bytes); bench_next(&t);)
+
+static void bench_section(const char *name) {
+	fprintf(bench_out, "\n[%s]\n", name);
+}
+
+// Hashing
+
+static void bench_hash_short(size_t key_size) {
+	u8 keys[64 + 32];
+	for (size_t i = 0; i < sizeof(keys); ++i) {
+		keys[i] = (u8)(i * 37 + 11);
+	}
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof(name), "hash_bytes %zuB", key_size);
+	size_t ops = 5000000;
+	BENCH(t, name, ops, ops * key_size) {
+		u64 acc = 0;
+		for (size_t i = 0; i < ops; ++i) {
+			// Vary the key so the hash cannot be hoisted out of the loop
+			acc += hash_bytes(keys + (i & 63), key_size, acc);
+		}
+		bench_sink = acc;
+	}
+}
+
+static void bench_hash_long(size_t size) {
+	u8 *data = ALLOC(u8, size);
+	for (size_t i = 0; i < size; ++i) {
+		data[i] = (u8)(i * 131 + 7);
+	}
+
+	char name[BENCH_NAME_SIZE];
+	size_t ops = MAX((size_t)1, ((size_t)256 << 20) / size);
+	snprintf(name, sizeof(name), "hash_bytes %zuKB", size / 1024);
+	BENCH(t, name, ops, ops * size) {
+		u64 acc = 0;
+		for (size_t i = 0; i < ops; ++i) {
+			acc ^= hash_bytes(data, size, i);
+		}
+		bench_sink = acc;
+	}
+
+	// Same input fed in 4 KiB chunks through the streaming interface
+	snprintf(name, sizeof(name), "hash_update %zuKB", size / 1024);
+	BENCH(t, name, ops, ops * size) {
+		u64 acc = 0;
+		for (size_t i = 0; i < ops; ++i) {
+			HashState state;
+			hash_init(&state, i);
+			for (size_t off = 0; off < size; off += 4096) {
+				hash_update(&state, data + off, MIN((size_t)4096, size - off));
+			}
+			acc ^= hash_final(&state);
+		}
+		bench_sink = acc;
+	}
+	FREE(data);
+}
+
+// String views and builders
+
+static void bench_strings(void) {
+	size_t size = (size_t)4 << 20;
+	char *text = ALLOC(char, size);
+	for (size_t i = 0; i < size; ++i) {
+		text[i] = (i % 97 == 96) ? '\n' : (char)('a' + i % 23);
+	}
+	stringv sv = sv_from_parts(text, size);
+	size_t ops = 64;
+
+	BENCH(t, "sv_count_char 4MB", ops, ops * size) {
+		size_t acc = 0;
+		for (size_t i = 0; i < ops; ++i) {
+			acc += sv_count_char(sv, '\n');
+		}
+		bench_sink = acc;
+	}
+
+	BENCH(t, "sv_find_char 4MB", ops, ops * size) {
+		size_t acc = 0;
+		for (size_t i = 0; i < ops; ++i) {
+			acc += sv_find_char(sv, 'z');
+		}
+		bench_sink = acc;
+	}
+
+	BENCH(t, "sv_find 4MB", ops, ops * size) {
+		size_t acc = 0;
+		for (size_t i = 0; i < ops; ++i) {
+			acc += sv_find(sv, sv_from_cstr("needle"));
+		}
+		bench_sink = acc;
+	}
+
+	size_t lines = sv_count_char(sv, '\n') + 1;
+	BENCH(t, "sv_split_line_next", lines * 16, size * 16) {
+		size_t acc = 0;
+		for (size_t i = 0; i < 16; ++i) {
+			stringv rest = sv, line;
+			while (sv_split_line_next(&rest, &line)) {
+				acc += line.length;
+			}
+		}
+		bench_sink = acc;
+	}
+	FREE(text);
+
+	stringb sb;
+	sb_init(&sb, 0);
+	size_t appends = 10000000;
+
+	BENCH(t, "sb_append_char", appends, appends) {
+		sb.length = 0;
+		for (size_t i = 0; i < appends; ++i) {
+			sb_append_char(&sb, (char)('a' + (i & 15)));
+		}
+		bench_sink = sb.length;
+	}
+
+	const char *word = "sixteen bytes!!!";
+	BENCH(t, "sb_append_cstr 16B", appends, appends * 16) {
+		sb.length = 0;
+		for (size_t i = 0; i < appends; ++i) {
+			sb_append_cstr(&sb, word);
+		}
+		bench_sink = sb.length;
+	}
+
+	stringv chunk = sv_from_cstr("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+	BENCH(t, "sb_append_sv 64B", appends / 4, appends / 4 * 64) {
+		sb.length = 0;
+		for (size_t i = 0; i < appends / 4; ++i) {
+			sb_append_sv(&sb, chunk);
+		}
+		bench_sink = sb.length;
+	}
+
+	// A fresh builder per run includes the cost of growing from the default capacity
+	BENCH(t, "sb_append_char cold", appends, appends) {
+		stringb cold;
+		sb_init(&cold, 0);
+		for (size_t i = 0; i < appends; ++i) {
+			sb_append_char(&cold, 'x');
+		}
+		bench_sink = cold.length;
+		sb_free(&cold);
+	}
+	sb_free(&sb);
+}
+
+// Dynamic arrays and hash maps
+
+static void bench_containers(void) {
+	size_t ops = 10000000;
+	BENCH(t, "array_push int", ops, ops * sizeof(int)) {
+		array(int) arr;
+		array_init(arr);
+		for (size_t i = 0; i < ops; ++i) {
+			array_push(arr, (int)i);
+		}
+		bench_sink = (u64)arr.length;
+		array_free(arr);
+	}
+
+	// Commits pages in place instead of reallocating and copying
+	BENCH(t, "stable_array_push int", ops, ops * sizeof(int)) {
+		stable_array(int) arr;
+		stable_array_init(arr, 0);
+		for (size_t i = 0; i < ops; ++i) {
+			stable_array_push(arr, (int)i);
+		}
+		bench_sink = (u64)arr.length;
+		stable_array_free(arr);
+	}
+
+	// Many short lists, as an AST or token list builds them
+	size_t lists = 1000000;
+	BENCH(t, "array_push 6 x 1M lists", lists, 0) {
+		u64 acc = 0;
+		for (size_t i = 0; i < lists; ++i) {
+			array(int) arr;
+			array_init(arr);
+			for (int j = 0; j < 6; ++j) {
+				array_push(arr, j);
+			}
+			acc += (u64)arr.data[i % 6];
+			array_free(arr);
+		}
+		bench_sink = acc;
+	}
+
+	BENCH(t, "small_array_push 6 x 1M lists", lists, 0) {
+		u64 acc = 0;
+		for (size_t i = 0; i < lists; ++i) {
+			small_array(int, 8) arr;
+			small_array_init(arr);
+			for (int j = 0; j < 6; ++j) {
+				small_array_push(arr, j);
+			}
+			acc += (u64)small_array_get(arr, i % 6);
+			small_array_free(arr);
+		}
+		bench_sink = acc;
+	}
+
+	BENCH(t, "array_pop int", ops, ops * sizeof(int)) {
+		array(int) arr;
+		array_init_cap(arr, ops);
+		arr.length = ops;
+		memset(arr.data, 1, ops * sizeof(int));
+		u64 acc = 0;
+		while (arr.length) {
+			acc += (u64)array_pop(arr);
+		}
+		bench_sink = acc;
+		array_free(arr);
+	}
+
+	// Front insert and remove shift the whole array, so keep them small
+	size_t shifts = 20000;
+	BENCH(t, "array_insert front 20k", shifts, 0) {
+		array(int) arr;
+		array_init(arr);
+		for (size_t i = 0; i < shifts; ++i) {
+			array_insert(arr, 0, (int)i);
+		}
+		bench_sink = (u64)arr.length;
+		array_free(arr);
+	}
+
+	BENCH(t, "array_insert middle 20k", shifts, 0) {
+		array(int) arr;
+		array_init(arr);
+		for (size_t i = 0; i < shifts; ++i) {
+			array_insert(arr, arr.length / 2, (int)i);
+		}
+		bench_sink = (u64)arr.length;
+		array_free(arr);
+	}
+
+	BENCH(t, "array_remove front 20k", shifts, 0) {
+		array(int) arr;
+		array_init_cap(arr, shifts);
+		for (size_t i = 0; i < shifts; ++i) {
+			arr.data[i] = (int)i;
+		}
+		arr.length = shifts;
+		while (arr.length) {
+			array_remove(arr, 0);
+		}
+		bench_sink = (u64)arr.length;
+		array_free(arr);
+	}
+
+	BENCH(t, "array_swap_remove front 20k", shifts, 0) {
+		array(int) arr;
+		array_init_cap(arr, shifts);
+		for (size_t i = 0; i < shifts; ++i) {
+			arr.data[i] = (int)i;
+		}
+		arr.length = shifts;
+		while (arr.length) {
+			array_swap_remove(arr, 0);
+		}
+		bench_sink = (u64)arr.length;
+		array_free(arr);
+	}
+
+	// Appending batches of 1024 elements, as an ingest loop would
+	int batch[1024];
+	for (size_t i = 0; i < countof(batch); ++i) {
+		batch[i] = (int)i;
+	}
+	BENCH(t, "array_push batch loop", ops, ops * sizeof(int)) {
+		array(int) arr;
+		array_init(arr);
+		for (size_t done = 0; done < ops; done += countof(batch)) {
+			for (size_t i = 0; i < countof(batch); ++i) {
+				array_push(arr, batch[i]);
+			}
+		}
+		bench_sink = (u64)arr.length;
+		array_free(arr);
+	}
+
+	BENCH(t, "array_push_n batch", ops, ops * sizeof(int)) {
+		array(int) arr;
+		array_init(arr);
+		for (size_t done = 0; done < ops; done += countof(batch)) {
+			array_push_n(arr, batch, countof(batch));
+		}
+		bench_sink = (u64)arr.length;
+		array_free(arr);
+	}
+
+	size_t keys = 1000000;
+	hashmap(u64, u64) map;
+	hashmap_init(map);
+	BENCH(t, "hashmap_put u64 1M", keys, 0) {
+		hashmap_clear(map);
+		for (size_t i = 0; i < keys; ++i) {
+			hashmap_put(map, (u64)i * 0x9E3779B97F4A7C15ull, (u64)i);
+		}
+	}
+
+	BENCH(t, "hashmap_get u64 1M", keys, 0) {
+		u64 acc = 0;
+		for (size_t i = 0; i < keys; ++i) {
+			u64 *value = hashmap_get(map, (u64)i * 0x9E3779B97F4A7C15ull);
+			acc += value ? *value : 0;
+		}
+		bench_sink = acc;
+	}
+
+	BENCH(t, "hashmap_get miss u64 1M", keys, 0) {
+		u64 acc = 0;
+		for (size_t i = 0; i < keys; ++i) {
+			acc += hashmap_contains(map, (u64)i * 0x9E3779B97F4A7C15ull + 1);
+		}
+		bench_sink = acc;
+	}
+	hashmap_free(map);
+}
+
+// Arenas
+
+static void bench_arena(void) {
+	size_t ops = 10000000;
+
+	Arena a = arena_make();
+	BENCH(t, "arena_alloc 32B", ops, ops * 32) {
+		arena_reset(&a);
+		for (size_t i = 0; i < ops; ++i) {
+			bench_sink += (uintptr_t)arena_alloc(&a, 32);
+		}
+	}
+	arena_free(&a);
+
+	// A new arena per run includes the block mallocs
+	BENCH(t, "arena_alloc 32B cold", ops, ops * 32) {
+		Arena cold = arena_make();
+		for (size_t i = 0; i < ops; ++i) {
+			bench_sink += (uintptr_t)arena_alloc(&cold, 32);
+		}
+		arena_free(&cold);
+	}
+
+	BENCH(t, "arena_alloc mixed sizes", ops, 0) {
+		arena_reset(&a);
+		for (size_t i = 0; i < ops; ++i) {
+			bench_sink += (uintptr_t)arena_alloc(&a, 8 + (i & 7) * 24);
+		}
+	}
+	arena_free(&a);
+
+	Arena vm = arena_make_virtual((size_t)1 << 30, 0);
+	BENCH(t, "arena_alloc 32B virtual", ops, ops * 32) {
+		arena_rewind(&vm, (ArenaMark){0});
+		for (size_t i = 0; i < ops; ++i) {
+			bench_sink += (uintptr_t)arena_alloc(&vm, 32);
+		}
+	}
+	arena_free(&vm);
+
+	BENCH(t, "arena mark/rewind", ops, 0) {
+		Arena scratch = arena_make();
+		for (size_t i = 0; i < ops; ++i) {
+			ArenaMark mark = arena_mark(&scratch);
+			bench_sink += (uintptr_t)arena_alloc(&scratch, 64);
+			arena_rewind(&scratch, mark);
+		}
+		arena_free(&scratch);
+	}
+}
+
+// File I/O
+
+static void bench_files(void) {
+	const char *path = "bench_io.tmp";
+	size_t size = (size_t)64 << 20;
+	char *data = ALLOC(char, size);
+	for (size_t i = 0; i < size; ++i) {
+		data[i] = (char)('a' + i % 26);
+	}
+
+	BENCH(t, "write_entire_file 64MB", 1, size) {
+		bench_sink = (u64)write_entire_file(path, data, size);
+	}
+	FREE(data);
+
+	BENCH(t, "read_entire_file 64MB", 1, size) {
+		size_t read_size = 0;
+		char *contents = read_entire_file(path, &read_size);
+		bench_sink = read_size;
+		FREE(contents);
+	}
+
+	BENCH(t, "map_entire_file 64MB + count", 1, size) {
+		MappedFile mf = map_entire_file(path, FILE_MAP_SEQUENTIAL);
+		bench_sink = sv_count_char(mf_as_sv(&mf), 'z');
+		unmap_file(&mf);
+	}
+
+	BENCH(t, "read_entire_file 64MB + count", 1, size) {
+		size_t read_size = 0;
+		char *contents = read_entire_file(path, &read_size);
+		bench_sink = sv_count_char(sv_from_parts(contents, read_size), 'z');
+		FREE(contents);
+	}
+	remove(path);
+}
+
+// Logging
+
+static void bench_logging(void) {
+	FILE *null_stream = fopen("/dev/null", "w");
+	if (!null_stream) {
+		return;
+	}
+
+	size_t ops = 200000;
+	set_log_level(LOG_INFO);
+	BENCH(t, "log_message", ops, 0) {
+		for (size_t i = 0; i < ops; ++i) {
+			log_message(null_stream, LOG_INFO, "request %zu served in %d us", i, 42);
+		}
+	}
+
+	// Filtered messages should only cost the level check
+	BENCH(t, "log_message filtered", ops * 100, 0) {
+		for (size_t i = 0; i < ops * 100; ++i) {
+			log_message(null_stream, LOG_DEBUG, "request %zu served in %d us", i, 42);
+		}
+	}
+
+	BENCH(t, "LOG_KV json", ops, 0) {
+		for (size_t i = 0; i < ops; ++i) {
+			LOG_KV(null_stream, LOG_INFO, "served", KV_UINT("request", i), KV_INT("us", 42), KV_CSTR("path", "/index.html"));
+		}
+	}
+
+	// After the first second's burst every call is suppressed
+	BENCH(t, "LOG_RATE_LIMITED suppressed", ops * 10, 0) {
+		for (size_t i = 0; i < ops * 10; ++i) {
+			LOG_RATE_LIMITED(null_stream, LOG_WARN, 10, "storm %zu", i);
+		}
+	}
+
+	// A disabled call site is a single branch on its static flag
+	BENCH(t, "LOG_AT disabled site", ops * 100, 0) {
+		for (size_t i = 0; i < ops * 100; ++i) {
+			LOG_AT(null_stream, LOG_DEBUG, "request %zu served in %d us", i, 42);
+		}
+	}
+	fclose(null_stream);
+
+	const char *path = "bench_binlog.tmp";
+	if (binlog_open(path)) {
+		BENCH(t, "BINLOG_INFO", ops * 10, 0) {
+			for (size_t i = 0; i < ops * 10; ++i) {
+				BINLOG_INFO("request %zu served in %d us", i, 42);
+			}
+		}
+		binlog_close();
+		remove(path);
+	}
+}
+
+// Timing
+
+static void bench_timing(void) {
+	size_t ops = 10000000;
+	u64 sum = 0;
+	BENCH(t, "time_now_ns", ops, 0) {
+		for (size_t i = 0; i < ops; ++i) {
+			sum += time_now_ns();
+		}
+	}
+	BENCH(t, "cycles_now", ops, 0) {
+		for (size_t i = 0; i < ops; ++i) {
+			sum += cycles_now();
+		}
+	}
+	BENCH(t, "TIMER_SCOPE", ops, 0) {
+		for (size_t i = 0; i < ops; ++i) {
+			TIMER_SCOPE("bench.scope") {
+				sum += i;
+			}
+		}
+	}
+	bench_sink = sum;
+
+	trace_start();
+	BENCH(t, "TRACE_INSTANT", ops, 0) {
+		for (size_t i = 0; i < ops; ++i) {
+			TRACE_INSTANT("bench.instant");
+		}
+		// Keep memory flat across repeats
+		trace_clear();
+	}
+	trace_stop();
+	trace_clear();
+
+	Histogram h;
+	hist_init(&h);
+	BENCH(t, "hist_record", ops, 0) {
+		u64 value = 1;
+		for (size_t i = 0; i < ops; ++i) {
+			value = value * 6364136223846793005ull + 1442695040888963407ull;
+			hist_record(&h, value >> 44);
+		}
+	}
+	BENCH(t, "hist_percentile", ops / 100, 0) {
+		for (size_t i = 0; i < ops / 100; ++i) {
+			sum += hist_percentile(&h, 90.0 + (double)(i % 10));
+		}
+	}
+	bench_sink = sum;
+}
+
+// Sorting
+
+typedef struct {
+	u64 key;
+	u64 payload;
+} BenchRecord;
+
+#define BENCH_RECORD_LESS(a, b) ((a).key < (b).key)
+#define BENCH_RECORD_KEY(x) ((x).key)
+
+SORT_DEF(bench_sort_u64, u64, SORT_LESS)
+SORT_DEF(bench_sort_records, BenchRecord, BENCH_RECORD_LESS)
+RADIX_SORT_DEF(bench_radix_u64, u64, u64, SORT_IDENTITY_KEY)
+RADIX_SORT_DEF(bench_radix_records, BenchRecord, u64, BENCH_RECORD_KEY)
+
+static int bench_compare_u64(const void *a, const void *b) {
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+	return (x > y) - (x < y);
+}
+
+static int bench_compare_records(const void *a, const void *b) {
+	return bench_compare_u64(&((const BenchRecord *)a)->key, &((const BenchRecord *)b)->key);
+}
+
+static void bench_sorting(void) {
+	size_t count = (size_t)1 << 20;
+	u64 *source = ALLOC(u64, count);
+	u64 *values = ALLOC(u64, count);
+	BenchRecord *records_source = ALLOC(BenchRecord, count);
+	BenchRecord *records = ALLOC(BenchRecord, count);
+	u64 state = 0x9e3779b97f4a7c15ull;
+	for (size_t i = 0; i < count; ++i) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		source[i] = state;
+		records_source[i] = (BenchRecord){state, i};
+	}
+
+	// Each run sorts a fresh copy; the copy is part of the measured time
+	BENCH(t, "qsort u64", count, 0) {
+		memcpy(values, source, count * sizeof(u64));
+		qsort(values, count, sizeof(u64), bench_compare_u64);
+	}
+	BENCH(t, "SORT_DEF u64", count, 0) {
+		memcpy(values, source, count * sizeof(u64));
+		bench_sort_u64(values, count);
+	}
+	BENCH(t, "SORT_DEF u64 stable", count, 0) {
+		memcpy(values, source, count * sizeof(u64));
+		bench_sort_u64_stable(values, count);
+	}
+	BENCH(t, "SORT_DEF u64 parallel", count, 0) {
+		memcpy(values, source, count * sizeof(u64));
+		bench_sort_u64_parallel(values, count);
+	}
+	BENCH(t, "RADIX_SORT_DEF u64", count, 0) {
+		memcpy(values, source, count * sizeof(u64));
+		bench_radix_u64(values, count);
+	}
+	BENCH(t, "qsort records", count, 0) {
+		memcpy(records, records_source, count * sizeof(BenchRecord));
+		qsort(records, count, sizeof(BenchRecord), bench_compare_records);
+	}
+	BENCH(t, "SORT_DEF records", count, 0) {
+		memcpy(records, records_source, count * sizeof(BenchRecord));
+		bench_sort_records(records, count);
+	}
+	BENCH(t, "RADIX_SORT_DEF records", count, 0) {
+		memcpy(records, records_source, count * sizeof(BenchRecord));
+		bench_radix_records(records, count);
+	}
+	bench_sink = values[count / 2] + records[count / 2].payload;
+	FREE(source);
+	FREE(values);
+	FREE(records_source);
+	FREE(records);
+}
+
+// Thread pool
+
+static void bench_pool_noop(void *arg) {
+	(void)arg;
+}
+
+static void bench_pool_sum(size_t begin, size_t end, void *ctx) {
+	const u64 *values = ctx;
+	u64 sum = 0;
+	for (size_t i = begin; i < end; ++i) {
+		sum += values[i] * values[i];
+	}
+	__atomic_add_fetch(&bench_sink, sum, __ATOMIC_RELAXED);
+}
+
+PARALLEL_REDUCE_DEF(bench_parallel_sum, u64, 0, PARALLEL_SUM)
+
+static void bench_threads(void) {
+	ThreadPool *pool = pool_default();
+	size_t ops = 1000000;
+	WaitGroup wg;
+	wait_group_init(&wg);
+	BENCH(t, "pool_submit + wait", ops, 0) {
+		for (size_t i = 0; i < ops; ++i) {
+			pool_submit(pool, &wg, bench_pool_noop, NULL);
+		}
+		pool_wait(pool, &wg);
+	}
+	wait_group_destroy(&wg);
+
+	size_t count = (size_t)16 << 20;
+	u64 *values = ALLOC(u64, count);
+	for (size_t i = 0; i < count; ++i) {
+		values[i] = i;
+	}
+	BENCH(t, "sum serial", count, count * sizeof(u64)) {
+		bench_pool_sum(0, count, values);
+	}
+	BENCH(t, "parallel_for sum", count, count * sizeof(u64)) {
+		parallel_for(0, count, 0, bench_pool_sum, values);
+	}
+	BENCH(t, "PARALLEL_REDUCE_DEF sum", count, count * sizeof(u64)) {
+		bench_sink = bench_parallel_sum(values, count);
+	}
+	FREE(values);
+}
+
+// Canvas & PPM
+
+static void bench_ppm(void) {
+	u32 w = 1920, h = 1080;
+	size_t pixels = (size_t)w * h;
+	Canvas canvas = ppm_init(w, h);
+
+	BENCH(t, "ppm_fill 1080p", 16, 16 * pixels * sizeof(Color)) {
+		for (int i = 0; i < 16; ++i) {
+			ppm_fill(&canvas, COLOR_HEX(0x102030 + i));
+		}
+	}
+
+	BENCH(t, "ppm_draw_rect 256x256", 1000, 0) {
+		for (u32 i = 0; i < 1000; ++i) {
+			ppm_draw_rect(&canvas, i % (w - 256), i % (h - 256), 256, 256, COLOR_RED);
+		}
+	}
+
+	BENCH(t, "ppm_draw_line 1080p diagonal", 1000, 0) {
+		for (i32 i = 0; i < 1000; ++i) {
+			ppm_draw_line(&canvas, i, 0, (i32)w - 1 - i, (i32)h - 1, COLOR_GREEN);
+		}
+	}
+
+	BENCH(t, "ppm_draw_circle r=200", 1000, 0) {
+		for (i32 i = 0; i < 1000; ++i) {
+			ppm_draw_circle(&canvas, 400 + i, 500, 200, COLOR_BLUE);
+		}
+	}
+
+	BENCH(t, "ppm_draw_triangle", 1000, 0) {
+		for (i32 i = 0; i < 1000; ++i) {
+			ppm_draw_triangle(&canvas, i, 100, 1500, 200 + i / 2, 700, 1000, COLOR_YELLOW);
+		}
+	}
+
+	const char *p6 = "bench_p6.tmp.ppm";
+	const char *p3 = "bench_p3.tmp.ppm";
+	BENCH(t, "ppm_save_binary 1080p", 1, pixels * 3) {
+		bench_sink = (u64)ppm_save_binary(&canvas, p6);
+	}
+
+	BENCH(t, "ppm_read P6 1080p", 1, pixels * 3) {
+		Canvas loaded = ppm_read(p6);
+		bench_sink = loaded.width;
+		ppm_free(&loaded);
+	}
+
+	// ASCII output is slow enough that a smaller image is representative
+	Canvas small = ppm_init(640, 360);
+	ppm_fill(&small, COLOR_HEX(0x7f3f1f));
+	size_t small_pixels = (size_t)640 * 360;
+	BENCH(t, "ppm_save P3 640x360", 1, small_pixels * 3) {
+		bench_sink = (u64)ppm_save(&small, p3);
+	}
+
+	BENCH(t, "ppm_read P3 640x360", 1, small_pixels * 3) {
+		Canvas loaded = ppm_read(p3);
+		bench_sink = loaded.width;
+		ppm_free(&loaded);
+	}
+
+	remove(p6);
+	remove(p3);
+	ppm_free(&small);
+	ppm_free(&canvas);
+}
+
+// Machine-readable output and baseline comparison
+
+static int bench_open_output(const char *path, FILE **out) {
+	if (strcmp(path, "-") == 0) {
+		*out = stdout;
+		return 1;
+	}
+	*out = fopen(path, "w");
+	if (!*out) {
+		fprintf(stderr, "bench: cannot open %s for writing\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+static void bench_close_output(FILE *out) {
+	if (out != stdout) {
+		fclose(out);
+	}
+}
+
+static int bench_write_json(const char *path) {
+	FILE *out;
+	if (!bench_open_output(path, &out)) {
+		return 0;
+	}
+	// One result per line keeps the file diffable and easy to parse back
+	fprintf(out, "{\n  \"benchmarks\": [\n");
+	for (size_t i = 0; i < bench_result_count; ++i) {
+		BenchResult *r = &bench_results[i];
+		fprintf(out, "    {\"name\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.4f, \"gb_per_sec\": %.4f}%s\n",
+		        r->name, r->ops, r->ns_per_op, r->gb_per_sec, i + 1 < bench_result_count ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+	bench_close_output(out);
+	return 1;
+}
+
+static int bench_write_csv(const char *path) {
+	FILE *out;
+	if (!bench_open_output(path, &out)) {
+		return 0;
+	}
+	fprintf(out, "name,ops,ns_per_op,gb_per_sec\n");
+	for (size_t i = 0; i < bench_result_count; ++i) {
+		BenchResult *r = &bench_results[i];
+		fprintf(out, "%s,%zu,%.4f,%.4f\n", r->name, r->ops, r->ns_per_op, r->gb_per_sec);
+	}
+	bench_close_output(out);
+	return 1;
+}
+
+// Parses one line of a JSON or CSV result file into name and ns_per_op
+static int bench_parse_line(stringv line, char *name, double *ns_per_op) {
+	stringv name_key = sv_from_cstr("\"name\": \"");
+	size_t at = sv_find(line, name_key);
+	if (at != SV_NPOS) {
+		stringv rest = sv_slice(line, at + name_key.length, line.length);
+		size_t quote = sv_find_char(rest, '"');
+		stringv ns_key = sv_from_cstr("\"ns_per_op\": ");
+		size_t ns_at = sv_find(line, ns_key);
+		if (quote == SV_NPOS || ns_at == SV_NPOS) {
+			return 0;
+		}
+		snprintf(name, BENCH_NAME_SIZE, "%.*s", (int)quote, rest.data);
+		*ns_per_op = strtod(line.data + ns_at + ns_key.length, NULL);
+		return 1;
+	}
+
+	// CSV: name,ops,ns_per_op,gb_per_sec
+	stringv field;
+	stringv rest = line;
+	if (!sv_split_next(&rest, ',', &field) || sv_equals(field, sv_from_cstr("name"))) {
+		return 0;
+	}
+	snprintf(name, BENCH_NAME_SIZE, "%.*s", (int)field.length, field.data);
+	stringv ops;
+	if (!sv_split_next(&rest, ',', &ops) || !rest.data) {
+		return 0;
+	}
+	*ns_per_op = strtod(rest.data, NULL);
+	return 1;
+}
+
+static int bench_compare(const char *path, double threshold) {
+	size_t size = 0;
+	char *baseline = read_entire_file(path, &size);
+	if (!baseline) {
+		fprintf(stderr, "bench: cannot read baseline %s\n", path);
+		return -1;
+	}
+
+	fprintf(bench_out, "\n[Compare against %s, threshold %.1f%%]\n", path, threshold);
+	int regressions = 0;
+	stringv rest = sv_from_parts(baseline, size), line;
+	while (sv_split_line_next(&rest, &line)) {
+		char name[BENCH_NAME_SIZE];
+		double base_ns;
+		if (!bench_parse_line(line, name, &base_ns) || base_ns <= 0) {
+			continue;
+		}
+		for (size_t i = 0; i < bench_result_count; ++i) {
+			BenchResult *r = &bench_results[i];
+			if (strcmp(r->name, name) != 0) {
+				continue;
+			}
+			double change = (r->ns_per_op - base_ns) / base_ns * 100.0;
+			const char *verdict = change > threshold ? " REGRESSION" : change < -threshold ? " faster" : "";
+			fprintf(bench_out, "  %-32s %12.2f -> %12.2f ns/op %+8.1f%%%s\n", name, base_ns, r->ns_per_op, change, verdict);
+			regressions += change > threshold;
+			break;
+		}
+	}
+	FREE(baseline);
+
+	fprintf(bench_out, "\n%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+	return regressions;
+}
+
+static void bench_usage(void) {
+	fprintf(stderr, "usage: bench [--filter SUBSTR] [--repeat N] [--json FILE] [--csv FILE]\n"
+	                "             [--compare FILE] [--threshold PCT]\n");
+}
+
+int main(int argc, char **argv) {
+	const char *json_path = NULL;
+	const char *csv_path = NULL;
+	const char *compare_path = NULL;
+	double threshold = 10.0;
+
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (!value) {
+			bench_usage();
+			return 2;
+		}
+		if (strcmp(arg, "--filter") == 0) {
+			bench_filter = value;
+		} else if (strcmp(arg, "--repeat") == 0) {
+			bench_repeats = MAX(1, atoi(value));
+		} else if (strcmp(arg, "--json") == 0) {
+			json_path = value;
+		} else if (strcmp(arg, "--csv") == 0) {
+			csv_path = value;
+		} else if (strcmp(arg, "--compare") == 0) {
+			compare_path = value;
+		} else if (strcmp(arg, "--threshold") == 0) {
+			threshold = strtod(value, NULL);
+		} else {
+			bench_usage();
+			return 2;
+		}
+		++i;
+	}
+
+	// Keep stdout clean when machine-readable output goes there
+	int machine_stdout = (json_path && strcmp(json_path, "-") == 0) || (csv_path && strcmp(csv_path, "-") == 0);
+	bench_out = machine_stdout ? stderr : stdout;
+
+	bench_section("Hash");
+	size_t short_sizes[] = {8, 16, 24, 32};
+	size_t size;
+	static_foreach(size_t, size, short_sizes) {
+		bench_hash_short(size);
+	}
+	bench_hash_long((size_t)1 << 20);
+	bench_hash_long((size_t)16 << 20);
+
+	bench_section("Strings");
+	bench_strings();
+
+	bench_section("Containers");
+	bench_containers();
+
+	bench_section("Arena");
+	bench_arena();
+
+	bench_section("File I/O");
+	bench_files();
+
+	bench_section("Logging");
+	bench_logging();
+
+	bench_section("Timing");
+	bench_timing();
+
+	bench_section("Thread Pool");
+	bench_threads();
+
+	bench_section("Sorting");
+	bench_sorting();
+
+	bench_section("Canvas & PPM");
+	bench_ppm();
+
+	if (json_path && !bench_write_json(json_path)) {
+		return 2;
+	}
+	if (csv_path && !bench_write_csv(csv_path)) {
+		return 2;
+	}
+	if (compare_path) {
+		int regressions = bench_compare(compare_path, threshold);
+		if (regressions != 0) {
+			return regressions < 0 ? 2 : 1;
+		}
+	}
+	return 0;
+}
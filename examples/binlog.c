@@ -0,0 +1,46 @@
+#define NONSTD_IMPLEMENTATION
+#include "../nonstd.h"
+
+#include <stdio.h>
+
+// Writes a small binary log and decodes it back to text.
+// Run as `./binlog FILE` to decode an existing binary log instead.
+
+static int decode(const char *path) {
+	MappedFile mf = map_entire_file(path, FILE_MAP_SEQUENTIAL);
+	if (!mf.data) {
+		fprintf(stderr, "cannot open %s\n", path);
+		return 1;
+	}
+	long events = binlog_decode(mf.data, mf.length, stdout);
+	unmap_file(&mf);
+	if (events < 0) {
+		fprintf(stderr, "%s is not a valid binary log\n", path);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1) {
+		return decode(argv[1]);
+	}
+
+	const char *path = "example.binlog";
+	if (!binlog_open(path)) {
+		return 1;
+	}
+
+	// Each call only records a timestamp and the raw argument bytes
+	for (int i = 0; i < 5; ++i) {
+		BINLOG_INFO("processed batch %d with %zu items in %.3f ms", i, (size_t)(i * 100), 0.125 * i);
+	}
+	BINLOG_WARN("cache miss for key %s", "user:42");
+	BINLOG_ERROR("giving up after %d retries", 3);
+	binlog_close();
+
+	printf("Decoded %s:\n", path);
+	int result = decode(path);
+	remove(path);
+	return result;
+}
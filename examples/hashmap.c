@@ -0,0 +1,63 @@
+#define NONSTD_IMPLEMENTATION
+#include "../nonstd.h"
+
+#include <stdio.h>
+
+typedef struct {
+	i32 x, y;
+} Point;
+
+int main(void) {
+	// 1. Integer keys
+	hashmap(int, const char *) names;
+	hashmap_init(names);
+
+	hashmap_put(names, 1, "one");
+	hashmap_put(names, 2, "two");
+	hashmap_put(names, 3, "three");
+
+	const char **name = hashmap_get(names, 2);
+	if (name) {
+		printf("2 -> %s\n", *name);
+	}
+
+	hashmap_remove(names, 2);
+	printf("Contains 2 after remove: %d\n", hashmap_contains(names, 2));
+	hashmap_free(names);
+
+	// 2. String view keys, counting words without copying them
+	hashmap(stringv, int) counts;
+	hashmap_init_sv(counts);
+
+	stringv rest = sv_from_cstr("red green blue green red red");
+	stringv word;
+	while (sv_split_whitespace_next(&rest, &word)) {
+		int *count = hashmap_get(counts, word);
+		if (count) {
+			(*count)++;
+		} else {
+			hashmap_put(counts, word, 1);
+		}
+	}
+
+	stringv key;
+	int value;
+	hashmap_foreach(counts, key, value) {
+		printf("%.*s: %d\n", (int)key.length, key.data, value);
+	}
+	hashmap_free(counts);
+
+	// 3. Struct keys are compared bytewise, so zero-initialize them
+	hashmap(Point, Color) pixels;
+	hashmap_init(pixels);
+	hashmap_reserve(pixels, 100);
+
+	Point p = {0};
+	p.x = 10;
+	p.y = 20;
+	hashmap_put(pixels, p, COLOR_RED);
+	printf("Pixel at (10, 20) is red: %d\n", hashmap_get(pixels, p)->r == 255);
+	hashmap_free(pixels);
+
+	return 0;
+}
@@ -21,5 +21,13 @@ int main(void) {
 		printf("Environment overrides level to: %d\n", env_level);
 	}
 
+	// Asynchronous logging: a background thread does the writing
+	if (log_async_start((LogAsyncConfig){.overflow = LOG_OVERFLOW_BLOCK})) {
+		for (int i = 0; i < 3; ++i) {
+			LOG_INFO_MSG("Async message %d", i);
+		}
+		log_async_stop();
+	}
+
 	return 0;
 }
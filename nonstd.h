@@ -11,21 +11,41 @@
 #ifndef _POSIX_C_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #endif
+// MAP_ANONYMOUS and madvise are not part of strict POSIX
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
 #endif
 
 #ifndef NONSTD_H
 #define NONSTD_H
 
+#include <ctype.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #ifndef NONSTD_DEF
 #ifdef NONSTD_STATIC
 #define NONSTD_DEF static
@@ -69,6 +89,12 @@ NONSTD_DEF void *safe_realloc(void *ptr, size_t item_size, size_t count);
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define CLAMP(x, lo, hi) (MIN((hi), MAX((lo), (x))))
 
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define NONSTD_THREAD_LOCAL _Thread_local
+#else
+#define NONSTD_THREAD_LOCAL __thread
+#endif
+
 // From https://github.com/tsoding/nob.h/blob/e2c9a46f01d052ab740140e74453665dc3334832/nob.h#L205-L206.
 #define UNUSED(value) (void)(value)
 #define TODO(message)                                                      \
@@ -102,6 +128,25 @@ NONSTD_DEF int sv_equals(stringv a, stringv b);
 NONSTD_DEF int sv_starts_with(stringv sv, stringv prefix);
 NONSTD_DEF int sv_ends_with(stringv sv, stringv suffix);
 
+// Search helpers return SV_NPOS when nothing is found
+#define SV_NPOS ((size_t)-1)
+
+NONSTD_DEF size_t sv_find_char(stringv sv, char c);
+NONSTD_DEF size_t sv_rfind_char(stringv sv, char c);
+NONSTD_DEF size_t sv_find(stringv sv, stringv needle);
+NONSTD_DEF size_t sv_count_char(stringv sv, char c);
+NONSTD_DEF int sv_contains(stringv sv, stringv needle);
+NONSTD_DEF size_t sv_find_any(stringv sv, stringv set);
+
+// Split iterators - zero-allocation tokenizers that advance *rest and return 0
+// when no fields are left. Usage:
+//     stringv rest = line, field;
+//     while (sv_split_next(&rest, ',', &field)) { ... }
+NONSTD_DEF int sv_split_next(stringv *rest, char delim, stringv *out);
+NONSTD_DEF int sv_split_any_next(stringv *rest, stringv delims, stringv *out);
+NONSTD_DEF int sv_split_whitespace_next(stringv *rest, stringv *out);
+NONSTD_DEF int sv_split_line_next(stringv *rest, stringv *out);
+
 // String builder - owning, mutable, dynamically growing string buffer
 typedef struct {
 	char *data;
@@ -205,15 +250,17 @@ NONSTD_DEF stringv sb_as_sv(const stringb *sb);
 		}                                \
 	} while (0)
 
+// The value is copied before the tail moves, so it may come from the array itself
 #define array_insert(arr, index, value)                              \
 	do {                                                             \
-		if ((index) <= (arr).length) {                               \
+		size_t _at = (index);                                        \
+		if (_at <= (arr).length) {                                   \
+			__typeof__(*(arr).data) _value = (value);                \
 			array_ensure((arr), 1);                                  \
 			if ((arr).length < (arr).capacity) {                     \
-				for (size_t _i = (arr).length; _i > (index); --_i) { \
-					(arr).data[_i] = (arr).data[_i - 1];             \
-				}                                                    \
-				(arr).data[index] = (value);                         \
+				memmove((arr).data + _at + 1, (arr).data + _at,      \
+				        ((arr).length - _at) * sizeof(*(arr).data)); \
+				(arr).data[_at] = _value;                            \
 				(arr).length++;                                      \
 			}                                                        \
 		}                                                            \
@@ -221,14 +268,64 @@ NONSTD_DEF stringv sb_as_sv(const stringb *sb);
 
 #define array_remove(arr, index)                                     \
 	do {                                                             \
-		if ((index) < (arr).length) {                                \
-			for (size_t _i = (index); _i < (arr).length - 1; ++_i) { \
-				(arr).data[_i] = (arr).data[_i + 1];                 \
-			}                                                        \
+		size_t _at = (index);                                        \
+		if (_at < (arr).length) {                                    \
+			memmove((arr).data + _at, (arr).data + _at + 1,          \
+			        ((arr).length - _at - 1) * sizeof(*(arr).data)); \
 			(arr).length--;                                          \
 		}                                                            \
 	} while (0)
 
+// Bulk operations - one capacity check and one memcpy/memmove per call.
+// `values` must not point into the array itself, growth may move it.
+#define array_push_n(arr, values, count)                                               \
+	do {                                                                               \
+		size_t _count = (count);                                                       \
+		array_ensure((arr), _count);                                                   \
+		if (_count && (arr).capacity - (arr).length >= _count) {                       \
+			memcpy((arr).data + (arr).length, (values), _count * sizeof(*(arr).data)); \
+			(arr).length += _count;                                                    \
+		}                                                                              \
+	} while (0)
+
+// Appends all elements of another array or slice
+#define array_extend(arr, other) array_push_n((arr), (other).data, (other).length)
+
+#define array_insert_n(arr, index, values, count)                                 \
+	do {                                                                          \
+		size_t _at = (index), _count = (count);                                   \
+		if (_at <= (arr).length && _count) {                                      \
+			array_ensure((arr), _count);                                          \
+			if ((arr).capacity - (arr).length >= _count) {                        \
+				memmove((arr).data + _at + _count, (arr).data + _at,              \
+				        ((arr).length - _at) * sizeof(*(arr).data));              \
+				memcpy((arr).data + _at, (values), _count * sizeof(*(arr).data)); \
+				(arr).length += _count;                                           \
+			}                                                                     \
+		}                                                                         \
+	} while (0)
+
+// Removes up to count elements starting at index, keeping the order of the rest
+#define array_remove_range(arr, index, count)                             \
+	do {                                                                  \
+		size_t _at = (index), _count = (count);                           \
+		if (_at < (arr).length) {                                         \
+			_count = MIN(_count, (arr).length - _at);                     \
+			memmove((arr).data + _at, (arr).data + _at + _count,          \
+			        ((arr).length - _at - _count) * sizeof(*(arr).data)); \
+			(arr).length -= _count;                                       \
+		}                                                                 \
+	} while (0)
+
+// O(1) removal that moves the last element into the hole (order is not kept)
+#define array_swap_remove(arr, index)                     \
+	do {                                                  \
+		size_t _at = (index);                             \
+		if (_at < (arr).length) {                         \
+			(arr).data[_at] = (arr).data[--(arr).length]; \
+		}                                                 \
+	} while (0)
+
 #define array_clear(arr)  \
 	do {                  \
 		(arr).length = 0; \
@@ -255,19 +352,369 @@ NONSTD_DEF stringv sb_as_sv(const stringb *sb);
 	for (size_t index = 0;                 \
 		 index < (arr).length && ((var) = (arr).data[index], 1); ++index)
 
+// Hashing - fast non-cryptographic 64-bit hash (wyhash family)
+// Values are identical across platforms for the same input and seed.
+NONSTD_DEF u64 hash_bytes(const void *data, size_t length, u64 seed);
+NONSTD_DEF u64 sv_hash64(stringv sv, u64 seed);
+
+// Incremental hashing for data that arrives in chunks. Produces the same value
+// as hash_bytes over the concatenated input.
+typedef struct {
+	u64 seed;
+	u64 see1;
+	u64 see2;
+	u64 length;
+	size_t buffered;
+	int blocks;
+	u8 buffer[48];
+	u8 tail[16];
+} HashState;
+
+NONSTD_DEF void hash_init(HashState *state, u64 seed);
+NONSTD_DEF void hash_update(HashState *state, const void *data, size_t length);
+NONSTD_DEF u64 hash_final(const HashState *state);
+
+// Hash map - generic open-addressing hash map using macros
+// Slots are tracked by SwissTable-style control bytes that are probed 16 at a
+// time. Keys are hashed and compared bytewise (zero padded structs before use)
+// unless the map is initialized with hashmap_init_sv for stringv keys. The map
+// does not own stringv key data.
+// Usage: hashmap(int, float) m; hashmap_init(m); hashmap_put(m, 1, 2.0f);
+typedef struct {
+	u8 *ctrl;
+	void *slots;
+	size_t length;
+	size_t capacity;
+	size_t tombstones;
+	u64 (*hash)(const void *key, size_t key_size);
+	int (*equals)(const void *a, const void *b, size_t key_size);
+} HashMapBase;
+
+typedef struct {
+	size_t key_size;
+	size_t slot_size;
+	size_t value_offset;
+} HashMapLayout;
+
+#define hashmap(K, V)     \
+	struct {              \
+		HashMapBase base; \
+		struct {          \
+			K key;        \
+			V value;      \
+		} *entry_type;    \
+	}
+
+#define hashmap_entries(map) ((__typeof__((map).entry_type))(map).base.slots)
+
+#define hashmap_layout(map)                         \
+	((HashMapLayout){sizeof((map).entry_type->key), \
+					 sizeof(*(map).entry_type),     \
+					 offsetof(__typeof__(*(map).entry_type), value)})
+
+#define hashmap_init(map)                         \
+	do {                                          \
+		memset(&(map), 0, sizeof(map));           \
+		(map).base.hash = hashmap_hash_bytes;     \
+		(map).base.equals = hashmap_equals_bytes; \
+	} while (0)
+
+#define hashmap_init_sv(map)                   \
+	do {                                       \
+		memset(&(map), 0, sizeof(map));        \
+		(map).base.hash = hashmap_hash_sv;     \
+		(map).base.equals = hashmap_equals_sv; \
+	} while (0)
+
+#define hashmap_free(map) hashmap_free_raw(&(map).base)
+
+#define hashmap_clear(map) hashmap_clear_raw(&(map).base)
+
+#define hashmap_length(map) ((map).base.length)
+
+#define hashmap_reserve(map, count) hashmap_reserve_raw(&(map).base, hashmap_layout(map), (count))
+
+#define hashmap_put(map, k, v)                                                                            \
+	do {                                                                                                  \
+		__typeof__((map).entry_type->key) _key = (k);                                                     \
+		__typeof__((map).entry_type) _slot = hashmap_insert_raw(&(map).base, hashmap_layout(map), &_key); \
+		if (_slot) {                                                                                      \
+			_slot->value = (v);                                                                           \
+		}                                                                                                 \
+	} while (0)
+
+// Evaluates to a pointer to the stored value, or NULL if the key is missing.
+// The key is copied into a one-element array literal so struct keys such as
+// stringv can be passed by value and the map itself is never written.
+#define hashmap_get(map, k)                                 \
+	((__typeof__(&(map).entry_type->value))hashmap_get_raw( \
+		&(map).base, hashmap_layout(map), (__typeof__((map).entry_type->key)[1]){(k)}))
+
+#define hashmap_contains(map, k) (hashmap_get((map), (k)) != NULL)
+
+// Evaluates to 1 if the key was present and removed, 0 otherwise
+#define hashmap_remove(map, k) \
+	hashmap_remove_raw(&(map).base, hashmap_layout(map), (__typeof__((map).entry_type->key)[1]){(k)})
+
+#define hashmap_foreach(map, k, v)                                                              \
+	for (size_t _i_##k = hashmap_next_raw(&(map).base, 0);                                      \
+		 _i_##k < (map).base.capacity &&                                                        \
+		 ((k) = hashmap_entries(map)[_i_##k].key, (v) = hashmap_entries(map)[_i_##k].value, 1); \
+		 _i_##k = hashmap_next_raw(&(map).base, _i_##k + 1))
+
+NONSTD_DEF u64 hashmap_hash_bytes(const void *key, size_t key_size);
+NONSTD_DEF int hashmap_equals_bytes(const void *a, const void *b, size_t key_size);
+NONSTD_DEF u64 hashmap_hash_sv(const void *key, size_t key_size);
+NONSTD_DEF int hashmap_equals_sv(const void *a, const void *b, size_t key_size);
+NONSTD_DEF void *hashmap_get_raw(const HashMapBase *m, HashMapLayout layout, const void *key);
+NONSTD_DEF void *hashmap_insert_raw(HashMapBase *m, HashMapLayout layout, const void *key);
+NONSTD_DEF int hashmap_remove_raw(HashMapBase *m, HashMapLayout layout, const void *key);
+NONSTD_DEF int hashmap_reserve_raw(HashMapBase *m, HashMapLayout layout, size_t count);
+NONSTD_DEF size_t hashmap_next_raw(const HashMapBase *m, size_t index);
+NONSTD_DEF void hashmap_clear_raw(HashMapBase *m);
+NONSTD_DEF void hashmap_free_raw(HashMapBase *m);
+
+// Virtual memory - reserve address space up front, commit pages on demand
+NONSTD_DEF size_t vm_page_size(void);
+NONSTD_DEF void *vm_reserve(size_t size);
+NONSTD_DEF int vm_commit(void *addr, size_t size);
+NONSTD_DEF void vm_decommit(void *addr, size_t size);
+NONSTD_DEF void vm_release(void *addr, size_t size);
+// Commits more of the reservation at base so that `needed` bytes are usable,
+// at least doubling the committed size. Returns the new committed size, or
+// `committed` unchanged when needed exceeds `reserved` or the commit fails.
+NONSTD_DEF size_t vm_grow(void *base, size_t committed, size_t needed, size_t reserved);
+// Decommits everything past `keep` bytes (rounded up to a page) and returns
+// the new committed size
+NONSTD_DEF size_t vm_trim(void *base, size_t committed, size_t keep);
+
+// Stable array - like array(T), but the elements live in one reserved virtual
+// memory range that is committed as the array grows. Elements never move, so
+// pointers to them stay valid until stable_array_free, and growth never copies.
+// data and length match array(), so array_get, array_foreach and
+// array_as_slice work on it; never pass it to array_push or array_ensure.
+// Usage: stable_array(int) ids; stable_array_init(ids, 0); stable_array_push(ids, 7);
+#define stable_array(T)  \
+	struct {             \
+		T *data;         \
+		size_t length;   \
+		size_t capacity; \
+		size_t reserved; \
+	}
+
+#define STABLE_ARRAY_DEFAULT_RESERVE ARENA_VM_DEFAULT_RESERVE
+
+// Reserves room for max_length elements (0 reserves STABLE_ARRAY_DEFAULT_RESERVE
+// bytes). data is NULL when the reservation fails.
+#define stable_array_init(arr, max_length)                                                \
+	do {                                                                                  \
+		size_t _max = (max_length);                                                       \
+		size_t _bytes = _max ? _max * sizeof(*(arr).data) : STABLE_ARRAY_DEFAULT_RESERVE; \
+		int _overflow = _max > SIZE_MAX / sizeof(*(arr).data);                            \
+		(arr).data = _overflow ? NULL : vm_reserve(_bytes);                               \
+		(arr).length = 0;                                                                 \
+		(arr).capacity = 0;                                                               \
+		(arr).reserved = (arr).data ? _bytes / sizeof(*(arr).data) : 0;                   \
+	} while (0)
+
+#define stable_array_free(arr)                                        \
+	do {                                                              \
+		vm_release((arr).data, (arr).reserved * sizeof(*(arr).data)); \
+		(arr).data = NULL;                                            \
+		(arr).length = 0;                                             \
+		(arr).capacity = 0;                                           \
+		(arr).reserved = 0;                                           \
+	} while (0)
+
+#define stable_array_ensure(arr, additional)                                              \
+	do {                                                                                  \
+		size_t _needed = (arr).length + (additional);                                     \
+		if (_needed > (arr).capacity && _needed <= (arr).reserved) {                      \
+			size_t _item = sizeof(*(arr).data);                                           \
+			(arr).capacity = vm_grow((arr).data, (arr).capacity * _item, _needed * _item, \
+			                         (arr).reserved * _item) / _item;                     \
+		}                                                                                 \
+	} while (0)
+
+// Like array_push; does nothing once the reservation is full
+#define stable_array_push(arr, value)             \
+	do {                                          \
+		stable_array_ensure((arr), 1);            \
+		if ((arr).length < (arr).capacity) {      \
+			(arr).data[(arr).length++] = (value); \
+		}                                         \
+	} while (0)
+
+#define stable_array_push_n(arr, values, count)                                        \
+	do {                                                                               \
+		size_t _count = (count);                                                       \
+		stable_array_ensure((arr), _count);                                            \
+		if (_count && (arr).capacity - (arr).length >= _count) {                       \
+			memcpy((arr).data + (arr).length, (values), _count * sizeof(*(arr).data)); \
+			(arr).length += _count;                                                    \
+		}                                                                              \
+	} while (0)
+
+#define stable_array_pop(arr) array_pop(arr)
+#define stable_array_get(arr, index) array_get(arr, index)
+#define stable_array_foreach(arr, var) array_foreach(arr, var)
+#define stable_array_clear(arr) array_clear(arr)
+
+// Returns the committed pages past the current length to the OS
+#define stable_array_trim(arr)                                                                      \
+	do {                                                                                            \
+		size_t _item = sizeof(*(arr).data);                                                         \
+		(arr).capacity = vm_trim((arr).data, (arr).capacity * _item, (arr).length * _item) / _item; \
+	} while (0)
+
+// Small array - like array(T), but the first N elements live inline in the
+// struct and nothing is allocated until the length exceeds N. The struct never
+// points into itself, so an inline small array can be copied or returned by
+// value. Use small_array_data instead of .data.
+// Usage: small_array(Token, 8) toks; small_array_init(toks); small_array_push(toks, t);
+#define small_array(T, N) \
+	struct {              \
+		T *heap;          \
+		size_t length;    \
+		size_t capacity;  \
+		T inline_data[N]; \
+	}
+
+#define small_array_init(arr)                        \
+	do {                                             \
+		(arr).heap = NULL;                           \
+		(arr).length = 0;                            \
+		(arr).capacity = countof((arr).inline_data); \
+	} while (0)
+
+#define small_array_free(arr)                        \
+	do {                                             \
+		FREE((arr).heap);                            \
+		(arr).length = 0;                            \
+		(arr).capacity = countof((arr).inline_data); \
+	} while (0)
+
+#define small_array_data(arr) ((arr).heap ? (arr).heap : (arr).inline_data)
+#define small_array_is_inline(arr) ((arr).heap == NULL)
+
+// Spilling moves every element to the heap, which invalidates pointers into
+// the inline storage
+#define small_array_ensure(arr, additional)                              \
+	do {                                                                 \
+		size_t _needed = (arr).length + (additional);                    \
+		if (_needed > (arr).capacity) {                                  \
+			size_t _new_cap = (arr).capacity;                            \
+			while (_new_cap < _needed) {                                 \
+				if (_new_cap > SIZE_MAX / 2) {                           \
+					_new_cap = SIZE_MAX;                                 \
+					break;                                               \
+				}                                                        \
+				_new_cap *= 2;                                           \
+			}                                                            \
+			if (_new_cap < _needed) { /* Overflow or OOM */              \
+				break;                                                   \
+			}                                                            \
+			void *_new_data =                                            \
+				safe_realloc((arr).heap, sizeof(*(arr).heap), _new_cap); \
+			if (_new_data) {                                             \
+				if (!(arr).heap) {                                       \
+					memcpy(_new_data, (arr).inline_data,                 \
+					       (arr).length * sizeof(*(arr).heap));          \
+				}                                                        \
+				(arr).heap = _new_data;                                  \
+				(arr).capacity = _new_cap;                               \
+			}                                                            \
+		}                                                                \
+	} while (0)
+
+#define small_array_push(arr, value)                        \
+	do {                                                    \
+		__typeof__(*(arr).heap) _value = (value);           \
+		small_array_ensure((arr), 1);                       \
+		if ((arr).length < (arr).capacity) {                \
+			small_array_data(arr)[(arr).length++] = _value; \
+		}                                                   \
+	} while (0)
+
+#define small_array_pop(arr) ((arr).length > 0 ? small_array_data(arr)[--(arr).length] : 0)
+
+#define small_array_get(arr, index) (small_array_data(arr)[index])
+
+#define small_array_set(arr, index, value)          \
+	do {                                            \
+		if ((index) < (arr).length) {               \
+			small_array_data(arr)[index] = (value); \
+		}                                           \
+	} while (0)
+
+#define small_array_clear(arr) array_clear(arr)
+
+#define small_array_foreach(arr, var)                                             \
+	for (size_t _i_##var = 0;                                                     \
+		 _i_##var < (arr).length && ((var) = small_array_data(arr)[_i_##var], 1); \
+		 ++_i_##var)
+
+#define small_array_as_slice(T, arr) \
+	((slice(T)){.data = small_array_data(arr), .length = (arr).length})
+
 // Arena - block-based memory allocator
+typedef struct {
+	char *data;
+	size_t size;
+} ArenaBlock;
+
+// Bump blocks start at block_size and double up to max_block_size. Requests
+// larger than large_threshold (0 means a quarter of block_size) that do not
+// fit the current block get a dedicated allocation in large, so the bump
+// block stays in use.
+// Virtual arenas (arena_make_virtual) instead bump through one reserved range
+// starting at vm_base, with end marking the committed part and block_size
+// used as the commit granularity. Their allocations never move.
 typedef struct {
 	char *ptr;
 	char *end;
-	array(char *) blocks;
+	size_t current; // index of the block ptr points into
+	array(ArenaBlock) blocks;
+	array(ArenaBlock) large;
+	size_t block_size;
+	size_t max_block_size;
+	size_t large_threshold;
+	char *vm_base;
+	size_t vm_reserved;
 } Arena;
 
+// Allocation checkpoint, see arena_mark and arena_rewind
+typedef struct {
+	size_t block;
+	char *ptr;
+	size_t large;
+} ArenaMark;
+
 #define ARENA_DEFAULT_BLOCK_SIZE (4096)
+#define ARENA_MAX_BLOCK_SIZE ((size_t)1 << 20)
+#define ARENA_VM_COMMIT_SIZE ((size_t)64 << 10)
+#define ARENA_VM_HUGEPAGE_SIZE ((size_t)2 << 20)
+#define ARENA_VM_DEFAULT_RESERVE (sizeof(void *) >= 8 ? (size_t)64 << 30 : (size_t)256 << 20)
+
+// Flags for arena_make_virtual
+#define ARENA_VM_HUGEPAGES (1 << 0)
 
 NONSTD_DEF Arena arena_make(void);
+NONSTD_DEF Arena arena_make_sized(size_t block_size);
+NONSTD_DEF Arena arena_make_virtual(size_t reserve_size, int flags);
 NONSTD_DEF void arena_grow(Arena *a, size_t min_size);
 NONSTD_DEF void *arena_alloc(Arena *a, size_t size);
 NONSTD_DEF void arena_free(Arena *a);
+NONSTD_DEF void arena_reset(Arena *a);
+NONSTD_DEF ArenaMark arena_mark(const Arena *a);
+NONSTD_DEF void arena_rewind(Arena *a, ArenaMark mark);
+
+// Scratch scope - everything allocated inside the following block is released
+// when it ends. Leaving the block with break, return or goto skips the rewind.
+// Usage: arena_scratch(&arena) { char *tmp = arena_alloc(&arena, 256); }
+#define arena_scratch(a)                                                           \
+	for (ArenaMark _scratch_mark = arena_mark(a), *_scratch_once = &_scratch_mark; \
+		 _scratch_once; arena_rewind((a), _scratch_mark), _scratch_once = NULL)
 
 // Image - simple RGB image structure
 typedef struct {
@@ -297,6 +744,7 @@ NONSTD_DEF void ppm_free(Canvas *img);
 NONSTD_DEF void ppm_set_pixel(Canvas *img, u32 x, u32 y, Color color);
 NONSTD_DEF Color ppm_get_pixel(const Canvas *img, u32 x, u32 y);
 NONSTD_DEF int ppm_save(const Canvas *img, const char *filename);
+NONSTD_DEF int ppm_save_binary(const Canvas *img, const char *filename);
 NONSTD_DEF Canvas ppm_read(const char *filename);
 NONSTD_DEF void ppm_fill(Canvas *canvas, Color color);
 NONSTD_DEF void ppm_draw_rect(Canvas *canvas, u32 x, u32 y, u32 w, u32 h, Color color);
@@ -311,6 +759,21 @@ NONSTD_DEF stringb read_entire_file_sb(const char *filepath);
 NONSTD_DEF int write_file_sv(const char *filepath, stringv sv);
 NONSTD_DEF int write_file_sb(const char *filepath, const stringb *sb);
 
+// Memory-mapped file - read-only, zero-copy view of a file in the page cache
+typedef struct {
+	const char *data;
+	size_t length;
+} MappedFile;
+
+// Access hints for map_entire_file, can be OR-ed together
+#define FILE_MAP_SEQUENTIAL (1 << 0)
+#define FILE_MAP_WILLNEED (1 << 1)
+#define FILE_MAP_HUGEPAGE (1 << 2)
+
+NONSTD_DEF MappedFile map_entire_file(const char *filepath, int hints);
+NONSTD_DEF void unmap_file(MappedFile *mf);
+NONSTD_DEF stringv mf_as_sv(const MappedFile *mf);
+
 // Logging
 typedef enum {
 	LOG_ERROR,
@@ -322,11 +785,239 @@ typedef enum {
 NONSTD_DEF void set_log_level(LogLevel level);
 NONSTD_DEF LogLevel get_log_level_from_env(void);
 NONSTD_DEF void log_message(FILE *stream, LogLevel level, const char *format, ...);
+NONSTD_DEF void log_register_stream(FILE *stream);
+
+// Levels above NONSTD_LOG_COMPILE_LEVEL (0 = ERROR ... 3 = DEBUG, -1 = none)
+// are compiled out of the LOG_*_MSG and BINLOG_* macros, their arguments
+// are type-checked but never evaluated.
+#ifndef NONSTD_LOG_COMPILE_LEVEL
+#define NONSTD_LOG_COMPILE_LEVEL 3
+#endif
+
+// Every LOG_*_MSG call site owns a static LogSite. Its enabled flag is worked
+// out on first use from the runtime level and the log_enable_sites rules, so
+// a disabled site costs a single branch.
+#define LOG_SITE_UNRESOLVED 2
+
+typedef struct LogSite {
+	const char *file;
+	int line;
+	LogLevel level;
+	int enabled; // 0, 1 or LOG_SITE_UNRESOLVED
+	struct LogSite *next;
+} LogSite;
+
+NONSTD_DEF int log_site_resolve(LogSite *site);
+NONSTD_DEF void log_site_message(const LogSite *site, FILE *stream, const char *format, ...);
+NONSTD_DEF size_t log_enable_sites(const char *pattern, int enabled);
+NONSTD_DEF void log_reset_site_rules(void);
+
+#define LOG_AT(stream, log_level, ...)                                                         \
+	do {                                                                                       \
+		static LogSite log_site_ = {__FILE__, __LINE__, log_level, LOG_SITE_UNRESOLVED, NULL}; \
+		int log_enabled_ = __atomic_load_n(&log_site_.enabled, __ATOMIC_RELAXED);              \
+		if (log_enabled_ && (log_enabled_ == 1 || log_site_resolve(&log_site_))) {             \
+			log_site_message(&log_site_, stream, __VA_ARGS__);                                 \
+		}                                                                                      \
+	} while (0)
+
+#define LOG_COMPILED_OUT(...)                            \
+	do {                                                 \
+		if (0) {                                         \
+			log_message(stderr, LOG_ERROR, __VA_ARGS__); \
+		}                                                \
+	} while (0)
+
+#if NONSTD_LOG_COMPILE_LEVEL >= 0
+#define LOG_ERROR_MSG(...) LOG_AT(stderr, LOG_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR_MSG(...) LOG_COMPILED_OUT(__VA_ARGS__)
+#endif
+#if NONSTD_LOG_COMPILE_LEVEL >= 1
+#define LOG_WARN_MSG(...) LOG_AT(stderr, LOG_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN_MSG(...) LOG_COMPILED_OUT(__VA_ARGS__)
+#endif
+#if NONSTD_LOG_COMPILE_LEVEL >= 2
+#define LOG_INFO_MSG(...) LOG_AT(stdout, LOG_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO_MSG(...) LOG_COMPILED_OUT(__VA_ARGS__)
+#endif
+#if NONSTD_LOG_COMPILE_LEVEL >= 3
+#define LOG_DEBUG_MSG(...) LOG_AT(stdout, LOG_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG_MSG(...) LOG_COMPILED_OUT(__VA_ARGS__)
+#endif
+
+// Rate limiting and sampling - LOG_RATE_LIMITED lets at most per_second
+// messages through a call site (bursts up to per_second) using a lock-free
+// GCRA token bucket stored next to the site. Suppressed calls are reported
+// in a "suppressed N messages" summary line: before the next message that
+// passes, once per second while a storm lasts, and on log_limit_flush for
+// storms that ended. log_async_flush and log_async_stop flush them too.
+// LOG_SAMPLED logs the first of every `every` calls.
+typedef struct LogLimiter {
+	u64 tat; // theoretical arrival time of the next message, in ns
+	u64 suppressed;
+	u64 since; // when the first of the suppressed calls happened, in ns
+	u64 calls;
+	// Set when the limiter first suppresses a call, for log_limit_flush
+	const LogSite *site;
+	FILE *stream;
+	int registered;
+	struct LogLimiter *next;
+} LogLimiter;
+
+NONSTD_DEF int log_limit_allow_at(LogLimiter *limiter, u32 per_second, u64 now_ns);
+// The limiter must be static, it is kept in a global list once it suppresses a call
+NONSTD_DEF int log_limit_allow(LogLimiter *limiter, u32 per_second, const LogSite *site, FILE *stream);
+NONSTD_DEF int log_sample_allow(LogLimiter *limiter, u32 every);
+// Writes the summary line of every rate limited site with suppressed calls
+NONSTD_DEF void log_limit_flush(void);
+
+#define LOG_LIMITED_AT(stream, log_level, allow, ...)                                          \
+	do {                                                                                       \
+		static LogSite log_site_ = {__FILE__, __LINE__, log_level, LOG_SITE_UNRESOLVED, NULL}; \
+		static LogLimiter log_limiter_ = {0};                                                  \
+		int log_enabled_ = __atomic_load_n(&log_site_.enabled, __ATOMIC_RELAXED);              \
+		if ((int)(log_level) <= NONSTD_LOG_COMPILE_LEVEL && log_enabled_ &&                    \
+		    (log_enabled_ == 1 || log_site_resolve(&log_site_)) && (allow)) {                  \
+			log_site_message(&log_site_, stream, __VA_ARGS__);                                 \
+		}                                                                                      \
+	} while (0)
+
+#define LOG_RATE_LIMITED(stream, log_level, per_second, ...) \
+	LOG_LIMITED_AT(stream, log_level, log_limit_allow(&log_limiter_, (per_second), &log_site_, stream), __VA_ARGS__)
+#define LOG_SAMPLED(stream, log_level, every, ...) \
+	LOG_LIMITED_AT(stream, log_level, log_sample_allow(&log_limiter_, (every)), __VA_ARGS__)
+
+// Structured logging - typed key/value fields written as one JSON object or
+// logfmt line, rendered into a per-thread scratch buffer without allocating.
+typedef enum {
+	LOG_FORMAT_JSON,
+	LOG_FORMAT_LOGFMT,
+} LogFormat;
+
+typedef enum {
+	LOG_KV_INT,
+	LOG_KV_UINT,
+	LOG_KV_FLOAT,
+	LOG_KV_STR,
+	LOG_KV_BOOL,
+} LogKvType;
+
+typedef struct {
+	const char *key;
+	LogKvType type;
+	union {
+		i64 i;
+		u64 u;
+		double f;
+		stringv s;
+		int b;
+	} as;
+} LogKv;
+
+#define KV_INT(k, v) ((LogKv){.key = (k), .type = LOG_KV_INT, .as.i = (i64)(v)})
+#define KV_UINT(k, v) ((LogKv){.key = (k), .type = LOG_KV_UINT, .as.u = (u64)(v)})
+#define KV_FLOAT(k, v) ((LogKv){.key = (k), .type = LOG_KV_FLOAT, .as.f = (double)(v)})
+#define KV_STR(k, v) ((LogKv){.key = (k), .type = LOG_KV_STR, .as.s = (v)})
+#define KV_CSTR(k, v) ((LogKv){.key = (k), .type = LOG_KV_STR, .as.s = sv_from_cstr(v)})
+#define KV_BOOL(k, v) ((LogKv){.key = (k), .type = LOG_KV_BOOL, .as.b = !!(v)})
+
+NONSTD_DEF void log_set_format(LogFormat format);
+NONSTD_DEF void log_kv(FILE *stream, LogLevel level, const char *message, const LogKv *fields, size_t count);
+NONSTD_DEF void log_kv_emit(FILE *stream, LogLevel level, const char *message, const LogKv *fields, size_t count);
+NONSTD_DEF void log_kv_render(stringb *sb, LogFormat format, LogLevel level, const char *message, const LogKv *fields, size_t count);
+
+// LOG_KV(stdout, LOG_INFO, "request done", KV_INT("status", 200), KV_CSTR("path", p));
+// Takes at least one field and shares the call-site flag of LOG_AT.
+#define LOG_KV(stream, log_level, message, ...)                                                \
+	do {                                                                                       \
+		static LogSite log_site_ = {__FILE__, __LINE__, log_level, LOG_SITE_UNRESOLVED, NULL}; \
+		int log_enabled_ = __atomic_load_n(&log_site_.enabled, __ATOMIC_RELAXED);              \
+		if ((int)(log_level) <= NONSTD_LOG_COMPILE_LEVEL && log_enabled_ &&                    \
+		    (log_enabled_ == 1 || log_site_resolve(&log_site_))) {                             \
+			const LogKv log_kv_fields_[] = {__VA_ARGS__};                                      \
+			log_kv_emit(stream, log_level, message, log_kv_fields_, countof(log_kv_fields_));  \
+		}                                                                                      \
+	} while (0)
+
+// Asynchronous logging - while started, log_message formats each line into a
+// lock-free ring buffer and a background thread writes batches with writev.
+// Lines longer than message_size are truncated. Streams without a file
+// descriptor, such as fmemopen buffers, are still written synchronously.
+typedef enum {
+	LOG_OVERFLOW_BLOCK,		  // wait for the writer to free a slot
+	LOG_OVERFLOW_DROP,		  // discard the message
+	LOG_OVERFLOW_DROP_REPORT, // discard it and have the writer report the count
+} LogOverflow;
+
+typedef struct {
+	size_t capacity;	 // number of slots, rounded up to a power of two (0 = 4096)
+	size_t message_size; // bytes per slot including the newline (0 = 512)
+	LogOverflow overflow;
+} LogAsyncConfig;
+
+NONSTD_DEF int log_async_start(LogAsyncConfig config);
+NONSTD_DEF void log_async_flush(void);
+NONSTD_DEF void log_async_stop(void);
+NONSTD_DEF u64 log_async_dropped(void);
+
+// Binary logging - each call site registers its format string once, after
+// that a call only copies a timestamp and the raw argument bytes into a
+// per-thread buffer. binlog_decode turns the file back into the text layout
+// of log_message. The file uses the writer's native byte order and sizes.
+// Buffers are flushed when full, when a thread exits and on binlog_flush.
+// Timestamps are cycles_now() ticks; the file header maps them to wall time.
+// binlog_close only flushes the calling thread, other threads must call
+// binlog_flush first or their buffered events are dropped.
+#define BINLOG_MAX_ARGS 16
 
-#define LOG_INFO_MSG(...) log_message(stdout, LOG_INFO, __VA_ARGS__)
-#define LOG_DEBUG_MSG(...) log_message(stdout, LOG_DEBUG, __VA_ARGS__)
-#define LOG_WARN_MSG(...) log_message(stderr, LOG_WARN, __VA_ARGS__)
-#define LOG_ERROR_MSG(...) log_message(stderr, LOG_ERROR, __VA_ARGS__)
+typedef struct {
+	const char *format;
+	const char *file;
+	int line;
+	LogLevel level;
+	u32 id; // 0 until the site is first used
+	u8 arg_count;
+	u8 arg_types[BINLOG_MAX_ARGS];
+} BinlogSite;
+
+NONSTD_DEF int binlog_open(const char *path);
+NONSTD_DEF void binlog_flush(void);
+NONSTD_DEF void binlog_close(void);
+NONSTD_DEF void binlog_write(BinlogSite *site, const char *format, ...);
+NONSTD_DEF long binlog_decode(const char *data, size_t size, FILE *out);
+
+#define BINLOG_FIRST_(first, ...) first
+#define BINLOG_FIRST(...) BINLOG_FIRST_(__VA_ARGS__, 0)
+#define BINLOG(log_level, ...)                                                                                                          \
+	do {                                                                                                                                \
+		static BinlogSite binlog_site_ = {.format = BINLOG_FIRST(__VA_ARGS__), .file = __FILE__, .line = __LINE__, .level = log_level}; \
+		binlog_write(&binlog_site_, __VA_ARGS__);                                                                                       \
+	} while (0)
+
+#if NONSTD_LOG_COMPILE_LEVEL >= 0
+#define BINLOG_ERROR(...) BINLOG(LOG_ERROR, __VA_ARGS__)
+#else
+#define BINLOG_ERROR(...) LOG_COMPILED_OUT(__VA_ARGS__)
+#endif
+#if NONSTD_LOG_COMPILE_LEVEL >= 1
+#define BINLOG_WARN(...) BINLOG(LOG_WARN, __VA_ARGS__)
+#else
+#define BINLOG_WARN(...) LOG_COMPILED_OUT(__VA_ARGS__)
+#endif
+#if NONSTD_LOG_COMPILE_LEVEL >= 2
+#define BINLOG_INFO(...) BINLOG(LOG_INFO, __VA_ARGS__)
+#else
+#define BINLOG_INFO(...) LOG_COMPILED_OUT(__VA_ARGS__)
+#endif
+#if NONSTD_LOG_COMPILE_LEVEL >= 3
+#define BINLOG_DEBUG(...) BINLOG(LOG_DEBUG, __VA_ARGS__)
+#else
+#define BINLOG_DEBUG(...) LOG_COMPILED_OUT(__VA_ARGS__)
+#endif
 
 #define COLOR_RESET "\033[0m"
 #define COLOR_INFO "\033[32m"
@@ -334,6 +1025,654 @@ NONSTD_DEF void log_message(FILE *stream, LogLevel level, const char *format, ..
 #define COLOR_WARNING "\033[33m"
 #define COLOR_ERROR "\033[31m"
 
+// Timing - monotonic nanoseconds, a raw cycle counter (rdtsc/cntvct) with
+// calibration, and named scoped timers that accumulate per call site.
+NONSTD_DEF u64 time_now_ns(void);
+NONSTD_DEF u64 cycles_now(void);
+NONSTD_DEF double cycles_per_ns(void);
+NONSTD_DEF u64 cycles_to_ns(u64 cycles);
+
+typedef struct TimerSite {
+	const char *name;
+	const char *file;
+	int line;
+	u64 count;
+	u64 total; // in cycles
+	u64 min;
+	u64 max;
+	int registered;
+	struct TimerSite *next;
+} TimerSite;
+
+typedef struct {
+	TimerSite *site;
+	u64 start;
+} TimerScope;
+
+NONSTD_DEF TimerScope timer_begin(TimerSite *site);
+NONSTD_DEF void timer_end(TimerScope *scope);
+// Adds one measurement in cycles. The site is linked into a global list on first
+// use and must stay alive for the rest of the program (static storage).
+NONSTD_DEF void timer_record(TimerSite *site, u64 cycles);
+NONSTD_DEF void timer_summary(FILE *stream);
+// Logs one line per site to stdout, or to stream with timer_log_summary_stream
+NONSTD_DEF void timer_log_summary(LogLevel level);
+NONSTD_DEF void timer_log_summary_stream(FILE *stream, LogLevel level);
+NONSTD_DEF void timer_reset_all(void);
+
+// Declares the static site a timed scope records into
+#define TIMER_SITE(var, name) static TimerSite var = {(name), __FILE__, __LINE__, 0, 0, UINT64_MAX, 0, 0, NULL}
+
+// Times the following block and adds it to the statistics of `name`.
+// Leaving the block with break, return or goto skips the measurement.
+// It expands to a single for statement, so it can be the unbraced body of an
+// if or loop; the site lives in a statement expression (a GNU extension).
+// Usage: TIMER_SCOPE("parse") { parse(input); }
+#define TIMER_SCOPE(name)                                                                           \
+	for (TimerScope timer_scope_ = timer_begin(({ TIMER_SITE(timer_site_, name); &timer_site_; })); \
+		 timer_scope_.site; timer_end(&timer_scope_))
+
+// Tracing - span and instant events recorded into per-thread buffers and
+// written as Chrome Trace Event JSON, viewable in Perfetto or about:tracing.
+// Names and argument keys are stored by pointer and must outlive the trace.
+typedef struct {
+	const char *name;
+	const char *arg_name; // NULL when the event has no argument
+	i64 arg_value;
+	u64 timestamp; // cycles_now()
+	char phase;    // 'B' begin, 'E' end, 'i' instant, 'C' counter
+} TraceEvent;
+
+NONSTD_DEF void trace_start(void);
+NONSTD_DEF void trace_stop(void);
+NONSTD_DEF void trace_event(char phase, const char *name, const char *arg_name, i64 arg_value);
+NONSTD_DEF void trace_set_thread_name(const char *name);
+NONSTD_DEF size_t trace_event_count(void);
+NONSTD_DEF void trace_render(stringb *sb);
+NONSTD_DEF int trace_write(const char *path);
+// Frees all recorded events. No thread may be recording while it runs.
+NONSTD_DEF void trace_clear(void);
+
+#define TRACE_BEGIN(name) trace_event('B', (name), NULL, 0)
+#define TRACE_END(name) trace_event('E', (name), NULL, 0)
+#define TRACE_INSTANT(name) trace_event('i', (name), NULL, 0)
+#define TRACE_BEGIN_ARG(name, key, value) trace_event('B', (name), (key), (i64)(value))
+#define TRACE_INSTANT_ARG(name, key, value) trace_event('i', (name), (key), (i64)(value))
+#define TRACE_COUNTER(name, value) trace_event('C', (name), (name), (i64)(value))
+
+// Records the following block as one span. Leaving it with break, return or
+// goto skips the end event.
+// Usage: TRACE_SCOPE("load") { load_assets(); }
+#define TRACE_SCOPE(name)                                                      \
+	for (const char *trace_scope_ = (TRACE_BEGIN(name), (name)); trace_scope_; \
+		 TRACE_END(trace_scope_), trace_scope_ = NULL)
+
+// Histogram - fixed-size log-linear latency histogram (HDR style). Values
+// below 2^HIST_SUB_BITS are exact, larger ones fall into one of
+// 2^HIST_SUB_BITS buckets per power of two, so any recorded u64 is kept with
+// a relative error below 1/2^HIST_SUB_BITS (about 3%).
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct {
+	u64 counts[HIST_BUCKETS];
+	u64 total;
+	u64 min;
+	u64 max;
+	u64 sum;
+} Histogram;
+
+NONSTD_DEF void hist_init(Histogram *h);
+NONSTD_DEF void hist_reset(Histogram *h);
+NONSTD_DEF void hist_record(Histogram *h, u64 value);
+NONSTD_DEF void hist_record_n(Histogram *h, u64 value, u64 count);
+NONSTD_DEF void hist_merge(Histogram *dst, const Histogram *src);
+NONSTD_DEF u64 hist_percentile(const Histogram *h, double percentile);
+NONSTD_DEF double hist_mean(const Histogram *h);
+NONSTD_DEF size_t hist_bucket_index(u64 value);
+NONSTD_DEF u64 hist_bucket_low(size_t index);
+NONSTD_DEF u64 hist_bucket_high(size_t index);
+// Writes a summary line and the percentile distribution of the non-empty buckets
+NONSTD_DEF void hist_dump(const Histogram *h, FILE *stream);
+// Logs one line: count, min, mean, p50, p90, p99, p99.9 and max
+NONSTD_DEF void hist_log(const Histogram *h, FILE *stream, LogLevel level, const char *name);
+
+// Per-thread histograms for recording from many threads without contention.
+// Each thread records into its own Histogram and hist_set_merge sums them.
+typedef struct {
+	pthread_key_t key;
+	pthread_mutex_t mutex;
+	array(Histogram *) parts;
+} HistogramSet;
+
+NONSTD_DEF int hist_set_init(HistogramSet *set);
+NONSTD_DEF void hist_set_record(HistogramSet *set, u64 value);
+NONSTD_DEF void hist_set_merge(HistogramSet *set, Histogram *out);
+// No thread may be recording into the set while it is freed
+NONSTD_DEF void hist_set_free(HistogramSet *set);
+
+// Thread pool - fixed number of pthreads with per-worker work-stealing
+// deques (Chase-Lev). Tasks submitted from a worker go to its own deque,
+// tasks from other threads go through a shared injector queue.
+typedef void (*TaskFn)(void *arg);
+typedef void (*ParallelForFn)(size_t begin, size_t end, void *ctx);
+
+typedef struct {
+	i64 count;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} WaitGroup;
+
+typedef struct ThreadPool ThreadPool;
+
+NONSTD_DEF void wait_group_init(WaitGroup *wg);
+NONSTD_DEF void wait_group_add(WaitGroup *wg, i64 delta);
+NONSTD_DEF void wait_group_done(WaitGroup *wg);
+// Blocks until the count drops to zero. Inside a pool task use pool_wait,
+// which runs other tasks meanwhile.
+NONSTD_DEF void wait_group_wait(WaitGroup *wg);
+NONSTD_DEF void wait_group_destroy(WaitGroup *wg);
+
+// thread_count 0 uses one thread per online CPU
+NONSTD_DEF ThreadPool *pool_create(size_t thread_count);
+// Runs every task still queued, then joins the workers. Must not be called from a task.
+NONSTD_DEF void pool_destroy(ThreadPool *pool);
+NONSTD_DEF size_t pool_thread_count(const ThreadPool *pool);
+// Queues fn(arg). wg may be NULL; otherwise it is incremented now and
+// decremented when the task has run. A task that cannot be queued because
+// memory ran out runs on the calling thread before pool_submit returns.
+NONSTD_DEF void pool_submit(ThreadPool *pool, WaitGroup *wg, TaskFn fn, void *arg);
+// Waits for wg, executing queued tasks of the pool in the meantime
+NONSTD_DEF void pool_wait(ThreadPool *pool, WaitGroup *wg);
+// Calls fn on consecutive subranges of [begin, end) of at most grain elements
+// (0 picks one) across the pool and the calling thread, returning when all are done
+NONSTD_DEF void pool_parallel_for(ThreadPool *pool, size_t begin, size_t end, size_t grain, ParallelForFn fn, void *ctx);
+// Process-wide pool with one thread per CPU, created on first use
+NONSTD_DEF ThreadPool *pool_default(void);
+NONSTD_DEF void parallel_for(size_t begin, size_t end, size_t grain, ParallelForFn fn, void *ctx);
+
+// Parallel algorithms - generate typed for-each, map and reduce functions that
+// split data into chunks of PARALLEL_GRAIN elements on pool_default(). The
+// operation is a function or macro, so it is inlined in the chunk loop.
+// Chunking only depends on the length, and reductions combine the per-chunk
+// results in index order, so a reduction returns the same value on any number
+// of threads (including floating point sums) as long as combine is associative.
+// Use with array() or slice(): sum_u64(numbers.data, numbers.length)
+#ifndef PARALLEL_GRAIN
+#define PARALLEL_GRAIN 16384
+#endif
+
+#define PARALLEL_SUM(a, b) ((a) + (b))
+#define PARALLEL_IDENTITY(item, ctx) (*(item))
+
+// void name(T *data, size_t length, void *ctx) calling fn(T *item, void *ctx)
+#define PARALLEL_FOREACH_DEF(name, T, fn)                             \
+	typedef struct {                                                  \
+		T *data;                                                      \
+		void *ctx;                                                    \
+	} name##_ParallelArgs;                                            \
+	static void name##_chunk(size_t begin, size_t end, void *args_) { \
+		name##_ParallelArgs *args = args_;                            \
+		for (size_t _i = begin; _i < end; ++_i) {                     \
+			fn(&args->data[_i], args->ctx);                           \
+		}                                                             \
+	}                                                                 \
+	static inline void name(T *data, size_t length, void *ctx) {      \
+		name##_ParallelArgs args = {data, ctx};                       \
+		parallel_for(0, length, PARALLEL_GRAIN, name##_chunk, &args); \
+	}
+
+// void name(const T *in, U *out, size_t length, void *ctx) storing
+// out[i] = fn(const T *item, void *ctx)
+#define PARALLEL_MAP_DEF(name, T, U, fn)                                     \
+	typedef struct {                                                         \
+		const T *in;                                                         \
+		U *out;                                                              \
+		void *ctx;                                                           \
+	} name##_ParallelArgs;                                                   \
+	static void name##_chunk(size_t begin, size_t end, void *args_) {        \
+		name##_ParallelArgs *args = args_;                                   \
+		for (size_t _i = begin; _i < end; ++_i) {                            \
+			args->out[_i] = fn(&args->in[_i], args->ctx);                    \
+		}                                                                    \
+	}                                                                        \
+	static inline void name(const T *in, U *out, size_t length, void *ctx) { \
+		name##_ParallelArgs args = {in, out, ctx};                           \
+		parallel_for(0, length, PARALLEL_GRAIN, name##_chunk, &args);        \
+	}
+
+// R name(const T *data, size_t length, void *ctx) folding
+// map(const T *item, void *ctx) with combine(R, R), starting from identity
+#define PARALLEL_MAP_REDUCE_DEF(name, T, R, identity, map, combine)                                \
+	typedef struct {                                                                               \
+		const T *data;                                                                             \
+		R *partials;                                                                               \
+		void *ctx;                                                                                 \
+	} name##_ParallelArgs;                                                                         \
+	static inline R name##_range(const T *data, size_t begin, size_t end, void *ctx) {             \
+		UNUSED(ctx); /* map may ignore it */                                                       \
+		R _acc = (identity);                                                                       \
+		for (size_t _i = begin; _i < end; ++_i) {                                                  \
+			R _value = map(&data[_i], ctx);                                                        \
+			_acc = combine(_acc, _value);                                                          \
+		}                                                                                          \
+		return _acc;                                                                               \
+	}                                                                                              \
+	static void name##_chunk(size_t begin, size_t end, void *args_) {                              \
+		name##_ParallelArgs *args = args_;                                                         \
+		args->partials[begin / PARALLEL_GRAIN] = name##_range(args->data, begin, end, args->ctx);  \
+	}                                                                                              \
+	static inline R name(const T *data, size_t length, void *ctx) {                                \
+		size_t _chunks = length / PARALLEL_GRAIN + (length % PARALLEL_GRAIN != 0);                 \
+		R _stack_partials[64];                                                                     \
+		R *_partials = _chunks <= countof(_stack_partials) ? _stack_partials : ALLOC(R, _chunks);  \
+		if (!_partials) {                                                                          \
+			/* No room for the partials: same chunks and order on the calling thread */            \
+			R _result = (identity);                                                                \
+			for (size_t _begin = 0; _begin < length; _begin += PARALLEL_GRAIN) {                   \
+				size_t _end = length - _begin > PARALLEL_GRAIN ? _begin + PARALLEL_GRAIN : length; \
+				_result = combine(_result, name##_range(data, _begin, _end, ctx));                 \
+			}                                                                                      \
+			return _result;                                                                        \
+		}                                                                                          \
+		name##_ParallelArgs args = {data, _partials, ctx};                                         \
+		parallel_for(0, length, PARALLEL_GRAIN, name##_chunk, &args);                              \
+		R _result = (identity);                                                                    \
+		for (size_t _c = 0; _c < _chunks; ++_c) {                                                  \
+			_result = combine(_result, _partials[_c]);                                             \
+		}                                                                                          \
+		if (_partials != _stack_partials) {                                                        \
+			FREE(_partials);                                                                       \
+		}                                                                                          \
+		return _result;                                                                            \
+	}
+
+// T name(const T *data, size_t length), e.g.
+// PARALLEL_REDUCE_DEF(sum_u64, u64, 0, PARALLEL_SUM) or (max_i32, i32, INT32_MIN, MAX)
+#define PARALLEL_REDUCE_DEF(name, T, identity, combine)                                    \
+	PARALLEL_MAP_REDUCE_DEF(name##_map_reduce, T, T, identity, PARALLEL_IDENTITY, combine) \
+	static inline T name(const T *data, size_t length) {                                   \
+		return name##_map_reduce(data, length, NULL);                                      \
+	}
+
+// Sorting - comparison sorts generated per element type, so the comparison is
+// inlined instead of called through a pointer as with qsort. `less(a, b)` is a
+// function or macro taking two elements (not pointers), e.g.
+//   #define BY_ID(a, b) ((a).id < (b).id)
+//   SORT_DEF(sort_users, User, BY_ID)
+// generates
+//   void sort_users(User *data, size_t length);          introsort, not stable
+//   void sort_users_stable(User *data, size_t length);   merge sort, O(n) buffer
+//   void sort_users_parallel(User *data, size_t length); stable, on pool_default()
+// Use with array() or slice(): sort_users(users.data, users.length)
+#define SORT_SMALL 24          // partitions up to this size use insertion sort
+#define SORT_STABLE_RUN 32     // merge sort starts from insertion-sorted runs of this size
+#define SORT_PARALLEL_MIN 65536 // smaller inputs are sorted on the calling thread
+
+// Insertion sort and a stable in-place merge sort (O(n log^2 n), no buffer)
+// shared by SORT_DEF and RADIX_SORT_DEF. The buffered sorts fall back to
+// name_stable_inplace when their buffer cannot be allocated.
+#define SORT_INPLACE_DEF_(name, T, less)                                                 \
+	static inline void name##_insertion(T *data, size_t length) {                        \
+		for (size_t _i = 1; _i < length; ++_i) {                                         \
+			T _value = data[_i];                                                         \
+			size_t _j = _i;                                                              \
+			while (_j > 0 && less(_value, data[_j - 1])) {                               \
+				data[_j] = data[_j - 1];                                                 \
+				--_j;                                                                    \
+			}                                                                            \
+			data[_j] = _value;                                                           \
+		}                                                                                \
+	}                                                                                    \
+	static inline void name##_reverse(T *data, size_t length) {                          \
+		for (; length > 1; ++data, length -= 2) {                                        \
+			T _tmp = data[0];                                                            \
+			data[0] = data[length - 1];                                                  \
+			data[length - 1] = _tmp;                                                     \
+		}                                                                                \
+	}                                                                                    \
+	/* Merges the sorted runs data[0, mid) and data[mid, length) by splitting */         \
+	/* the longer run in half, binary searching the other and rotating.       */         \
+	static void name##_merge_inplace(T *data, size_t mid, size_t length) {               \
+		while (mid > 0 && mid < length && less(data[mid], data[mid - 1])) {              \
+			size_t _cut1, _cut2, _lo, _hi;                                               \
+			if (mid > length - mid) {                                                    \
+				/* First element of the right run not less than data[_cut1] */           \
+				_cut1 = mid / 2;                                                         \
+				for (_lo = mid, _hi = length; _lo < _hi;) {                              \
+					size_t _m = _lo + (_hi - _lo) / 2;                                   \
+					if (less(data[_m], data[_cut1])) {                                   \
+						_lo = _m + 1;                                                    \
+					} else {                                                             \
+						_hi = _m;                                                        \
+					}                                                                    \
+				}                                                                        \
+				_cut2 = _lo;                                                             \
+			} else {                                                                     \
+				/* First element of the left run greater than data[_cut2 - 1] */         \
+				_cut2 = mid + (length - mid + 1) / 2;                                    \
+				for (_lo = 0, _hi = mid; _lo < _hi;) {                                   \
+					size_t _m = _lo + (_hi - _lo) / 2;                                   \
+					if (less(data[_cut2 - 1], data[_m])) {                               \
+						_hi = _m;                                                        \
+					} else {                                                             \
+						_lo = _m + 1;                                                    \
+					}                                                                    \
+				}                                                                        \
+				_cut1 = _lo;                                                             \
+			}                                                                            \
+			name##_reverse(data + _cut1, mid - _cut1);                                   \
+			name##_reverse(data + mid, _cut2 - mid);                                     \
+			name##_reverse(data + _cut1, _cut2 - _cut1);                                 \
+			size_t _new_mid = _cut1 + (_cut2 - mid);                                     \
+			name##_merge_inplace(data, _cut1, _new_mid);                                 \
+			data += _new_mid;                                                            \
+			mid = _cut2 - _new_mid;                                                      \
+			length -= _new_mid;                                                          \
+		}                                                                                \
+	}                                                                                    \
+	static void name##_stable_inplace(T *data, size_t length) {                          \
+		for (size_t _i = 0; _i < length; _i += SORT_STABLE_RUN) {                        \
+			name##_insertion(data + _i, MIN((size_t)SORT_STABLE_RUN, length - _i));      \
+		}                                                                                \
+		for (size_t _width = SORT_STABLE_RUN; _width < length; _width *= 2) {            \
+			for (size_t _lo = 0; _lo + _width < length; _lo += 2 * _width) {             \
+				name##_merge_inplace(data + _lo, _width, MIN(2 * _width, length - _lo)); \
+			}                                                                            \
+		}                                                                                \
+	}
+
+#define SORT_LESS(a, b) ((a) < (b))
+#define SORT_GREATER(a, b) ((b) < (a))
+
+#define SORT_DEF(name, T, less)                                                                       \
+	SORT_INPLACE_DEF_(name, T, less)                                                                  \
+	static inline void name##_swap(T *a, T *b) {                                                      \
+		T _tmp = *a;                                                                                  \
+		*a = *b;                                                                                      \
+		*b = _tmp;                                                                                    \
+	}                                                                                                 \
+	/* Optimal sorting networks for 2..8 elements, branch-free compare-exchanges */                   \
+	static inline void name##_network(T *data, size_t length) {                                       \
+		static const u8 _pairs[] = {                                                                  \
+			0, 1, 0, 2, 0, 1, 1, 2, 0, 2, 1, 3, 0, 1, 2, 3, 1, 2, 0, 3, 1, 4, 0, 2, 1, 3, 0, 1, 2, 4, \
+			1, 2, 3, 4, 2, 3, 0, 5, 1, 3, 2, 4, 1, 2, 3, 4, 0, 3, 2, 5, 0, 1, 2, 3, 4, 5, 1, 2, 3, 4, \
+			0, 6, 2, 3, 4, 5, 0, 2, 1, 4, 3, 6, 0, 1, 2, 5, 3, 4, 1, 2, 4, 6, 2, 3, 4, 5, 1, 2, 3, 4, \
+			5, 6, 0, 2, 1, 3, 4, 6, 5, 7, 0, 4, 1, 5, 2, 6, 3, 7, 0, 1, 2, 3, 4, 5, 6, 7, 2, 4, 3, 5, \
+			1, 4, 3, 6, 1, 2, 3, 4, 5, 6};                                                            \
+		static const u8 _offsets[] = {0, 0, 0, 1, 4, 9, 18, 30, 46, 65};                              \
+		for (size_t _p = _offsets[length]; _p < _offsets[length + 1]; ++_p) {                         \
+			T *_x = &data[_pairs[2 * _p]];                                                            \
+			T *_y = &data[_pairs[2 * _p + 1]];                                                        \
+			T _a = *_x, _b = *_y;                                                                     \
+			int _swap = less(_b, _a);                                                                 \
+			*_x = _swap ? _b : _a;                                                                    \
+			*_y = _swap ? _a : _b;                                                                    \
+		}                                                                                             \
+	}                                                                                                 \
+	static inline void name##_sift_down(T *data, size_t root, size_t length) {                        \
+		for (size_t _child; (_child = 2 * root + 1) < length; root = _child) {                        \
+			if (_child + 1 < length && less(data[_child], data[_child + 1])) {                        \
+				++_child;                                                                             \
+			}                                                                                         \
+			if (!less(data[root], data[_child])) {                                                    \
+				break;                                                                                \
+			}                                                                                         \
+			name##_swap(&data[root], &data[_child]);                                                  \
+		}                                                                                             \
+	}                                                                                                 \
+	static void name##_heapsort(T *data, size_t length) {                                             \
+		for (size_t _i = length / 2; _i-- > 0;) {                                                     \
+			name##_sift_down(data, _i, length);                                                       \
+		}                                                                                             \
+		for (size_t _end = length; _end-- > 1;) {                                                     \
+			name##_swap(&data[0], &data[_end]);                                                       \
+			name##_sift_down(data, 0, _end);                                                          \
+		}                                                                                             \
+	}                                                                                                 \
+	/* Quicksort with a branch-free Lomuto partition around the median of three.  */                  \
+	/* When the pivot equals the element before the range (the parent pivot),     */                  \
+	/* all elements equal to it are split off and skipped, so duplicates stay     */                  \
+	/* linear. Recurses into the smaller side, falls back to heapsort at depth 0. */                  \
+	static void name##_introsort(T *data, size_t length, int depth, int has_pred) {                   \
+		while (length > SORT_SMALL) {                                                                 \
+			if (depth-- == 0) {                                                                       \
+				name##_heapsort(data, length);                                                        \
+				return;                                                                               \
+			}                                                                                         \
+			size_t _mid = length / 2, _last = length - 1;                                             \
+			if (less(data[_mid], data[0])) {                                                          \
+				name##_swap(&data[_mid], &data[0]);                                                   \
+			}                                                                                         \
+			if (less(data[_last], data[_mid])) {                                                      \
+				name##_swap(&data[_last], &data[_mid]);                                               \
+			}                                                                                         \
+			if (less(data[_mid], data[0])) {                                                          \
+				name##_swap(&data[_mid], &data[0]);                                                   \
+			}                                                                                         \
+			name##_swap(&data[0], &data[_mid]);                                                       \
+			T _pivot = data[0];                                                                       \
+			size_t _store = 1;                                                                        \
+			if (has_pred && !less(data[-1], _pivot)) {                                                \
+				for (size_t _i = 1; _i < length; ++_i) {                                              \
+					T _value = data[_i];                                                              \
+					int _equal = !less(_pivot, _value);                                               \
+					data[_i] = data[_store];                                                          \
+					data[_store] = _value;                                                            \
+					_store += _equal;                                                                 \
+				}                                                                                     \
+				data += _store;                                                                       \
+				length -= _store;                                                                     \
+				continue;                                                                             \
+			}                                                                                         \
+			for (size_t _i = 1; _i < length; ++_i) {                                                  \
+				T _value = data[_i];                                                                  \
+				int _smaller = less(_value, _pivot);                                                  \
+				data[_i] = data[_store];                                                              \
+				data[_store] = _value;                                                                \
+				_store += _smaller;                                                                   \
+			}                                                                                         \
+			size_t _p = _store - 1;                                                                   \
+			name##_swap(&data[0], &data[_p]);                                                         \
+			if (_p < length - _p - 1) {                                                               \
+				name##_introsort(data, _p, depth, has_pred);                                          \
+				data += _p + 1;                                                                       \
+				length -= _p + 1;                                                                     \
+				has_pred = 1;                                                                         \
+			} else {                                                                                  \
+				name##_introsort(data + _p + 1, length - _p - 1, depth, 1);                           \
+				length = _p;                                                                          \
+			}                                                                                         \
+		}                                                                                             \
+		if (length <= 8) {                                                                            \
+			name##_network(data, length);                                                             \
+		} else {                                                                                      \
+			name##_insertion(data, length);                                                           \
+		}                                                                                             \
+	}                                                                                                 \
+	static inline void name(T *data, size_t length) {                                                 \
+		int _depth = 0;                                                                               \
+		for (size_t _n = length; _n > 1; _n >>= 1) {                                                  \
+			_depth += 2;                                                                              \
+		}                                                                                             \
+		name##_introsort(data, length, _depth, 0);                                                    \
+	}                                                                                                 \
+	/* Merges src[lo, mid) and src[mid, hi) into dst, left side first on ties */                      \
+	static inline void name##_merge(const T *src, size_t lo, size_t mid, size_t hi, T *dst) {         \
+		size_t _i = lo, _j = mid, _k = lo;                                                            \
+		if (mid == lo || mid == hi || !less(src[mid], src[mid - 1])) {                                \
+			memcpy(dst + lo, src + lo, (hi - lo) * sizeof(T));                                        \
+			return;                                                                                   \
+		}                                                                                             \
+		while (_i < mid && _j < hi) {                                                                 \
+			int _right = less(src[_j], src[_i]);                                                      \
+			dst[_k++] = _right ? src[_j] : src[_i];                                                   \
+			_j += _right;                                                                             \
+			_i += !_right;                                                                            \
+		}                                                                                             \
+		memcpy(dst + _k, src + _i, (mid - _i) * sizeof(T));                                           \
+		_k += mid - _i;                                                                               \
+		memcpy(dst + _k, src + _j, (hi - _j) * sizeof(T));                                            \
+	}                                                                                                 \
+	/* Bottom-up merge sort of data using buffer, the result ends up in data */                       \
+	static void name##_stable_with(T *data, T *buffer, size_t length) {                               \
+		for (size_t _i = 0; _i < length; _i += SORT_STABLE_RUN) {                                     \
+			name##_insertion(data + _i, MIN((size_t)SORT_STABLE_RUN, length - _i));                   \
+		}                                                                                             \
+		T *_src = data, *_dst = buffer;                                                               \
+		for (size_t _width = SORT_STABLE_RUN; _width < length; _width *= 2) {                         \
+			for (size_t _lo = 0; _lo < length; _lo += 2 * _width) {                                   \
+				size_t _mid = MIN(_lo + _width, length), _hi = MIN(_lo + 2 * _width, length);         \
+				name##_merge(_src, _lo, _mid, _hi, _dst);                                             \
+			}                                                                                         \
+			T *_tmp = _src;                                                                           \
+			_src = _dst;                                                                              \
+			_dst = _tmp;                                                                              \
+		}                                                                                             \
+		if (_src != data) {                                                                           \
+			memcpy(data, _src, length * sizeof(T));                                                   \
+		}                                                                                             \
+	}                                                                                                 \
+	static inline void name##_stable(T *data, size_t length) {                                        \
+		if (length <= SORT_STABLE_RUN) {                                                              \
+			name##_insertion(data, length);                                                           \
+			return;                                                                                   \
+		}                                                                                             \
+		T *_buffer = ALLOC(T, length);                                                                \
+		if (!_buffer) {                                                                               \
+			name##_stable_inplace(data, length);                                                      \
+			return;                                                                                   \
+		}                                                                                             \
+		name##_stable_with(data, _buffer, length);                                                    \
+		FREE(_buffer);                                                                                \
+	}                                                                                                 \
+	typedef struct {                                                                                  \
+		T *src;                                                                                       \
+		T *dst;                                                                                       \
+		size_t length;                                                                                \
+		size_t width;                                                                                 \
+	} name##_SortArgs;                                                                                \
+	static void name##_sort_chunks(size_t begin, size_t end, void *args_) {                           \
+		name##_SortArgs *args = args_;                                                                \
+		for (size_t _c = begin; _c < end; ++_c) {                                                     \
+			size_t _lo = MIN(_c * args->width, args->length);                                         \
+			size_t _hi = MIN(_lo + args->width, args->length);                                        \
+			name##_stable_with(args->src + _lo, args->dst + _lo, _hi - _lo);                          \
+		}                                                                                             \
+	}                                                                                                 \
+	static void name##_merge_pairs(size_t begin, size_t end, void *args_) {                           \
+		name##_SortArgs *args = args_;                                                                \
+		for (size_t _p = begin; _p < end; ++_p) {                                                     \
+			size_t _lo = _p * 2 * args->width;                                                        \
+			size_t _mid = MIN(_lo + args->width, args->length);                                       \
+			size_t _hi = MIN(_lo + 2 * args->width, args->length);                                    \
+			name##_merge(args->src, _lo, _mid, _hi, args->dst);                                       \
+		}                                                                                             \
+	}                                                                                                 \
+	/* Sorts one chunk per thread, then merges pairs of runs in parallel rounds */                    \
+	static inline void name##_parallel(T *data, size_t length) {                                      \
+		ThreadPool *_pool = pool_default();                                                           \
+		size_t _threads = _pool ? pool_thread_count(_pool) + 1 : 1;                                   \
+		if (length < SORT_PARALLEL_MIN || _threads == 1) {                                            \
+			name##_stable(data, length);                                                              \
+			return;                                                                                   \
+		}                                                                                             \
+		size_t _chunks = 1;                                                                           \
+		while (_chunks < _threads && _chunks * 2 <= length / SORT_STABLE_RUN) {                       \
+			_chunks *= 2;                                                                             \
+		}                                                                                             \
+		T *_buffer = ALLOC(T, length);                                                                \
+		if (!_buffer) {                                                                               \
+			name##_stable_inplace(data, length);                                                      \
+			return;                                                                                   \
+		}                                                                                             \
+		name##_SortArgs args = {data, _buffer, length, (length + _chunks - 1) / _chunks};             \
+		pool_parallel_for(_pool, 0, _chunks, 1, name##_sort_chunks, &args);                           \
+		for (; args.width < length; args.width *= 2) {                                                \
+			size_t _pairs = (length + 2 * args.width - 1) / (2 * args.width);                         \
+			pool_parallel_for(_pool, 0, _pairs, 1, name##_merge_pairs, &args);                        \
+			T *_tmp = args.src;                                                                       \
+			args.src = args.dst;                                                                      \
+			args.dst = _tmp;                                                                          \
+		}                                                                                             \
+		if (args.src != data) {                                                                       \
+			memcpy(data, args.src, length * sizeof(T));                                               \
+		}                                                                                             \
+		FREE(_buffer);                                                                                \
+	}
+
+// Radix sort - stable LSD radix sort on an unsigned integer key (u8 to u64)
+// with one pass per key byte; passes where every key has the same byte are
+// skipped. `key(x)` maps an element (not a pointer) to its key. Signed and
+// floating point keys are mapped to order-preserving unsigned keys with the
+// SORT_KEY_* macros, which evaluate their argument more than once.
+//   #define BY_SCORE(x) SORT_KEY_F64((x).score)
+//   RADIX_SORT_DEF(sort_by_score, Player, u64, BY_SCORE)
+#define SORT_IDENTITY_KEY(x) (x)
+#define SORT_KEY_I32(x) ((u32)(i32)(x) ^ 0x80000000u)
+#define SORT_KEY_I64(x) ((u64)(i64)(x) ^ 0x8000000000000000ull)
+#define SORT_KEY_F32(x) (SORT_FLOAT_BITS_(float, u32, x) ^ ((0u - (SORT_FLOAT_BITS_(float, u32, x) >> 31)) | 0x80000000u))
+#define SORT_KEY_F64(x) (SORT_FLOAT_BITS_(double, u64, x) ^ ((0ull - (SORT_FLOAT_BITS_(double, u64, x) >> 63)) | 0x8000000000000000ull))
+#define SORT_FLOAT_BITS_(F, U, x) (((union { F f; U u; }){.f = (x)}).u)
+
+#define RADIX_SORT_DEF(name, T, K, key)                                         \
+	static inline int name##_key_less(T a, T b) {                               \
+		return (K)key(a) < (K)key(b);                                           \
+	}                                                                           \
+	SORT_INPLACE_DEF_(name, T, name##_key_less)                                 \
+	static inline void name(T *data, size_t length) {                           \
+		if (length <= SORT_SMALL) {                                             \
+			for (size_t _i = 1; _i < length; ++_i) {                            \
+				T _value = data[_i];                                            \
+				K _key = key(_value);                                           \
+				size_t _j = _i;                                                 \
+				while (_j > 0 && _key < (K)key(data[_j - 1])) {                 \
+					data[_j] = data[_j - 1];                                    \
+					--_j;                                                       \
+				}                                                               \
+				data[_j] = _value;                                              \
+			}                                                                   \
+			return;                                                             \
+		}                                                                       \
+		size_t _counts[sizeof(K)][256];                                         \
+		memset(_counts, 0, sizeof(_counts));                                    \
+		for (size_t _i = 0; _i < length; ++_i) {                                \
+			K _key = key(data[_i]);                                             \
+			for (size_t _b = 0; _b < sizeof(K); ++_b) {                         \
+				_counts[_b][(_key >> (8 * _b)) & 0xff]++;                       \
+			}                                                                   \
+		}                                                                       \
+		T *_buffer = ALLOC(T, length);                                          \
+		if (!_buffer) {                                                         \
+			name##_stable_inplace(data, length);                                \
+			return;                                                             \
+		}                                                                       \
+		T *_src = data, *_dst = _buffer;                                        \
+		for (size_t _b = 0; _b < sizeof(K); ++_b) {                             \
+			size_t *_count = _counts[_b];                                       \
+			size_t _shift = 8 * _b;                                             \
+			if (_count[((K)key(_src[0]) >> _shift) & 0xff] == length) {         \
+				continue;                                                       \
+			}                                                                   \
+			for (size_t _d = 0, _offset = 0; _d < 256; ++_d) {                  \
+				size_t _c = _count[_d];                                         \
+				_count[_d] = _offset;                                           \
+				_offset += _c;                                                  \
+			}                                                                   \
+			for (size_t _i = 0; _i < length; ++_i) {                            \
+				_dst[_count[((K)key(_src[_i]) >> _shift) & 0xff]++] = _src[_i]; \
+			}                                                                   \
+			T *_tmp = _src;                                                     \
+			_src = _dst;                                                        \
+			_dst = _tmp;                                                        \
+		}                                                                       \
+		if (_src != data) {                                                     \
+			memcpy(data, _src, length * sizeof(T));                             \
+		}                                                                       \
+		FREE(_buffer);                                                          \
+	}
+
 #endif // NONSTD_H
 
 #ifdef NONSTD_IMPLEMENTATION
@@ -387,422 +1726,3999 @@ NONSTD_DEF int sv_ends_with(stringv sv, stringv suffix) {
 	return sv.length >= suffix.length && memcmp(sv.data + sv.length - suffix.length, suffix.data, suffix.length) == 0;
 }
 
-// String Builder Implementation
+// String view search - SSE2/AVX2 kernels with a portable scalar fallback.
+// Every kernel uses unaligned loads and finishes the last partial block with
+// scalar code, so no byte past sv.data + sv.length is ever read.
+
+#if defined(__AVX2__)
+#define SV_SIMD_WIDTH 32
+typedef __m256i sv_simd_vec;
+#define sv_simd_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define sv_simd_splat(c) _mm256_set1_epi8(c)
+#define sv_simd_eq_mask(a, b) ((u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8((a), (b))))
+#elif defined(__SSE2__)
+#define SV_SIMD_WIDTH 16
+typedef __m128i sv_simd_vec;
+#define sv_simd_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define sv_simd_splat(c) _mm_set1_epi8(c)
+#define sv_simd_eq_mask(a, b) ((u32)_mm_movemask_epi8(_mm_cmpeq_epi8((a), (b))))
+#endif
 
-NONSTD_DEF void sb_init(stringb *sb, size_t initial_cap) {
-	sb->capacity = initial_cap ? initial_cap : 16;
-	sb->data = ALLOC(char, sb->capacity);
-	sb->length = 0;
-	if (sb->data) {
-		sb->data[0] = '\0';
+NONSTD_DEF size_t sv_find_char(stringv sv, char c) {
+	size_t i = 0;
+#ifdef SV_SIMD_WIDTH
+	sv_simd_vec needle = sv_simd_splat(c);
+	for (; i + SV_SIMD_WIDTH <= sv.length; i += SV_SIMD_WIDTH) {
+		u32 mask = sv_simd_eq_mask(sv_simd_load(sv.data + i), needle);
+		if (mask) {
+			return i + (size_t)__builtin_ctz(mask);
+		}
 	}
+#endif
+	if (i < sv.length) {
+		const char *p = memchr(sv.data + i, c, sv.length - i);
+		if (p) {
+			return (size_t)(p - sv.data);
+		}
+	}
+	return SV_NPOS;
 }
 
-NONSTD_DEF void sb_free(stringb *sb) {
-	FREE(sb->data);
-	sb->length = 0;
-	sb->capacity = 0;
-}
-
-NONSTD_DEF void sb_ensure(stringb *sb, size_t additional) {
-	size_t needed = sb->length + additional + 1;
-	size_t new_cap = sb->capacity;
-
-	if (needed > new_cap) {
-		while (new_cap < needed) {
-			if (new_cap > SIZE_MAX / 2) {
-				new_cap = SIZE_MAX;
-				break;
-			}
-			new_cap *= 2;
+NONSTD_DEF size_t sv_rfind_char(stringv sv, char c) {
+	size_t i = sv.length;
+#ifdef SV_SIMD_WIDTH
+	sv_simd_vec needle = sv_simd_splat(c);
+	for (; i >= SV_SIMD_WIDTH; i -= SV_SIMD_WIDTH) {
+		u32 mask = sv_simd_eq_mask(sv_simd_load(sv.data + i - SV_SIMD_WIDTH), needle);
+		if (mask) {
+			return i - SV_SIMD_WIDTH + (size_t)(31 - __builtin_clz(mask));
 		}
-		if (new_cap < needed)
-			return; // Overflow
-
-		char *new_data = safe_realloc(sb->data, sizeof(char), new_cap);
-		if (new_data) {
-			sb->data = new_data;
-			sb->capacity = new_cap;
+	}
+#endif
+	while (i > 0) {
+		--i;
+		if (sv.data[i] == c) {
+			return i;
 		}
 	}
+	return SV_NPOS;
 }
 
-NONSTD_DEF void sb_append_cstr(stringb *sb, const char *s) {
-	if (!s) {
-		return;
+NONSTD_DEF size_t sv_count_char(stringv sv, char c) {
+	size_t count = 0;
+	size_t i = 0;
+#if defined(__AVX2__)
+	__m256i needle = _mm256_set1_epi8(c);
+	while (i + 32 <= sv.length) {
+		// Byte counters saturate after 255 blocks, so fold them into 64-bit lanes
+		__m256i acc = _mm256_setzero_si256();
+		size_t blocks = MIN((sv.length - i) / 32, (size_t)255);
+		for (size_t b = 0; b < blocks; ++b, i += 32) {
+			acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(sv.data + i)), needle));
+		}
+		__m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+		count += (size_t)_mm256_extract_epi64(sums, 0) + (size_t)_mm256_extract_epi64(sums, 1) +
+				 (size_t)_mm256_extract_epi64(sums, 2) + (size_t)_mm256_extract_epi64(sums, 3);
 	}
-	size_t slength = strlen(s);
-	sb_ensure(sb, slength);
-	if (sb->length + slength + 1 <= sb->capacity) {
-		memcpy(sb->data + sb->length, s, slength);
-		sb->length += slength;
-		sb->data[sb->length] = '\0';
+#elif defined(__SSE2__)
+	__m128i needle = _mm_set1_epi8(c);
+	while (i + 16 <= sv.length) {
+		// Byte counters saturate after 255 blocks, so fold them into 64-bit lanes
+		__m128i acc = _mm_setzero_si128();
+		size_t blocks = MIN((sv.length - i) / 16, (size_t)255);
+		for (size_t b = 0; b < blocks; ++b, i += 16) {
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(sv.data + i)), needle));
+		}
+		__m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+		count += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
 	}
+#endif
+	for (; i < sv.length; ++i) {
+		count += sv.data[i] == c;
+	}
+	return count;
 }
 
-NONSTD_DEF void sb_append_sv(stringb *sb, stringv sv) {
-	if (!sv.data || sv.length == 0) {
-		return;
+NONSTD_DEF size_t sv_find(stringv sv, stringv needle) {
+	if (needle.length == 0) {
+		return 0;
 	}
-	sb_ensure(sb, sv.length);
-	if (sb->length + sv.length + 1 <= sb->capacity) {
-		memcpy(sb->data + sb->length, sv.data, sv.length);
-		sb->length += sv.length;
-		sb->data[sb->length] = '\0';
+	if (needle.length > sv.length) {
+		return SV_NPOS;
+	}
+	if (needle.length == 1) {
+		return sv_find_char(sv, needle.data[0]);
 	}
-}
 
-NONSTD_DEF void sb_append_char(stringb *sb, char c) {
-	sb_ensure(sb, 1);
-	if (sb->length + 2 <= sb->capacity) {
-		sb->data[sb->length++] = c;
-		sb->data[sb->length] = '\0';
+	size_t last = needle.length - 1;
+	size_t limit = sv.length - needle.length; // last valid start position
+	size_t i = 0;
+#ifdef SV_SIMD_WIDTH
+	// Filter candidate positions on the first and last needle byte, then
+	// verify the middle with memcmp.
+	sv_simd_vec first_byte = sv_simd_splat(needle.data[0]);
+	sv_simd_vec last_byte = sv_simd_splat(needle.data[last]);
+	for (; i + SV_SIMD_WIDTH <= limit + 1; i += SV_SIMD_WIDTH) {
+		u32 mask = sv_simd_eq_mask(sv_simd_load(sv.data + i), first_byte) &
+				   sv_simd_eq_mask(sv_simd_load(sv.data + i + last), last_byte);
+		while (mask) {
+			size_t pos = i + (size_t)__builtin_ctz(mask);
+			if (memcmp(sv.data + pos + 1, needle.data + 1, last - 1) == 0) {
+				return pos;
+			}
+			mask &= mask - 1;
+		}
 	}
+#endif
+	while (i <= limit) {
+		const char *p = memchr(sv.data + i, needle.data[0], limit - i + 1);
+		if (!p) {
+			break;
+		}
+		size_t pos = (size_t)(p - sv.data);
+		if (sv.data[pos + last] == needle.data[last] && memcmp(p + 1, needle.data + 1, last - 1) == 0) {
+			return pos;
+		}
+		i = pos + 1;
+	}
+	return SV_NPOS;
 }
 
-NONSTD_DEF stringv sb_as_sv(const stringb *sb) {
-	return (stringv){.data = sb->data, .length = sb->length};
+NONSTD_DEF int sv_contains(stringv sv, stringv needle) {
+	return sv_find(sv, needle) != SV_NPOS;
 }
 
-NONSTD_DEF Arena arena_make(void) {
+NONSTD_DEF size_t sv_find_any(stringv sv, stringv set) {
+	if (set.length == 0) {
+		return SV_NPOS;
+	}
+	if (set.length == 1) {
+		return sv_find_char(sv, set.data[0]);
+	}
+
+	// Byte-class bitmap: bit (c & 7) of bitmap[c >> 3] is set for each byte in set
+	u8 bitmap[32] = {0};
+	int ascii = 1;
+	for (size_t k = 0; k < set.length; ++k) {
+		u8 c = (u8)set.data[k];
+		bitmap[c >> 3] |= (u8)(1u << (c & 7));
+		ascii &= c < 0x80;
+	}
+
+	size_t i = 0;
+#if defined(__AVX2__) || defined(__SSSE3__)
+	if (ascii) {
+		// Nibble lookup: lo_table[lo] holds one bit per high nibble (0..7) whose
+		// byte (hi << 4 | lo) is in the set, hi_table[hi] selects that bit.
+		u8 lo_table[16] = {0};
+		u8 hi_table[16] = {0};
+		for (u32 c = 0; c < 128; ++c) {
+			if (bitmap[c >> 3] & (1u << (c & 7))) {
+				lo_table[c & 0x0F] |= (u8)(1u << (c >> 4));
+			}
+		}
+		for (u32 h = 0; h < 8; ++h) {
+			hi_table[h] = (u8)(1u << h);
+		}
+#if defined(__AVX2__)
+		__m256i lo_lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lo_table));
+		__m256i hi_lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hi_table));
+		__m256i nibble = _mm256_set1_epi8(0x0F);
+		for (; i + 32 <= sv.length; i += 32) {
+			__m256i block = _mm256_loadu_si256((const __m256i *)(sv.data + i));
+			__m256i lo = _mm256_shuffle_epi8(lo_lut, _mm256_and_si256(block, nibble));
+			__m256i hi = _mm256_shuffle_epi8(hi_lut, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+			__m256i hit = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+			u32 mask = ~(u32)_mm256_movemask_epi8(hit);
+			if (mask) {
+				return i + (size_t)__builtin_ctz(mask);
+			}
+		}
+#else
+		__m128i lo_lut = _mm_loadu_si128((const __m128i *)lo_table);
+		__m128i hi_lut = _mm_loadu_si128((const __m128i *)hi_table);
+		__m128i nibble = _mm_set1_epi8(0x0F);
+		for (; i + 16 <= sv.length; i += 16) {
+			__m128i block = _mm_loadu_si128((const __m128i *)(sv.data + i));
+			__m128i lo = _mm_shuffle_epi8(lo_lut, _mm_and_si128(block, nibble));
+			__m128i hi = _mm_shuffle_epi8(hi_lut, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+			__m128i hit = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+			u32 mask = ~(u32)_mm_movemask_epi8(hit) & 0xFFFF;
+			if (mask) {
+				return i + (size_t)__builtin_ctz(mask);
+			}
+		}
+#endif
+	}
+#elif defined(__SSE2__)
+	// Without a byte shuffle, compare against each delimiter and OR the masks
+	if (set.length <= 16) {
+		__m128i delims[16];
+		for (size_t k = 0; k < set.length; ++k) {
+			delims[k] = _mm_set1_epi8(set.data[k]);
+		}
+		for (; i + 16 <= sv.length; i += 16) {
+			__m128i block = _mm_loadu_si128((const __m128i *)(sv.data + i));
+			__m128i hit = _mm_cmpeq_epi8(block, delims[0]);
+			for (size_t k = 1; k < set.length; ++k) {
+				hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, delims[k]));
+			}
+			u32 mask = (u32)_mm_movemask_epi8(hit);
+			if (mask) {
+				return i + (size_t)__builtin_ctz(mask);
+			}
+		}
+	}
+#else
+	UNUSED(ascii);
+#endif
+	for (; i < sv.length; ++i) {
+		u8 c = (u8)sv.data[i];
+		if (bitmap[c >> 3] & (1u << (c & 7))) {
+			return i;
+		}
+	}
+	return SV_NPOS;
+}
+
+// Split iterators: each call chops the next field off the front of *rest.
+// When the last field has been returned rest->data is set to NULL and the
+// following call returns 0.
+
+static int sv_split_at(stringv *rest, size_t pos, size_t skip, stringv *out) {
+	if (pos == SV_NPOS) {
+		*out = *rest;
+		*rest = (stringv){.data = NULL, .length = 0};
+	} else {
+		*out = (stringv){.data = rest->data, .length = pos};
+		*rest = (stringv){.data = rest->data + pos + skip, .length = rest->length - pos - skip};
+	}
+	return 1;
+}
+
+NONSTD_DEF int sv_split_next(stringv *rest, char delim, stringv *out) {
+	if (!rest->data) {
+		return 0;
+	}
+	return sv_split_at(rest, sv_find_char(*rest, delim), 1, out);
+}
+
+NONSTD_DEF int sv_split_any_next(stringv *rest, stringv delims, stringv *out) {
+	if (!rest->data) {
+		return 0;
+	}
+	return sv_split_at(rest, sv_find_any(*rest, delims), 1, out);
+}
+
+NONSTD_DEF int sv_split_whitespace_next(stringv *rest, stringv *out) {
+	if (!rest->data) {
+		return 0;
+	}
+
+	size_t start = 0;
+	while (start < rest->length && isspace((unsigned char)rest->data[start])) {
+		start++;
+	}
+	if (start == rest->length) {
+		*rest = (stringv){.data = NULL, .length = 0};
+		return 0;
+	}
+
+	*rest = sv_slice(*rest, start, rest->length);
+	return sv_split_at(rest, sv_find_any(*rest, sv_from_parts(" \t\n\v\f\r", 6)), 1, out);
+}
+
+NONSTD_DEF int sv_split_line_next(stringv *rest, stringv *out) {
+	if (!rest->data || rest->length == 0) {
+		*rest = (stringv){.data = NULL, .length = 0};
+		return 0;
+	}
+
+	sv_split_at(rest, sv_find_char(*rest, '\n'), 1, out);
+	if (out->length > 0 && out->data[out->length - 1] == '\r') {
+		out->length--;
+	}
+	return 1;
+}
+
+// String Builder Implementation
+
+NONSTD_DEF void sb_init(stringb *sb, size_t initial_cap) {
+	sb->capacity = initial_cap ? initial_cap : 16;
+	sb->data = ALLOC(char, sb->capacity);
+	sb->length = 0;
+	if (sb->data) {
+		sb->data[0] = '\0';
+	}
+}
+
+NONSTD_DEF void sb_free(stringb *sb) {
+	FREE(sb->data);
+	sb->length = 0;
+	sb->capacity = 0;
+}
+
+NONSTD_DEF void sb_ensure(stringb *sb, size_t additional) {
+	size_t needed = sb->length + additional + 1;
+	size_t new_cap = sb->capacity;
+
+	if (needed > new_cap) {
+		while (new_cap < needed) {
+			if (new_cap > SIZE_MAX / 2) {
+				new_cap = SIZE_MAX;
+				break;
+			}
+			new_cap *= 2;
+		}
+		if (new_cap < needed)
+			return; // Overflow
+
+		char *new_data = safe_realloc(sb->data, sizeof(char), new_cap);
+		if (new_data) {
+			sb->data = new_data;
+			sb->capacity = new_cap;
+		}
+	}
+}
+
+NONSTD_DEF void sb_append_cstr(stringb *sb, const char *s) {
+	if (!s) {
+		return;
+	}
+	size_t slength = strlen(s);
+	sb_ensure(sb, slength);
+	if (sb->length + slength + 1 <= sb->capacity) {
+		memcpy(sb->data + sb->length, s, slength);
+		sb->length += slength;
+		sb->data[sb->length] = '\0';
+	}
+}
+
+NONSTD_DEF void sb_append_sv(stringb *sb, stringv sv) {
+	if (!sv.data || sv.length == 0) {
+		return;
+	}
+	sb_ensure(sb, sv.length);
+	if (sb->length + sv.length + 1 <= sb->capacity) {
+		memcpy(sb->data + sb->length, sv.data, sv.length);
+		sb->length += sv.length;
+		sb->data[sb->length] = '\0';
+	}
+}
+
+NONSTD_DEF void sb_append_char(stringb *sb, char c) {
+	sb_ensure(sb, 1);
+	if (sb->length + 2 <= sb->capacity) {
+		sb->data[sb->length++] = c;
+		sb->data[sb->length] = '\0';
+	}
+}
+
+NONSTD_DEF stringv sb_as_sv(const stringb *sb) {
+	return (stringv){.data = sb->data, .length = sb->length};
+}
+
+// Hash Implementation
+
+static const u64 hash_secret[4] = {
+	0x2d358dccaa6c78a5ull,
+	0x8bb84b93962eacc9ull,
+	0x4b33a62ed433d4a3ull,
+	0x4d5a2da51de1aa47ull,
+};
+
+// 64x64 -> 128-bit multiply, low half in *a and high half in *b
+static void hash_mum(u64 *a, u64 *b) {
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = (__uint128_t)*a * *b;
+	*a = (u64)r;
+	*b = (u64)(r >> 64);
+#else
+	u64 ha = *a >> 32, hb = *b >> 32, la = (u32)*a, lb = (u32)*b;
+	u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	u64 t = rl + (rm0 << 32);
+	u64 carry = t < rl;
+	u64 lo = t + (rm1 << 32);
+	carry += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+static u64 hash_mix(u64 a, u64 b) {
+	hash_mum(&a, &b);
+	return a ^ b;
+}
+
+static u64 hash_read8(const u8 *p) {
+	u64 v;
+	memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static u64 hash_read4(const u8 *p) {
+	u32 v;
+	memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+// Inputs of up to 16 bytes are covered by (possibly overlapping) 4-byte loads
+static void hash_short(const u8 *p, size_t length, u64 *a, u64 *b) {
+	if (length >= 4) {
+		size_t mid = (length >> 3) << 2;
+		*a = (hash_read4(p) << 32) | hash_read4(p + mid);
+		*b = (hash_read4(p + length - 4) << 32) | hash_read4(p + length - 4 - mid);
+	} else if (length > 0) {
+		*a = ((u64)p[0] << 16) | ((u64)p[length >> 1] << 8) | p[length - 1];
+		*b = 0;
+	} else {
+		*a = 0;
+		*b = 0;
+	}
+}
+
+// Consumes 16-byte chunks while more than 16 bytes remain, then loads the last
+// 16 bytes, which may overlap bytes before p.
+static u64 hash_tail(const u8 *p, size_t remaining, u64 seed, u64 length) {
+	while (remaining > 16) {
+		seed = hash_mix(hash_read8(p) ^ hash_secret[1], hash_read8(p + 8) ^ seed);
+		p += 16;
+		remaining -= 16;
+	}
+	u64 a = hash_read8(p + remaining - 16) ^ hash_secret[1];
+	u64 b = hash_read8(p + remaining - 8) ^ seed;
+	hash_mum(&a, &b);
+	return hash_mix(a ^ hash_secret[0] ^ length, b ^ hash_secret[1]);
+}
+
+NONSTD_DEF u64 hash_bytes(const void *data, size_t length, u64 seed) {
+	const u8 *p = data;
+	seed ^= hash_mix(seed ^ hash_secret[0], hash_secret[1]);
+
+	if (length <= 16) {
+		u64 a, b;
+		hash_short(p, length, &a, &b);
+		a ^= hash_secret[1];
+		b ^= seed;
+		hash_mum(&a, &b);
+		return hash_mix(a ^ hash_secret[0] ^ length, b ^ hash_secret[1]);
+	}
+
+	size_t remaining = length;
+	if (remaining > 48) {
+		// Three independent lanes keep the multipliers busy on long inputs
+		u64 see1 = seed, see2 = seed;
+		do {
+			seed = hash_mix(hash_read8(p) ^ hash_secret[1], hash_read8(p + 8) ^ seed);
+			see1 = hash_mix(hash_read8(p + 16) ^ hash_secret[2], hash_read8(p + 24) ^ see1);
+			see2 = hash_mix(hash_read8(p + 32) ^ hash_secret[3], hash_read8(p + 40) ^ see2);
+			p += 48;
+			remaining -= 48;
+		} while (remaining > 48);
+		seed ^= see1 ^ see2;
+	}
+	return hash_tail(p, remaining, seed, length);
+}
+
+NONSTD_DEF u64 sv_hash64(stringv sv, u64 seed) {
+	return hash_bytes(sv.data, sv.length, seed);
+}
+
+NONSTD_DEF void hash_init(HashState *state, u64 seed) {
+	memset(state, 0, sizeof(*state));
+	state->seed = seed ^ hash_mix(seed ^ hash_secret[0], hash_secret[1]);
+	state->see1 = state->seed;
+	state->see2 = state->seed;
+}
+
+static void hash_state_block(HashState *state, const u8 *p) {
+	state->seed = hash_mix(hash_read8(p) ^ hash_secret[1], hash_read8(p + 8) ^ state->seed);
+	state->see1 = hash_mix(hash_read8(p + 16) ^ hash_secret[2], hash_read8(p + 24) ^ state->see1);
+	state->see2 = hash_mix(hash_read8(p + 32) ^ hash_secret[3], hash_read8(p + 40) ^ state->see2);
+	memcpy(state->tail, p + 32, 16);
+	state->blocks = 1;
+}
+
+NONSTD_DEF void hash_update(HashState *state, const void *data, size_t length) {
+	const u8 *p = data;
+	state->length += length;
+
+	// A 48-byte block is only consumed once more input is known to follow it,
+	// matching hash_bytes, which keeps 1..48 bytes for the tail.
+	while (length > 0) {
+		if (state->buffered == 48) {
+			hash_state_block(state, state->buffer);
+			state->buffered = 0;
+		}
+		if (state->buffered == 0) {
+			while (length > 48) {
+				hash_state_block(state, p);
+				p += 48;
+				length -= 48;
+			}
+		}
+		size_t take = MIN(length, 48 - state->buffered);
+		memcpy(state->buffer + state->buffered, p, take);
+		state->buffered += take;
+		p += take;
+		length -= take;
+	}
+}
+
+NONSTD_DEF u64 hash_final(const HashState *state) {
+	if (!state->blocks) {
+		// Everything is still buffered, which is exactly the one-shot input
+		if (state->length <= 16) {
+			u64 a, b;
+			hash_short(state->buffer, state->buffered, &a, &b);
+			a ^= hash_secret[1];
+			b ^= state->seed;
+			hash_mum(&a, &b);
+			return hash_mix(a ^ hash_secret[0] ^ state->length, b ^ hash_secret[1]);
+		}
+		return hash_tail(state->buffer, state->buffered, state->seed, state->length);
+	}
+
+	// The final loads may reach up to 16 bytes back into the last block
+	u8 scratch[16 + 48];
+	memcpy(scratch, state->tail, 16);
+	memcpy(scratch + 16, state->buffer, state->buffered);
+	u64 seed = state->seed ^ state->see1 ^ state->see2;
+	return hash_tail(scratch + 16, state->buffered, seed, state->length);
+}
+
+// Hash Map Implementation
+
+#define HASHMAP_GROUP_SIZE 16
+#define HASHMAP_CTRL_EMPTY ((u8)0x80)
+#define HASHMAP_CTRL_DELETED ((u8)0xFE)
+
+NONSTD_DEF u64 hashmap_hash_bytes(const void *key, size_t key_size) {
+	return hash_bytes(key, key_size, 0);
+}
+
+NONSTD_DEF int hashmap_equals_bytes(const void *a, const void *b, size_t key_size) {
+	return memcmp(a, b, key_size) == 0;
+}
+
+NONSTD_DEF u64 hashmap_hash_sv(const void *key, size_t key_size) {
+	UNUSED(key_size);
+	const stringv *sv = key;
+	return hash_bytes(sv->data, sv->length, 0);
+}
+
+NONSTD_DEF int hashmap_equals_sv(const void *a, const void *b, size_t key_size) {
+	UNUSED(key_size);
+	return sv_equals(*(const stringv *)a, *(const stringv *)b);
+}
+
+// Bit i of the result is set when ctrl[i] of the 16-byte group equals byte
+static u32 hashmap_group_match(const u8 *group, u8 byte) {
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte)));
+#else
+	u32 mask = 0;
+	for (u32 i = 0; i < HASHMAP_GROUP_SIZE; ++i) {
+		mask |= (u32)(group[i] == byte) << i;
+	}
+	return mask;
+#endif
+}
+
+// Bit i of the result is set when slot i of the group is empty or deleted
+static u32 hashmap_group_match_free(const u8 *group) {
+#ifdef __SSE2__
+	return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+	u32 mask = 0;
+	for (u32 i = 0; i < HASHMAP_GROUP_SIZE; ++i) {
+		mask |= (u32)(group[i] >> 7) << i;
+	}
+	return mask;
+#endif
+}
+
+// Walks groups in triangular order, which visits every group once when the
+// group count is a power of two. Returns the slot index holding key, or
+// SIZE_MAX when a group with an empty slot ends the probe sequence.
+static size_t hashmap_find_slot(const HashMapBase *m, HashMapLayout layout, const void *key, u64 hash) {
+	if (m->capacity == 0) {
+		return SIZE_MAX;
+	}
+
+	size_t group_mask = m->capacity / HASHMAP_GROUP_SIZE - 1;
+	size_t group = (size_t)(hash >> 7) & group_mask;
+	u8 h2 = (u8)(hash & 0x7F);
+
+	for (size_t step = 1; step <= group_mask + 1; ++step) {
+		const u8 *ctrl = m->ctrl + group * HASHMAP_GROUP_SIZE;
+		u32 mask = hashmap_group_match(ctrl, h2);
+		while (mask) {
+			size_t index = group * HASHMAP_GROUP_SIZE + (size_t)__builtin_ctz(mask);
+			if (m->equals((const char *)m->slots + index * layout.slot_size, key, layout.key_size)) {
+				return index;
+			}
+			mask &= mask - 1;
+		}
+		if (hashmap_group_match(ctrl, HASHMAP_CTRL_EMPTY)) {
+			break;
+		}
+		group = (group + step) & group_mask;
+	}
+	return SIZE_MAX;
+}
+
+// First empty or deleted slot along the probe sequence of hash
+static size_t hashmap_find_free(const HashMapBase *m, u64 hash) {
+	size_t group_mask = m->capacity / HASHMAP_GROUP_SIZE - 1;
+	size_t group = (size_t)(hash >> 7) & group_mask;
+	for (size_t step = 1;; ++step) {
+		u32 mask = hashmap_group_match_free(m->ctrl + group * HASHMAP_GROUP_SIZE);
+		if (mask) {
+			return group * HASHMAP_GROUP_SIZE + (size_t)__builtin_ctz(mask);
+		}
+		group = (group + step) & group_mask;
+	}
+}
+
+static int hashmap_rehash(HashMapBase *m, HashMapLayout layout, size_t new_capacity) {
+	u8 *ctrl = ALLOC(u8, new_capacity);
+	void *slots = safe_malloc(layout.slot_size, new_capacity);
+	if (!ctrl || !slots) {
+		FREE(ctrl);
+		FREE(slots);
+		return 0;
+	}
+	memset(ctrl, HASHMAP_CTRL_EMPTY, new_capacity);
+
+	HashMapBase grown = *m;
+	grown.ctrl = ctrl;
+	grown.slots = slots;
+	grown.capacity = new_capacity;
+	grown.tombstones = 0;
+
+	for (size_t i = 0; i < m->capacity; ++i) {
+		if (m->ctrl[i] & 0x80) {
+			continue;
+		}
+		const char *src = (const char *)m->slots + i * layout.slot_size;
+		u64 hash = m->hash(src, layout.key_size);
+		size_t index = hashmap_find_free(&grown, hash);
+		ctrl[index] = (u8)(hash & 0x7F);
+		memcpy((char *)slots + index * layout.slot_size, src, layout.slot_size);
+	}
+
+	FREE(m->ctrl);
+	FREE(m->slots);
+	*m = grown;
+	return 1;
+}
+
+NONSTD_DEF void *hashmap_get_raw(const HashMapBase *m, HashMapLayout layout, const void *key) {
+	if (m->length == 0) {
+		return NULL;
+	}
+	size_t index = hashmap_find_slot(m, layout, key, m->hash(key, layout.key_size));
+	if (index == SIZE_MAX) {
+		return NULL;
+	}
+	return (char *)m->slots + index * layout.slot_size + layout.value_offset;
+}
+
+NONSTD_DEF void *hashmap_insert_raw(HashMapBase *m, HashMapLayout layout, const void *key) {
+	u64 hash = m->hash(key, layout.key_size);
+	size_t index = hashmap_find_slot(m, layout, key, hash);
+	if (index != SIZE_MAX) {
+		return (char *)m->slots + index * layout.slot_size;
+	}
+
+	// Keep the load (live + deleted slots) at or below 7/8
+	if (m->capacity == 0 || (m->length + m->tombstones + 1) * 8 > m->capacity * 7) {
+		size_t new_capacity = m->capacity ? m->capacity : HASHMAP_GROUP_SIZE;
+		if ((m->length + 1) * 16 > new_capacity * 7) {
+			if (new_capacity > SIZE_MAX / 2) {
+				return NULL;
+			}
+			new_capacity *= 2;
+		}
+		if (!hashmap_rehash(m, layout, new_capacity)) {
+			return NULL;
+		}
+	}
+
+	index = hashmap_find_free(m, hash);
+	if (m->ctrl[index] == HASHMAP_CTRL_DELETED) {
+		m->tombstones--;
+	}
+	m->ctrl[index] = (u8)(hash & 0x7F);
+	m->length++;
+
+	char *slot = (char *)m->slots + index * layout.slot_size;
+	memcpy(slot, key, layout.key_size);
+	return slot;
+}
+
+NONSTD_DEF int hashmap_remove_raw(HashMapBase *m, HashMapLayout layout, const void *key) {
+	if (m->length == 0) {
+		return 0;
+	}
+	size_t index = hashmap_find_slot(m, layout, key, m->hash(key, layout.key_size));
+	if (index == SIZE_MAX) {
+		return 0;
+	}
+
+	// Lookups stop at any group that still has an empty slot, so the slot can
+	// become empty again. Otherwise a tombstone keeps later probes going.
+	const u8 *group = m->ctrl + (index / HASHMAP_GROUP_SIZE) * HASHMAP_GROUP_SIZE;
+	if (hashmap_group_match(group, HASHMAP_CTRL_EMPTY)) {
+		m->ctrl[index] = HASHMAP_CTRL_EMPTY;
+	} else {
+		m->ctrl[index] = HASHMAP_CTRL_DELETED;
+		m->tombstones++;
+	}
+	m->length--;
+	return 1;
+}
+
+NONSTD_DEF int hashmap_reserve_raw(HashMapBase *m, HashMapLayout layout, size_t count) {
+	size_t capacity = HASHMAP_GROUP_SIZE;
+	while (capacity / 8 * 7 < count) {
+		if (capacity > SIZE_MAX / 2) {
+			return 0;
+		}
+		capacity *= 2;
+	}
+	if (capacity <= m->capacity) {
+		return 1;
+	}
+	return hashmap_rehash(m, layout, capacity);
+}
+
+NONSTD_DEF size_t hashmap_next_raw(const HashMapBase *m, size_t index) {
+	while (index < m->capacity && (m->ctrl[index] & 0x80)) {
+		index++;
+	}
+	return index;
+}
+
+NONSTD_DEF void hashmap_clear_raw(HashMapBase *m) {
+	if (m->ctrl) {
+		memset(m->ctrl, HASHMAP_CTRL_EMPTY, m->capacity);
+	}
+	m->length = 0;
+	m->tombstones = 0;
+}
+
+NONSTD_DEF void hashmap_free_raw(HashMapBase *m) {
+	FREE(m->ctrl);
+	FREE(m->slots);
+	m->length = 0;
+	m->capacity = 0;
+	m->tombstones = 0;
+}
+
+// Virtual Memory Implementation
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+NONSTD_DEF size_t vm_page_size(void) {
+	static size_t page_size = 0;
+	if (!page_size) {
+		long size = sysconf(_SC_PAGESIZE);
+		page_size = size > 0 ? (size_t)size : 4096;
+	}
+	return page_size;
+}
+
+NONSTD_DEF void *vm_reserve(size_t size) {
+#ifdef MAP_ANONYMOUS
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+	flags |= MAP_NORESERVE;
+#endif
+	void *addr = mmap(NULL, size, PROT_NONE, flags, -1, 0);
+	return addr == MAP_FAILED ? NULL : addr;
+#else
+	UNUSED(size);
+	return NULL;
+#endif
+}
+
+NONSTD_DEF int vm_commit(void *addr, size_t size) {
+	return mprotect(addr, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+NONSTD_DEF void vm_decommit(void *addr, size_t size) {
+	// Drop the physical pages first, then make the range inaccessible again
+#ifdef MADV_DONTNEED
+	madvise(addr, size, MADV_DONTNEED);
+#else
+	posix_madvise(addr, size, POSIX_MADV_DONTNEED);
+#endif
+	mprotect(addr, size, PROT_NONE);
+}
+
+NONSTD_DEF void vm_release(void *addr, size_t size) {
+	if (addr) {
+		munmap(addr, size);
+	}
+}
+
+NONSTD_DEF size_t vm_grow(void *base, size_t committed, size_t needed, size_t reserved) {
+	if (needed <= committed || needed > reserved) {
+		return committed;
+	}
+	// Callers may track the committed size in whole elements, which can end
+	// inside a page, so start at the page holding the first missing byte
+	size_t page = vm_page_size();
+	size_t start = committed / page * page;
+	size_t target = MAX(needed, MAX(committed * 2, ARENA_VM_COMMIT_SIZE));
+	target = MIN((target + page - 1) / page * page, reserved);
+	if (!vm_commit((char *)base + start, target - start)) {
+		return committed;
+	}
+	return target;
+}
+
+NONSTD_DEF size_t vm_trim(void *base, size_t committed, size_t keep) {
+	size_t page = vm_page_size();
+	size_t start = (keep + page - 1) / page * page;
+	size_t end = (committed + page - 1) / page * page;
+	if (start >= end) {
+		return committed;
+	}
+	vm_decommit((char *)base + start, end - start);
+	return start;
+}
+
+NONSTD_DEF Arena arena_make(void) {
+	return arena_make_sized(ARENA_DEFAULT_BLOCK_SIZE);
+}
+
+NONSTD_DEF Arena arena_make_sized(size_t block_size) {
 	Arena a = {0};
 	array_init(a.blocks);
+	array_init(a.large);
+	a.block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+	a.max_block_size = MAX(a.block_size, ARENA_MAX_BLOCK_SIZE);
+	a.large_threshold = 0;
 	return a;
 }
 
-// Arena Implementation
+NONSTD_DEF Arena arena_make_virtual(size_t reserve_size, int flags) {
+	size_t granule = (flags & ARENA_VM_HUGEPAGES) ? ARENA_VM_HUGEPAGE_SIZE : ARENA_VM_COMMIT_SIZE;
+	size_t page = vm_page_size();
+	granule = (granule + page - 1) / page * page;
+
+	size_t reserve = reserve_size ? reserve_size : ARENA_VM_DEFAULT_RESERVE;
+	reserve = (reserve + granule - 1) / granule * granule;
+
+	// Fall back to a regular block arena when the reservation fails
+	Arena a = arena_make();
+	char *base = vm_reserve(reserve);
+	if (!base) {
+		return a;
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (flags & ARENA_VM_HUGEPAGES) {
+		madvise(base, reserve, MADV_HUGEPAGE);
+	}
+#endif
+
+	a.vm_base = base;
+	a.vm_reserved = reserve;
+	a.ptr = base;
+	a.end = base;
+	a.block_size = granule;
+	return a;
+}
+
+// Commits enough of the reservation for size bytes at the aligned bump pointer
+static void arena_vm_grow(Arena *a, size_t size) {
+	size_t align = sizeof(void *);
+	uintptr_t aligned = ((uintptr_t)a->ptr + align - 1) & ~(align - 1);
+	uintptr_t reserve_end = (uintptr_t)a->vm_base + a->vm_reserved;
+	if (aligned > reserve_end || size > reserve_end - aligned) {
+		return;
+	}
+
+	size_t missing = (size_t)(aligned + size - (uintptr_t)a->end);
+	size_t commit = (missing + a->block_size - 1) / a->block_size * a->block_size;
+	commit = MIN(commit, (size_t)(reserve_end - (uintptr_t)a->end));
+	if (vm_commit(a->end, commit)) {
+		a->end += commit;
+	}
+}
+
+// Arena Implementation
+
+NONSTD_DEF void arena_grow(Arena *a, size_t min_size) {
+	if (a->vm_base) {
+		arena_vm_grow(a, min_size);
+		return;
+	}
+
+	// Blocks after the current one are left over from arena_reset or
+	// arena_rewind, so reuse the first one that fits before calling malloc.
+	size_t first = a->ptr ? a->current + 1 : 0;
+	for (size_t i = first; i < a->blocks.length; ++i) {
+		ArenaBlock block = a->blocks.data[i];
+		if (block.size >= min_size) {
+			a->current = i;
+			a->ptr = block.data;
+			a->end = block.data + block.size;
+			return;
+		}
+	}
+
+	size_t block_size = a->block_size ? a->block_size : ARENA_DEFAULT_BLOCK_SIZE;
+	size_t size = MAX(block_size, min_size);
+	char *data = ALLOC(char, size);
+	if (!data) {
+		return;
+	}
+
+	// Geometric growth keeps the number of blocks logarithmic in the total size
+	if (block_size < a->max_block_size) {
+		a->block_size = block_size > a->max_block_size / 2 ? a->max_block_size : block_size * 2;
+	}
+
+	size_t count = a->blocks.length;
+	array_push(a->blocks, ((ArenaBlock){.data = data, .size = size}));
+	if (a->blocks.length == count) {
+		FREE(data);
+		return;
+	}
+
+	a->current = count;
+	a->ptr = data;
+	a->end = data + size;
+}
+
+// Oversized allocations get their own malloc block and leave the bump block alone
+static void *arena_alloc_large(Arena *a, size_t size) {
+	char *data = ALLOC(char, size);
+	if (!data) {
+		return NULL;
+	}
+	size_t count = a->large.length;
+	array_push(a->large, ((ArenaBlock){.data = data, .size = size}));
+	if (a->large.length == count) {
+		FREE(data);
+		return NULL;
+	}
+	return data;
+}
+
+static void arena_free_large(Arena *a, size_t keep) {
+	for (size_t i = keep; i < a->large.length; ++i) {
+		FREE(a->large.data[i].data);
+	}
+	if (a->large.length > keep) {
+		a->large.length = keep;
+	}
+}
+
+NONSTD_DEF void *arena_alloc(Arena *a, size_t size) {
+	// Align to 8 bytes basically
+	size_t align = sizeof(void *);
+	uintptr_t current = (uintptr_t)a->ptr;
+	uintptr_t aligned = (current + align - 1) & ~(align - 1);
+	uintptr_t end = (uintptr_t)a->end;
+
+	// Check for overflow (aligned wrapped around) or out of bounds (aligned >= end)
+	// or not enough space ((end - aligned) < size)
+	if (aligned < current || aligned >= end || (end - aligned) < size) {
+		size_t threshold = a->large_threshold ? a->large_threshold : a->block_size / 4;
+		if (!a->vm_base && threshold && size > threshold) {
+			return arena_alloc_large(a, size);
+		}
+		arena_grow(a, size);
+		current = (uintptr_t)a->ptr;
+		aligned = (current + align - 1) & ~(align - 1);
+		end = (uintptr_t)a->end;
+	}
+
+	// Double check after grow (in case grow failed or size is just too huge)
+	if (aligned < current || aligned >= end || (end - aligned) < size) {
+		return NULL;
+	}
+
+	a->ptr = (char *)(aligned + size);
+	return (void *)aligned;
+}
+
+NONSTD_DEF void arena_free(Arena *a) {
+	if (a->vm_base) {
+		vm_release(a->vm_base, a->vm_reserved);
+		a->vm_base = NULL;
+		a->vm_reserved = 0;
+	}
+	ArenaBlock block;
+	array_foreach(a->blocks, block) { FREE(block.data); }
+	array_free(a->blocks);
+	arena_free_large(a, 0);
+	array_free(a->large);
+	a->ptr = NULL;
+	a->end = NULL;
+	a->current = 0;
+}
+
+NONSTD_DEF void arena_reset(Arena *a) {
+	if (a->vm_base) {
+		// Hand the committed pages back to the OS, they are re-committed on demand
+		vm_decommit(a->vm_base, (size_t)(a->end - a->vm_base));
+		a->ptr = a->vm_base;
+		a->end = a->vm_base;
+		return;
+	}
+
+	arena_free_large(a, 0);
+	if (a->blocks.length == 0) {
+		return;
+	}
+	a->current = 0;
+	a->ptr = a->blocks.data[0].data;
+	a->end = a->ptr + a->blocks.data[0].size;
+}
+
+NONSTD_DEF ArenaMark arena_mark(const Arena *a) {
+	return (ArenaMark){.block = a->current, .ptr = a->ptr, .large = a->large.length};
+}
+
+NONSTD_DEF void arena_rewind(Arena *a, ArenaMark mark) {
+	if (a->vm_base) {
+		a->ptr = mark.ptr ? mark.ptr : a->vm_base;
+		return;
+	}
+
+	arena_free_large(a, mark.large);
+
+	// A mark taken before the first bump allocation rewinds to the start of
+	// the first block, large blocks allocated before the mark are kept
+	if (!mark.ptr) {
+		if (a->blocks.length == 0) {
+			return;
+		}
+		a->current = 0;
+		a->ptr = a->blocks.data[0].data;
+		a->end = a->ptr + a->blocks.data[0].size;
+		return;
+	}
+	ArenaBlock block = a->blocks.data[mark.block];
+	a->current = mark.block;
+	a->ptr = mark.ptr;
+	a->end = block.data + block.size;
+}
+
+// File I/O Implementation
+
+NONSTD_DEF char *read_entire_file(const char *filepath, size_t *out_size) {
+	FILE *f = fopen(filepath, "rb");
+	if (!f) {
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	if (length < 0) {
+		fclose(f);
+		return NULL;
+	}
+
+	size_t size = (size_t)length;
+	char *buffer = ALLOC(char, size + 1);
+	if (!buffer) {
+		fclose(f);
+		return NULL;
+	}
+
+	size_t read = fread(buffer, 1, size, f);
+	fclose(f);
+
+	if (read != size) {
+		FREE(buffer);
+		return NULL;
+	}
+
+	buffer[size] = '\0';
+	if (out_size) {
+		*out_size = size;
+	}
+
+	return buffer;
+}
+
+NONSTD_DEF int write_entire_file(const char *filepath, const void *data, size_t size) {
+	FILE *f = fopen(filepath, "wb");
+	if (!f) {
+		return 0;
+	}
+
+	size_t written = fwrite(data, 1, size, f);
+	fclose(f);
+
+	return written == size;
+}
+
+NONSTD_DEF stringb read_entire_file_sb(const char *filepath) {
+	size_t size = 0;
+	char *data = read_entire_file(filepath, &size);
+	stringb sb = {0};
+	if (data) {
+		sb.data = data;
+		sb.length = size;
+		sb.capacity = size + 1;
+	}
+	return sb;
+}
+
+NONSTD_DEF int write_file_sv(const char *filepath, stringv sv) {
+	return write_entire_file(filepath, sv.data, sv.length);
+}
+
+NONSTD_DEF int write_file_sb(const char *filepath, const stringb *sb) {
+	return write_entire_file(filepath, sb->data, sb->length);
+}
+
+NONSTD_DEF MappedFile map_entire_file(const char *filepath, int hints) {
+	MappedFile mf = {0};
+	int fd = open(filepath, O_RDONLY);
+	if (fd < 0) {
+		return mf;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (u64)st.st_size > SIZE_MAX) {
+		close(fd);
+		return mf;
+	}
+
+	// mmap rejects zero-length mappings, so an empty file maps to an empty view.
+	size_t size = (size_t)st.st_size;
+	if (size == 0) {
+		close(fd);
+		mf.data = "";
+		return mf;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	if (hints & FILE_MAP_SEQUENTIAL) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+	if (hints & FILE_MAP_WILLNEED) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	}
+#endif
+
+	void *addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		return mf;
+	}
+
+	if (hints & FILE_MAP_SEQUENTIAL) {
+		posix_madvise(addr, size, POSIX_MADV_SEQUENTIAL);
+	}
+	if (hints & FILE_MAP_WILLNEED) {
+		posix_madvise(addr, size, POSIX_MADV_WILLNEED);
+	}
+#ifdef MADV_HUGEPAGE
+	if (hints & FILE_MAP_HUGEPAGE) {
+		madvise(addr, size, MADV_HUGEPAGE);
+	}
+#endif
+
+	mf.data = addr;
+	mf.length = size;
+	return mf;
+}
+
+NONSTD_DEF void unmap_file(MappedFile *mf) {
+	if (mf->data && mf->length > 0) {
+		munmap((void *)mf->data, mf->length);
+	}
+	mf->data = NULL;
+	mf->length = 0;
+}
+
+NONSTD_DEF stringv mf_as_sv(const MappedFile *mf) {
+	return (stringv){.data = mf->data, .length = mf->length};
+}
+
+// Logging Implementation
+
+static LogLevel max_level = LOG_INFO;
+
+static const char *level_strings[] = {
+	"ERROR",
+	"WARN",
+	"INFO",
+	"DEBUG",
+};
+
+static const char *level_colors[] = {
+	COLOR_ERROR,
+	COLOR_WARNING,
+	COLOR_INFO,
+	COLOR_DEBUG,
+};
+
+// Call sites in use, linked through LogSite.next, and the toggle rules
+typedef struct {
+	char *pattern;
+	int enabled;
+} LogSiteRule;
+
+static struct {
+	LogSite *head;
+	array(LogSiteRule) rules;
+	pthread_mutex_t mutex;
+} log_sites = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+// Called with the mutex held. The last matching rule wins, otherwise the
+// runtime level decides.
+static int log_site_compute(const LogSite *site) {
+	char key[512];
+	snprintf(key, sizeof(key), "%s:%d", site->file, site->line);
+	for (size_t i = log_sites.rules.length; i-- > 0;) {
+		if (fnmatch(log_sites.rules.data[i].pattern, key, 0) == 0) {
+			return log_sites.rules.data[i].enabled;
+		}
+	}
+	return site->level <= max_level;
+}
+
+static void log_sites_refresh(void) {
+	for (LogSite *site = log_sites.head; site; site = site->next) {
+		__atomic_store_n(&site->enabled, log_site_compute(site), __ATOMIC_RELAXED);
+	}
+}
+
+NONSTD_DEF int log_site_resolve(LogSite *site) {
+	pthread_mutex_lock(&log_sites.mutex);
+	if (__atomic_load_n(&site->enabled, __ATOMIC_RELAXED) == LOG_SITE_UNRESOLVED) {
+		site->next = log_sites.head;
+		log_sites.head = site;
+		__atomic_store_n(&site->enabled, log_site_compute(site), __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&log_sites.mutex);
+	return __atomic_load_n(&site->enabled, __ATOMIC_RELAXED);
+}
+
+NONSTD_DEF size_t log_enable_sites(const char *pattern, int enabled) {
+	char *copy = ALLOC(char, strlen(pattern) + 1);
+	if (!copy) {
+		return 0;
+	}
+	strcpy(copy, pattern);
+
+	size_t matched = 0;
+	pthread_mutex_lock(&log_sites.mutex);
+	array_push(log_sites.rules, ((LogSiteRule){copy, enabled ? 1 : 0}));
+	log_sites_refresh();
+	for (LogSite *site = log_sites.head; site; site = site->next) {
+		char key[512];
+		snprintf(key, sizeof(key), "%s:%d", site->file, site->line);
+		matched += fnmatch(pattern, key, 0) == 0;
+	}
+	pthread_mutex_unlock(&log_sites.mutex);
+	return matched;
+}
+
+NONSTD_DEF void log_reset_site_rules(void) {
+	pthread_mutex_lock(&log_sites.mutex);
+	LogSiteRule rule;
+	array_foreach(log_sites.rules, rule) { free(rule.pattern); }
+	array_free(log_sites.rules);
+	log_sites_refresh();
+	pthread_mutex_unlock(&log_sites.mutex);
+}
+
+NONSTD_DEF void set_log_level(LogLevel level) {
+	pthread_mutex_lock(&log_sites.mutex);
+	max_level = level;
+	log_sites_refresh();
+	pthread_mutex_unlock(&log_sites.mutex);
+}
+
+NONSTD_DEF LogLevel get_log_level_from_env(void) {
+	const char *env = getenv("LOG_LEVEL");
+	if (env) {
+		int level = atoi(env);
+		if (level >= 0 && level <= 3) {
+			return (LogLevel)level;
+		}
+	}
+
+	return max_level;
+}
+
+#define LOG_LINE_SIZE 512
+#define LOG_TTY_CACHE_SIZE 256
+
+// Per file descriptor, the FILE * that was checked with the low bit set when
+// it is a terminal, 0 when not checked yet. A different stream on the same
+// descriptor (closed and reopened) misses the cache and is checked again.
+static uintptr_t log_tty_cache[LOG_TTY_CACHE_SIZE];
+
+// The date and time only change once per second, so each thread keeps the
+// last rendered "YYYY-MM-DD HH:MM:SS" and patches the seconds in place while
+// the minute stays the same.
+static NONSTD_THREAD_LOCAL struct {
+	time_t minute;
+	time_t second;
+	char text[20];
+} log_time_cache = {-1, -1, {0}};
+
+NONSTD_DEF void log_register_stream(FILE *stream) {
+	int fd = fileno(stream);
+	if (fd >= 0 && fd < LOG_TTY_CACHE_SIZE) {
+		__atomic_store_n(&log_tty_cache[fd], (uintptr_t)stream | (isatty(fd) ? 1 : 0), __ATOMIC_RELAXED);
+	}
+}
+
+static int log_stream_is_tty(FILE *stream) {
+	int fd = fileno(stream);
+	if (fd < 0 || fd >= LOG_TTY_CACHE_SIZE) {
+		return fd >= 0 && isatty(fd);
+	}
+	uintptr_t state = __atomic_load_n(&log_tty_cache[fd], __ATOMIC_RELAXED);
+	if ((state & ~(uintptr_t)1) != (uintptr_t)stream) {
+		log_register_stream(stream);
+		state = __atomic_load_n(&log_tty_cache[fd], __ATOMIC_RELAXED);
+	}
+	return (state & 1) != 0;
+}
+
+static const char *log_time_string(time_t seconds) {
+	if (seconds / 60 != log_time_cache.minute) {
+		struct tm tm_info;
+		localtime_r(&seconds, &tm_info);
+		strftime(log_time_cache.text, sizeof(log_time_cache.text), "%Y-%m-%d %H:%M:%S", &tm_info);
+		log_time_cache.minute = seconds / 60;
+	} else if (seconds != log_time_cache.second) {
+		int sec = (int)(seconds % 60);
+		log_time_cache.text[17] = (char)('0' + sec / 10);
+		log_time_cache.text[18] = (char)('0' + sec % 10);
+	}
+	log_time_cache.second = seconds;
+	return log_time_cache.text;
+}
+
+// Formats a complete line into buf and returns the number of bytes written.
+// A line that does not fit is cut short but still ends with the color reset
+// and the newline; *needed receives the size the full line would take.
+// Writes "[YYYY-MM-DD HH:MM:SS.mmm] [LEVEL] " (plus the color when tty) by hand,
+// it is on every line. buf needs room for LOG_PREFIX_SIZE bytes.
+#define LOG_PREFIX_SIZE 48
+static size_t log_format_prefix(char *buf, int tty, LogLevel level, time_t seconds, int ms) {
+	size_t used = 0;
+	if (tty) {
+		size_t color_length = strlen(level_colors[level]);
+		memcpy(buf, level_colors[level], color_length);
+		used += color_length;
+	}
+	buf[used++] = '[';
+	memcpy(buf + used, log_time_string(seconds), 19);
+	used += 19;
+	buf[used++] = '.';
+	buf[used++] = (char)('0' + ms / 100);
+	buf[used++] = (char)('0' + ms / 10 % 10);
+	buf[used++] = (char)('0' + ms % 10);
+	memcpy(buf + used, "] [", 3);
+	used += 3;
+	// Level names are padded to five characters like %-5s
+	memset(buf + used, ' ', 5);
+	memcpy(buf + used, level_strings[level], strlen(level_strings[level]));
+	used += 5;
+	memcpy(buf + used, "] ", 2);
+	used += 2;
+	return used;
+}
+
+static size_t log_format_line(char *buf, size_t size, int tty, LogLevel level, const char *format, va_list args, size_t *needed) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	size_t used = log_format_prefix(buf, tty, level, tv.tv_sec, (int)(tv.tv_usec / 1000));
+
+	size_t reset_length = tty ? sizeof(COLOR_RESET) - 1 : 0;
+	size_t room = size - reset_length - 1;
+	int length = vsnprintf(buf + used, room - used, format, args);
+	size_t message = length > 0 ? (size_t)length : 0;
+	*needed = used + message + reset_length + 1;
+
+	used = MIN(used + message, room - 1);
+	memcpy(buf + used, COLOR_RESET, reset_length);
+	used += reset_length;
+	buf[used++] = '\n';
+	return used;
+}
+
+// Formats the whole line up front and hands it to stdio as a single write
+static void log_emit(FILE *stream, LogLevel level, const char *format, va_list args) {
+	char stack[LOG_LINE_SIZE];
+	va_list retry;
+	va_copy(retry, args);
+
+	int tty = log_stream_is_tty(stream);
+	size_t needed;
+	size_t length = log_format_line(stack, sizeof(stack), tty, level, format, args, &needed);
+	char *line = stack;
+	if (needed > length) {
+		char *heap = ALLOC(char, needed + 1);
+		if (heap) {
+			line = heap;
+			length = log_format_line(line, needed + 1, tty, level, format, retry, &needed);
+		}
+	}
+	va_end(retry);
+
+	fwrite(line, 1, length, stream);
+	fflush(stream);
+	if (line != stack) {
+		FREE(line);
+	}
+}
+
+// Asynchronous Logging Implementation
+
+#define LOG_ASYNC_BATCH 64
+
+// Bounded MPSC queue with per-slot sequence numbers (Vyukov). A slot is free
+// for position pos when seq == pos and ready for the writer when seq == pos + 1.
+typedef struct {
+	size_t seq;
+	int fd;
+	u32 length;
+} LogAsyncSlot;
+
+static struct {
+	LogAsyncSlot *slots;
+	char *text;
+	size_t mask;
+	size_t message_size;
+	LogOverflow overflow;
+	int running;
+	int stopping;
+	int idle;
+	u64 dropped;
+	u64 reported;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t wake;
+	// Producers and the writer hammer different counters, keep them apart
+	char pad0[64];
+	size_t enqueue_pos;
+	int producers;
+	FILE *last_stream; // stream flushed most recently by log_async_stream_ready
+	char pad1[64];
+	size_t dequeue_pos;
+	char pad2[64];
+} log_async = {.mutex = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER};
+
+static void log_async_wake(void) {
+	if (__atomic_load_n(&log_async.idle, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&log_async.mutex);
+		pthread_cond_signal(&log_async.wake);
+		pthread_mutex_unlock(&log_async.mutex);
+	}
+}
+
+static void log_write_all(int fd, struct iovec *iov, int count) {
+	while (count > 0) {
+		ssize_t written = writev(fd, iov, count);
+		if (written < 0) {
+			return;
+		}
+		// Skip fully written buffers and advance into a partially written one
+		while (count > 0 && (size_t)written >= iov->iov_len) {
+			written -= (ssize_t)iov->iov_len;
+			++iov;
+			--count;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= (size_t)written;
+		}
+	}
+}
+
+static void log_async_report_drops(void) {
+	u64 dropped = __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
+	if (dropped == log_async.reported) {
+		return;
+	}
+	char line[96];
+	int length = snprintf(line, sizeof(line), "[WARN ] log: dropped %llu messages\n",
+	                      (unsigned long long)(dropped - log_async.reported));
+	struct iovec iov = {line, (size_t)length};
+	log_write_all(STDERR_FILENO, &iov, 1);
+	log_async.reported = dropped;
+}
+
+// Writes every ready slot, returns the number of messages written
+static size_t log_async_drain(void) {
+	size_t total = 0;
+	for (;;) {
+		struct iovec iov[LOG_ASYNC_BATCH];
+		size_t pos = log_async.dequeue_pos;
+		int count = 0;
+		int fd = -1;
+
+		// Collect consecutive ready slots going to the same descriptor
+		while (count < LOG_ASYNC_BATCH) {
+			LogAsyncSlot *slot = &log_async.slots[(pos + (size_t)count) & log_async.mask];
+			if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + (size_t)count + 1) {
+				break;
+			}
+			if (count > 0 && slot->fd != fd) {
+				break;
+			}
+			fd = slot->fd;
+			iov[count].iov_base = log_async.text + ((pos + (size_t)count) & log_async.mask) * log_async.message_size;
+			iov[count].iov_len = slot->length;
+			++count;
+		}
+		if (count == 0) {
+			break;
+		}
+
+		log_write_all(fd, iov, count);
+		for (int i = 0; i < count; ++i) {
+			LogAsyncSlot *slot = &log_async.slots[(pos + (size_t)i) & log_async.mask];
+			__atomic_store_n(&slot->seq, pos + (size_t)i + log_async.mask + 1, __ATOMIC_RELEASE);
+		}
+		__atomic_store_n(&log_async.dequeue_pos, pos + (size_t)count, __ATOMIC_RELEASE);
+		total += (size_t)count;
+	}
+
+	if (log_async.overflow == LOG_OVERFLOW_DROP_REPORT) {
+		log_async_report_drops();
+	}
+	return total;
+}
+
+static void *log_async_writer(void *arg) {
+	UNUSED(arg);
+	for (;;) {
+		if (log_async_drain() > 0) {
+			continue;
+		}
+		if (__atomic_load_n(&log_async.stopping, __ATOMIC_ACQUIRE)) {
+			// log_async_stop waited for the producers, so every claimed slot
+			// is published and the ring can be emptied completely
+			while (log_async.dequeue_pos != __atomic_load_n(&log_async.enqueue_pos, __ATOMIC_ACQUIRE)) {
+				log_async_drain();
+			}
+			break;
+		}
+
+		// Announce that we are going to sleep, then check once more so a
+		// producer that missed the flag cannot leave a message stranded
+		pthread_mutex_lock(&log_async.mutex);
+		__atomic_store_n(&log_async.idle, 1, __ATOMIC_SEQ_CST);
+		LogAsyncSlot *next = &log_async.slots[log_async.dequeue_pos & log_async.mask];
+		if (__atomic_load_n(&next->seq, __ATOMIC_SEQ_CST) != log_async.dequeue_pos + 1 &&
+		    !__atomic_load_n(&log_async.stopping, __ATOMIC_SEQ_CST)) {
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec += 10 * 1000 * 1000;
+			if (deadline.tv_nsec >= 1000000000L) {
+				deadline.tv_sec += 1;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&log_async.wake, &log_async.mutex, &deadline);
+		}
+		__atomic_store_n(&log_async.idle, 0, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&log_async.mutex);
+	}
+	return NULL;
+}
+
+// Producers announce themselves before checking running, so log_async_stop
+// can wait for every producer that got past the check before freeing the ring
+static int log_async_enter(void) {
+	__atomic_fetch_add(&log_async.producers, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&log_async.running, __ATOMIC_SEQ_CST)) {
+		return 1;
+	}
+	__atomic_fetch_sub(&log_async.producers, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void log_async_leave(void) {
+	__atomic_fetch_sub(&log_async.producers, 1, __ATOMIC_RELEASE);
+}
+
+// Claims the next free slot, returns NULL when the message was dropped
+static LogAsyncSlot *log_async_claim(size_t *out_pos) {
+	size_t pos = __atomic_load_n(&log_async.enqueue_pos, __ATOMIC_RELAXED);
+	LogAsyncSlot *slot;
+	for (;;) {
+		slot = &log_async.slots[pos & log_async.mask];
+		size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&log_async.enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// Full: the writer has not released this slot from the previous lap
+			if (log_async.overflow != LOG_OVERFLOW_BLOCK) {
+				__atomic_fetch_add(&log_async.dropped, 1, __ATOMIC_RELAXED);
+				return NULL;
+			}
+			log_async_wake();
+			sched_yield();
+			pos = __atomic_load_n(&log_async.enqueue_pos, __ATOMIC_RELAXED);
+		} else {
+			pos = __atomic_load_n(&log_async.enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	*out_pos = pos;
+	return slot;
+}
+
+static void log_async_publish(LogAsyncSlot *slot, size_t pos, FILE *stream, size_t length) {
+	slot->fd = fileno(stream);
+	slot->length = (u32)length;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	log_async_wake();
+}
+
+// Streams without a descriptor (fmemopen, open_memstream) cannot be written
+// with writev and stay synchronous. Before a stream is first queued, output
+// already buffered in its stdio buffer is flushed so the writer's lines
+// cannot overtake it.
+static int log_async_stream_ready(FILE *stream) {
+	if (fileno(stream) < 0) {
+		return 0;
+	}
+	if (__atomic_load_n(&log_async.last_stream, __ATOMIC_RELAXED) != stream) {
+		fflush(stream);
+		__atomic_store_n(&log_async.last_stream, stream, __ATOMIC_RELAXED);
+	}
+	return 1;
+}
+
+// Formats one line into a free slot. Returns 1 when queued, 0 when the message
+// was dropped and -1 when the caller must write it synchronously, because async
+// logging stopped or the stream has no descriptor.
+static int log_async_push(FILE *stream, LogLevel level, const char *format, va_list args) {
+	if (!log_async_stream_ready(stream) || !log_async_enter()) {
+		return -1;
+	}
+	size_t pos;
+	LogAsyncSlot *slot = log_async_claim(&pos);
+	if (!slot) {
+		log_async_leave();
+		return 0;
+	}
+	char *text = log_async.text + (pos & log_async.mask) * log_async.message_size;
+	size_t needed;
+	size_t length = log_format_line(text, log_async.message_size, log_stream_is_tty(stream), level, format, args, &needed);
+	log_async_publish(slot, pos, stream, length);
+	log_async_leave();
+	return 1;
+}
+
+// Queues an already formatted line, cut to the slot size but kept newline terminated
+static int log_async_push_line(FILE *stream, const char *line, size_t length) {
+	if (!log_async_stream_ready(stream) || !log_async_enter()) {
+		return -1;
+	}
+	size_t pos;
+	LogAsyncSlot *slot = log_async_claim(&pos);
+	if (!slot) {
+		log_async_leave();
+		return 0;
+	}
+	char *text = log_async.text + (pos & log_async.mask) * log_async.message_size;
+	if (length > log_async.message_size) {
+		length = log_async.message_size;
+		memcpy(text, line, length - 1);
+		text[length - 1] = '\n';
+	} else {
+		memcpy(text, line, length);
+	}
+	log_async_publish(slot, pos, stream, length);
+	log_async_leave();
+	return 1;
+}
+
+NONSTD_DEF int log_async_start(LogAsyncConfig config) {
+	if (log_async.running) {
+		return 1;
+	}
+
+	size_t capacity = 1;
+	while (capacity < (config.capacity ? config.capacity : 4096)) {
+		capacity <<= 1;
+	}
+	size_t message_size = MAX(config.message_size ? config.message_size : 512, (size_t)64);
+
+	log_async.slots = ALLOC(LogAsyncSlot, capacity);
+	log_async.text = ALLOC(char, capacity * message_size);
+	if (!log_async.slots || !log_async.text) {
+		FREE(log_async.slots);
+		FREE(log_async.text);
+		return 0;
+	}
+	for (size_t i = 0; i < capacity; ++i) {
+		log_async.slots[i].seq = i;
+	}
+	log_async.mask = capacity - 1;
+	log_async.message_size = message_size;
+	log_async.overflow = config.overflow;
+	log_async.enqueue_pos = 0;
+	log_async.dequeue_pos = 0;
+	log_async.dropped = 0;
+	log_async.reported = 0;
+	log_async.stopping = 0;
+	log_async.idle = 0;
+	log_async.last_stream = NULL;
+
+	// Anything buffered in stdio must come out before the writer's lines
+	fflush(NULL);
+	if (pthread_create(&log_async.thread, NULL, log_async_writer, NULL) != 0) {
+		FREE(log_async.slots);
+		FREE(log_async.text);
+		return 0;
+	}
+	__atomic_store_n(&log_async.running, 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+NONSTD_DEF void log_async_flush(void) {
+	if (!__atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	log_limit_flush();
+	size_t target = __atomic_load_n(&log_async.enqueue_pos, __ATOMIC_ACQUIRE);
+	while (__atomic_load_n(&log_async.dequeue_pos, __ATOMIC_ACQUIRE) < target) {
+		pthread_mutex_lock(&log_async.mutex);
+		pthread_cond_signal(&log_async.wake);
+		pthread_mutex_unlock(&log_async.mutex);
+		sched_yield();
+	}
+}
+
+NONSTD_DEF void log_async_stop(void) {
+	if (!__atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	log_limit_flush();
+	// New messages go through the synchronous path from here on. Producers
+	// that already passed the check finish first; the writer keeps draining,
+	// so producers blocked on a full ring get their slots.
+	__atomic_store_n(&log_async.running, 0, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&log_async.producers, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&log_async.mutex);
+		pthread_cond_signal(&log_async.wake);
+		pthread_mutex_unlock(&log_async.mutex);
+		sched_yield();
+	}
+	pthread_mutex_lock(&log_async.mutex);
+	__atomic_store_n(&log_async.stopping, 1, __ATOMIC_RELEASE);
+	pthread_cond_signal(&log_async.wake);
+	pthread_mutex_unlock(&log_async.mutex);
+	pthread_join(log_async.thread, NULL);
+
+	FREE(log_async.slots);
+	FREE(log_async.text);
+}
+
+NONSTD_DEF u64 log_async_dropped(void) {
+	return __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
+}
+
+static void log_vmessage(FILE *stream, LogLevel level, const char *format, va_list args) {
+	if (__atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE) && log_async_push(stream, level, format, args) >= 0) {
+		return;
+	}
+	log_emit(stream, level, format, args);
+}
+
+NONSTD_DEF void log_message(FILE *stream, LogLevel level, const char *format, ...) {
+	if (max_level < level)
+		return;
+
+	va_list args;
+	va_start(args, format);
+	log_vmessage(stream, level, format, args);
+	va_end(args);
+}
+
+// The site's flag already accounts for the level, a rule may enable a site
+// above the runtime level
+NONSTD_DEF void log_site_message(const LogSite *site, FILE *stream, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	log_vmessage(stream, site->level, format, args);
+	va_end(args);
+}
+
+// Rate Limiting Implementation
+
+// GCRA: every message moves the theoretical arrival time (TAT) forward by
+// one emission interval. A message is allowed while the TAT stays within
+// the burst window ahead of now.
+static int log_limit_suppress(LogLimiter *limiter, u64 now_ns) {
+	if (__atomic_fetch_add(&limiter->suppressed, 1, __ATOMIC_RELAXED) == 0) {
+		__atomic_store_n(&limiter->since, now_ns, __ATOMIC_RELAXED);
+	}
+	return 0;
+}
+
+NONSTD_DEF int log_limit_allow_at(LogLimiter *limiter, u32 per_second, u64 now_ns) {
+	if (per_second == 0) {
+		return log_limit_suppress(limiter, now_ns);
+	}
+	u64 interval = 1000000000ull / per_second;
+	u64 window = interval * per_second;
+	u64 tat = __atomic_load_n(&limiter->tat, __ATOMIC_RELAXED);
+	for (;;) {
+		u64 next = MAX(tat, now_ns) + interval;
+		if (next - now_ns > window) {
+			return log_limit_suppress(limiter, now_ns);
+		}
+		if (__atomic_compare_exchange_n(&limiter->tat, &tat, next, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			return 1;
+		}
+	}
+}
+
+// Limiters that suppressed a call, newest first; log_limit_flush walks them
+static LogLimiter *log_limiters;
+
+static void log_limit_register(LogLimiter *limiter, const LogSite *site, FILE *stream) {
+	int expected = 0;
+	if (!__atomic_compare_exchange_n(&limiter->registered, &expected, 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		return;
+	}
+	limiter->site = site;
+	limiter->stream = stream;
+	LogLimiter *head = __atomic_load_n(&log_limiters, __ATOMIC_RELAXED);
+	do {
+		limiter->next = head;
+	} while (!__atomic_compare_exchange_n(&log_limiters, &head, limiter, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Writes the summary for the calls suppressed since the last one, if any
+static void log_limit_report(LogLimiter *limiter, const LogSite *site, FILE *stream) {
+	u64 suppressed = __atomic_exchange_n(&limiter->suppressed, 0, __ATOMIC_RELAXED);
+	if (suppressed) {
+		log_site_message(site, stream, "suppressed %llu messages from %s:%d",
+		                 (unsigned long long)suppressed, site->file, site->line);
+	}
+}
+
+NONSTD_DEF int log_limit_allow(LogLimiter *limiter, u32 per_second, const LogSite *site, FILE *stream) {
+	// Suppressed calls only pay for this, so the coarse clock is preferred
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	u64 now = (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+	if (log_limit_allow_at(limiter, per_second, now)) {
+		log_limit_report(limiter, site, stream);
+		return 1;
+	}
+
+	if (!__atomic_load_n(&limiter->registered, __ATOMIC_RELAXED)) {
+		log_limit_register(limiter, site, stream);
+	}
+	// A storm that goes on is summarized once per second
+	if (now - __atomic_load_n(&limiter->since, __ATOMIC_RELAXED) >= 1000000000ull) {
+		log_limit_report(limiter, site, stream);
+	}
+	return 0;
+}
+
+NONSTD_DEF void log_limit_flush(void) {
+	for (LogLimiter *limiter = __atomic_load_n(&log_limiters, __ATOMIC_ACQUIRE); limiter; limiter = limiter->next) {
+		log_limit_report(limiter, limiter->site, limiter->stream);
+	}
+}
+
+NONSTD_DEF int log_sample_allow(LogLimiter *limiter, u32 every) {
+	u64 call = __atomic_fetch_add(&limiter->calls, 1, __ATOMIC_RELAXED);
+	return every <= 1 || call % every == 0;
+}
+
+// Structured Logging Implementation
+
+static LogFormat log_format = LOG_FORMAT_JSON;
+static pthread_once_t log_kv_once = PTHREAD_ONCE_INIT;
+static pthread_key_t log_kv_key;
+static NONSTD_THREAD_LOCAL stringb *log_kv_scratch;
+
+static void log_kv_thread_exit(void *arg) {
+	stringb *sb = arg;
+	sb_free(sb);
+	free(sb);
+}
+
+static void log_kv_init_key(void) {
+	pthread_key_create(&log_kv_key, log_kv_thread_exit);
+}
+
+NONSTD_DEF void log_set_format(LogFormat format) {
+	log_format = format;
+}
+
+// SWAR test for a byte below 0x20, '"' or '\\' in 8 bytes at once
+static int log_word_needs_escape(u64 word) {
+	const u64 ones = 0x0101010101010101ull;
+	const u64 highs = 0x8080808080808080ull;
+	u64 quote = word ^ (ones * '"');
+	u64 backslash = word ^ (ones * '\\');
+	u64 control = (word - ones * 0x20) & ~word;
+	u64 zero_quote = (quote - ones) & ~quote;
+	u64 zero_backslash = (backslash - ones) & ~backslash;
+	return ((control | zero_quote | zero_backslash) & highs) != 0;
+}
+
+static int log_byte_needs_escape(u8 c) {
+	return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Appends s with JSON string escaping; runs without special bytes are copied
+// in bulk after an 8-bytes-at-a-time scan
+static void log_append_escaped(stringb *sb, stringv s) {
+	static const char hex[] = "0123456789abcdef";
+	size_t i = 0;
+	while (i < s.length) {
+		size_t start = i;
+		while (i + 8 <= s.length) {
+			u64 word;
+			memcpy(&word, s.data + i, 8);
+			if (log_word_needs_escape(word)) {
+				break;
+			}
+			i += 8;
+		}
+		while (i < s.length && !log_byte_needs_escape((u8)s.data[i])) {
+			++i;
+		}
+		if (i > start) {
+			sb_append_sv(sb, sv_from_parts(s.data + start, i - start));
+		}
+		if (i == s.length) {
+			break;
+		}
+
+		u8 c = (u8)s.data[i++];
+		char escaped[6] = {'\\', (char)c};
+		size_t length = 2;
+		if (c == '\n') {
+			escaped[1] = 'n';
+		} else if (c == '\r') {
+			escaped[1] = 'r';
+		} else if (c == '\t') {
+			escaped[1] = 't';
+		} else if (c < 0x20) {
+			memcpy(escaped + 1, "u00", 3);
+			escaped[4] = hex[c >> 4];
+			escaped[5] = hex[c & 15];
+			length = 6;
+		}
+		sb_append_sv(sb, sv_from_parts(escaped, length));
+	}
+}
+
+static void log_append_string(stringb *sb, LogFormat format, stringv s) {
+	// logfmt only quotes values that would not survive splitting on spaces
+	int quote = format == LOG_FORMAT_JSON || s.length == 0 || sv_find_any(s, sv_from_cstr(" =\"")) != SV_NPOS;
+	for (size_t i = 0; !quote && i < s.length; ++i) {
+		quote = log_byte_needs_escape((u8)s.data[i]);
+	}
+	if (quote) {
+		sb_append_char(sb, '"');
+		log_append_escaped(sb, s);
+		sb_append_char(sb, '"');
+	} else {
+		sb_append_sv(sb, s);
+	}
+}
+
+static void log_append_u64(stringb *sb, u64 value, int negative) {
+	char digits[21];
+	size_t n = sizeof(digits);
+	do {
+		digits[--n] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+	if (negative) {
+		digits[--n] = '-';
+	}
+	sb_append_sv(sb, sv_from_parts(digits + n, sizeof(digits) - n));
+}
+
+static void log_append_value(stringb *sb, LogFormat format, const LogKv *kv) {
+	switch (kv->type) {
+	case LOG_KV_INT: {
+		u64 magnitude = kv->as.i < 0 ? 0 - (u64)kv->as.i : (u64)kv->as.i;
+		log_append_u64(sb, magnitude, kv->as.i < 0);
+		break;
+	}
+	case LOG_KV_UINT:
+		log_append_u64(sb, kv->as.u, 0);
+		break;
+	case LOG_KV_FLOAT: {
+		double f = kv->as.f;
+		if (f != f || f - f != 0) {
+			// NaN and infinities have no JSON number form
+			sb_append_cstr(sb, format == LOG_FORMAT_JSON ? "null" : f != f ? "NaN" : f > 0 ? "+Inf" : "-Inf");
+		} else {
+			char number[32];
+			int length = snprintf(number, sizeof(number), "%.15g", f);
+			sb_append_sv(sb, sv_from_parts(number, (size_t)length));
+		}
+		break;
+	}
+	case LOG_KV_STR:
+		log_append_string(sb, format, kv->as.s);
+		break;
+	case LOG_KV_BOOL:
+		sb_append_cstr(sb, kv->as.b ? "true" : "false");
+		break;
+	}
+}
+
+// logfmt keys cannot be quoted, so bytes a parser would split on (spaces,
+// control bytes, '=' and '"') become '_'; an empty key becomes "_"
+static int log_key_byte_invalid(u8 c) {
+	return c <= ' ' || c == '=' || c == '"' || c == 0x7f;
+}
+
+static void log_append_logfmt_key(stringb *sb, const char *key) {
+	size_t start = 0, i = 0;
+	for (; key[i]; ++i) {
+		if (log_key_byte_invalid((u8)key[i])) {
+			sb_append_sv(sb, sv_from_parts(key + start, i - start));
+			sb_append_char(sb, '_');
+			start = i + 1;
+		}
+	}
+	if (i == 0) {
+		sb_append_char(sb, '_');
+	}
+	sb_append_sv(sb, sv_from_parts(key + start, i - start));
+}
+
+static void log_append_field(stringb *sb, LogFormat format, const char *key, size_t index) {
+	if (format == LOG_FORMAT_JSON) {
+		sb_append_cstr(sb, index ? ",\"" : "{\"");
+		log_append_escaped(sb, sv_from_cstr(key));
+		sb_append_cstr(sb, "\":");
+	} else {
+		if (index) {
+			sb_append_char(sb, ' ');
+		}
+		log_append_logfmt_key(sb, key);
+		sb_append_char(sb, '=');
+	}
+}
+
+NONSTD_DEF void log_kv_render(stringb *sb, LogFormat format, LogLevel level, const char *message, const LogKv *fields, size_t count) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	char time_str[24];
+	memcpy(time_str, log_time_string(tv.tv_sec), 19);
+	int ms = (int)(tv.tv_usec / 1000);
+	time_str[19] = '.';
+	time_str[20] = (char)('0' + ms / 100);
+	time_str[21] = (char)('0' + ms / 10 % 10);
+	time_str[22] = (char)('0' + ms % 10);
+
+	log_append_field(sb, format, "time", 0);
+	log_append_string(sb, LOG_FORMAT_JSON, sv_from_parts(time_str, 23));
+	log_append_field(sb, format, "level", 1);
+	log_append_string(sb, format, sv_from_cstr(level_strings[level]));
+	log_append_field(sb, format, "msg", 2);
+	log_append_string(sb, format, sv_from_cstr(message));
+	for (size_t i = 0; i < count; ++i) {
+		log_append_field(sb, format, fields[i].key, i + 3);
+		log_append_value(sb, format, &fields[i]);
+	}
+	if (format == LOG_FORMAT_JSON) {
+		sb_append_char(sb, '}');
+	}
+	sb_append_char(sb, '\n');
+}
+
+NONSTD_DEF void log_kv_emit(FILE *stream, LogLevel level, const char *message, const LogKv *fields, size_t count) {
+	stringb *sb = log_kv_scratch;
+	if (!sb) {
+		pthread_once(&log_kv_once, log_kv_init_key);
+		sb = ALLOC(stringb, 1);
+		if (!sb) {
+			return;
+		}
+		sb_init(sb, 256);
+		pthread_setspecific(log_kv_key, sb);
+		log_kv_scratch = sb;
+	}
+
+	// The scratch buffer keeps its capacity, steady state logging does not allocate
+	sb->length = 0;
+	log_kv_render(sb, log_format, level, message, fields, count);
+	if (__atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE) && log_async_push_line(stream, sb->data, sb->length) >= 0) {
+		return;
+	}
+	fwrite(sb->data, 1, sb->length, stream);
+	fflush(stream);
+}
+
+NONSTD_DEF void log_kv(FILE *stream, LogLevel level, const char *message, const LogKv *fields, size_t count) {
+	if (max_level < level) {
+		return;
+	}
+	log_kv_emit(stream, level, message, fields, count);
+}
+
+// Binary Logging Implementation
+
+#define BINLOG_MAGIC "NSTDBLOG"
+#define BINLOG_VERSION 2
+// magic, version, then for version 2 the wall clock in ns, the matching
+// cycles_now() value and the cycle ticks per second
+#define BINLOG_HEADER_V1 (8 + 4)
+#define BINLOG_HEADER_V2 (8 + 4 + 8 + 8 + 8)
+#define BINLOG_BUFFER_SIZE (64 * 1024)
+#define BINLOG_MAX_PAYLOAD 1024
+#define BINLOG_RECORD_SITE 1
+#define BINLOG_RECORD_EVENT 2
+// tag, site id, timestamp in cycles (ns for version 1), payload length
+#define BINLOG_EVENT_HEADER (1 + 4 + 8 + 2)
+
+enum {
+	BINLOG_ARG_INT,
+	BINLOG_ARG_LONG,
+	BINLOG_ARG_LLONG,
+	BINLOG_ARG_SIZE,
+	BINLOG_ARG_INTMAX,
+	BINLOG_ARG_PTRDIFF,
+	BINLOG_ARG_DOUBLE,
+	BINLOG_ARG_LDOUBLE,
+	BINLOG_ARG_STRING,
+	BINLOG_ARG_POINTER,
+};
+
+typedef struct {
+	size_t length;
+	char data[BINLOG_BUFFER_SIZE];
+} BinlogBuffer;
+
+static struct {
+	int fd;
+	u32 next_id;
+	array(BinlogSite *) sites;
+	pthread_mutex_t mutex;
+	pthread_once_t once;
+	pthread_key_t key;
+} binlog = {.fd = -1, .mutex = PTHREAD_MUTEX_INITIALIZER, .once = PTHREAD_ONCE_INIT};
+
+static NONSTD_THREAD_LOCAL BinlogBuffer *binlog_buffer;
+
+// Parses the conversions of a printf format into argument types. '*' widths
+// and precisions take an int argument of their own.
+static int binlog_parse_format(const char *format, u8 *types) {
+	int count = 0;
+	for (const char *p = format; *p; ++p) {
+		if (*p != '%') {
+			continue;
+		}
+		if (*++p == '%') {
+			continue;
+		}
+		while (*p && strchr("-+ #0", *p)) {
+			++p;
+		}
+		for (int part = 0; part < 2; ++part) {
+			if (*p == '*') {
+				if (count == BINLOG_MAX_ARGS) {
+					return -1;
+				}
+				types[count++] = BINLOG_ARG_INT;
+				++p;
+			}
+			while (isdigit((unsigned char)*p)) {
+				++p;
+			}
+			if (part == 0 && *p == '.') {
+				++p;
+				continue;
+			}
+			break;
+		}
+
+		int type = BINLOG_ARG_INT;
+		if (*p == 'h') {
+			p += p[1] == 'h' ? 2 : 1;
+		} else if (*p == 'l') {
+			type = p[1] == 'l' ? BINLOG_ARG_LLONG : BINLOG_ARG_LONG;
+			p += p[1] == 'l' ? 2 : 1;
+		} else if (*p == 'z') {
+			type = BINLOG_ARG_SIZE, ++p;
+		} else if (*p == 'j') {
+			type = BINLOG_ARG_INTMAX, ++p;
+		} else if (*p == 't') {
+			type = BINLOG_ARG_PTRDIFF, ++p;
+		} else if (*p == 'L') {
+			type = BINLOG_ARG_LDOUBLE, ++p;
+		}
+
+		if (*p && strchr("fFeEgGaA", *p)) {
+			type = type == BINLOG_ARG_LDOUBLE ? BINLOG_ARG_LDOUBLE : BINLOG_ARG_DOUBLE;
+		} else if (*p == 's') {
+			type = BINLOG_ARG_STRING;
+		} else if (*p == 'p') {
+			type = BINLOG_ARG_POINTER;
+		} else if (!*p || !strchr("diuxXoc", *p)) {
+			// %n and unknown conversions cannot be deferred
+			return -1;
+		}
+		if (count == BINLOG_MAX_ARGS) {
+			return -1;
+		}
+		types[count++] = (u8)type;
+	}
+	return count;
+}
+
+static void binlog_write_fd(const void *data, size_t size) {
+	const char *p = data;
+	while (binlog.fd >= 0 && size > 0) {
+		ssize_t written = write(binlog.fd, p, size);
+		if (written <= 0) {
+			return;
+		}
+		p += written;
+		size -= (size_t)written;
+	}
+}
+
+// Called with the mutex held
+static void binlog_write_site(const BinlogSite *site) {
+	char record[1 + 4 + 1 + 4 + 2 + 2];
+	u16 file_length = (u16)MIN(strlen(site->file), (size_t)UINT16_MAX);
+	u16 format_length = (u16)MIN(strlen(site->format), (size_t)UINT16_MAX);
+	u8 level = (u8)site->level;
+	i32 line = site->line;
+	record[0] = BINLOG_RECORD_SITE;
+	memcpy(record + 1, &site->id, 4);
+	memcpy(record + 5, &level, 1);
+	memcpy(record + 6, &line, 4);
+	memcpy(record + 10, &file_length, 2);
+	memcpy(record + 12, &format_length, 2);
+	binlog_write_fd(record, sizeof(record));
+	binlog_write_fd(site->file, file_length);
+	binlog_write_fd(site->format, format_length);
+}
+
+static void binlog_flush_buffer(BinlogBuffer *buffer) {
+	if (!buffer || buffer->length == 0) {
+		return;
+	}
+	pthread_mutex_lock(&binlog.mutex);
+	binlog_write_fd(buffer->data, buffer->length);
+	pthread_mutex_unlock(&binlog.mutex);
+	buffer->length = 0;
+}
+
+static void binlog_thread_exit(void *arg) {
+	BinlogBuffer *buffer = arg;
+	binlog_flush_buffer(buffer);
+	free(buffer);
+}
+
+static void binlog_init_key(void) {
+	pthread_key_create(&binlog.key, binlog_thread_exit);
+}
+
+static u32 binlog_register(BinlogSite *site) {
+	pthread_mutex_lock(&binlog.mutex);
+	if (!site->id) {
+		int count = binlog_parse_format(site->format, site->arg_types);
+		if (count >= 0) {
+			site->arg_count = (u8)count;
+			array_push(binlog.sites, site);
+			u32 id = ++binlog.next_id;
+			// Store the id last, other threads read the parsed types after seeing it
+			__atomic_store_n(&site->id, id, __ATOMIC_RELEASE);
+			binlog_write_site(site);
+		}
+	}
+	pthread_mutex_unlock(&binlog.mutex);
+	return site->id;
+}
+
+NONSTD_DEF int binlog_open(const char *path) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return 0;
+	}
+	pthread_once(&binlog.once, binlog_init_key);
+
+	pthread_mutex_lock(&binlog.mutex);
+	if (binlog.fd >= 0) {
+		close(binlog.fd);
+	}
+	__atomic_store_n(&binlog.fd, fd, __ATOMIC_RELAXED);
+	// Anchor the cycle counter to the wall clock once, events only read the counter
+	u32 version = BINLOG_VERSION;
+	u64 ticks_per_second = (u64)(cycles_per_ns() * 1e9 + 0.5);
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	u64 base_cycles = cycles_now();
+	u64 base_ns = (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+	binlog_write_fd(BINLOG_MAGIC, 8);
+	binlog_write_fd(&version, 4);
+	binlog_write_fd(&base_ns, 8);
+	binlog_write_fd(&base_cycles, 8);
+	binlog_write_fd(&ticks_per_second, 8);
+	// Sites registered for an earlier file are described again
+	BinlogSite *site;
+	array_foreach(binlog.sites, site) { binlog_write_site(site); }
+	pthread_mutex_unlock(&binlog.mutex);
+	return 1;
+}
+
+NONSTD_DEF void binlog_flush(void) {
+	binlog_flush_buffer(binlog_buffer);
+}
+
+NONSTD_DEF void binlog_close(void) {
+	// The main thread's key destructor never runs, so release its buffer here
+	binlog_flush();
+	if (binlog_buffer) {
+		pthread_setspecific(binlog.key, NULL);
+		FREE(binlog_buffer);
+	}
+	pthread_mutex_lock(&binlog.mutex);
+	if (binlog.fd >= 0) {
+		close(binlog.fd);
+		__atomic_store_n(&binlog.fd, -1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&binlog.mutex);
+}
+
+// Copies the next variadic argument of type T into the payload
+#define BINLOG_COPY_ARG(T)                         \
+	do {                                           \
+		T value = va_arg(args, T);                 \
+		memcpy(payload + used, &value, sizeof(T)); \
+		used += sizeof(T);                         \
+	} while (0)
+
+NONSTD_DEF void binlog_write(BinlogSite *site, const char *format, ...) {
+	if (max_level < site->level || __atomic_load_n(&binlog.fd, __ATOMIC_RELAXED) < 0) {
+		return;
+	}
+	u32 id = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+	if (!id && !(id = binlog_register(site))) {
+		return;
+	}
+
+	BinlogBuffer *buffer = binlog_buffer;
+	if (!buffer) {
+		buffer = binlog_buffer = ALLOC(BinlogBuffer, 1);
+		if (!buffer) {
+			return;
+		}
+		buffer->length = 0;
+		pthread_setspecific(binlog.key, buffer);
+	}
+	if (buffer->length + BINLOG_EVENT_HEADER + BINLOG_MAX_PAYLOAD > BINLOG_BUFFER_SIZE) {
+		binlog_flush_buffer(buffer);
+	}
+
+	u64 timestamp = cycles_now();
+
+	char *record = buffer->data + buffer->length;
+	char *payload = record + BINLOG_EVENT_HEADER;
+	size_t used = 0;
+
+	va_list args;
+	va_start(args, format);
+	for (u8 i = 0; i < site->arg_count; ++i) {
+		switch (site->arg_types[i]) {
+		case BINLOG_ARG_INT:
+			BINLOG_COPY_ARG(int);
+			break;
+		case BINLOG_ARG_LONG:
+			BINLOG_COPY_ARG(long);
+			break;
+		case BINLOG_ARG_LLONG:
+			BINLOG_COPY_ARG(long long);
+			break;
+		case BINLOG_ARG_SIZE:
+			BINLOG_COPY_ARG(size_t);
+			break;
+		case BINLOG_ARG_INTMAX:
+			BINLOG_COPY_ARG(intmax_t);
+			break;
+		case BINLOG_ARG_PTRDIFF:
+			BINLOG_COPY_ARG(ptrdiff_t);
+			break;
+		case BINLOG_ARG_DOUBLE:
+			BINLOG_COPY_ARG(double);
+			break;
+		case BINLOG_ARG_LDOUBLE:
+			BINLOG_COPY_ARG(long double);
+			break;
+		case BINLOG_ARG_POINTER:
+			BINLOG_COPY_ARG(void *);
+			break;
+		case BINLOG_ARG_STRING: {
+			// Strings are copied with a length, cut to what the record has left
+			const char *s = va_arg(args, const char *);
+			s = s ? s : "(null)";
+			size_t reserve = (size_t)(site->arg_count - i) * (sizeof(long double) + 2);
+			size_t room = BINLOG_MAX_PAYLOAD > used + reserve ? BINLOG_MAX_PAYLOAD - used - reserve : 0;
+			u16 length = (u16)strnlen(s, room);
+			memcpy(payload + used, &length, 2);
+			memcpy(payload + used + 2, s, length);
+			used += 2 + (size_t)length;
+			break;
+		}
+		}
+	}
+	va_end(args);
+
+	u16 payload_length = (u16)used;
+	record[0] = BINLOG_RECORD_EVENT;
+	memcpy(record + 1, &id, 4);
+	memcpy(record + 5, &timestamp, 8);
+	memcpy(record + 13, &payload_length, 2);
+	buffer->length += BINLOG_EVENT_HEADER + used;
+}
+
+typedef struct {
+	const char *file;
+	const char *format;
+	u16 format_length;
+	u8 level;
+	u8 arg_count;
+	u8 arg_types[BINLOG_MAX_ARGS];
+} BinlogDecodedSite;
+
+typedef struct {
+	u64 timestamp;
+	size_t order;
+	u32 id;
+	const char *payload;
+	u16 length;
+} BinlogDecodedEvent;
+
+static int binlog_event_compare(const void *a, const void *b) {
+	const BinlogDecodedEvent *x = a, *y = b;
+	if (x->timestamp != y->timestamp) {
+		return x->timestamp < y->timestamp ? -1 : 1;
+	}
+	return x->order < y->order ? -1 : x->order > y->order;
+}
+
+// Appends one printf conversion to sb, growing it when the result is longer
+// than the space left
+static void binlog_append_formatted(stringb *sb, const char *format, ...) {
+	sb_ensure(sb, 64);
+	if (!sb->data) {
+		return;
+	}
+	va_list args, retry;
+	va_start(args, format);
+	va_copy(retry, args);
+	size_t room = sb->capacity - sb->length;
+	int written = vsnprintf(sb->data + sb->length, room, format, args);
+	if (written >= 0 && (size_t)written >= room) {
+		sb_ensure(sb, (size_t)written);
+		room = sb->capacity - sb->length;
+		written = (size_t)written < room ? vsnprintf(sb->data + sb->length, room, format, retry) : -1;
+	}
+	if (written > 0) {
+		sb->length += (size_t)written;
+	}
+	sb->data[sb->length] = '\0';
+	va_end(retry);
+	va_end(args);
+}
+
+// Reads a T from the payload and formats it with the current spec
+#define BINLOG_FORMAT_ARG(T)                     \
+	do {                                         \
+		T v;                                     \
+		if (offset + sizeof(T) > length) {       \
+			return;                              \
+		}                                        \
+		memcpy(&v, payload + offset, sizeof(T)); \
+		offset += sizeof(T);                     \
+		binlog_append_formatted(sb, spec, v);    \
+	} while (0)
+
+// Formats one event by running each conversion of the format through snprintf
+static void binlog_format_event(stringb *sb, const BinlogDecodedSite *site, const char *payload, u16 length) {
+	const char *p = site->format;
+	const char *end = site->format + site->format_length;
+	size_t offset = 0;
+	u8 arg = 0;
+	char spec[64];
+
+	while (p < end) {
+		if (*p != '%') {
+			sb_append_char(sb, *p++);
+			continue;
+		}
+		if (p + 1 < end && p[1] == '%') {
+			sb_append_char(sb, '%');
+			p += 2;
+			continue;
+		}
+
+		// Copy the conversion spec, replacing '*' with the recorded int
+		size_t n = 0;
+		spec[n++] = *p++;
+		while (p < end && n < sizeof(spec) - 24) {
+			char c = *p++;
+			if (c == '*') {
+				int star = 0;
+				if (arg < site->arg_count && offset + sizeof(int) <= length) {
+					memcpy(&star, payload + offset, sizeof(int));
+					offset += sizeof(int);
+					++arg;
+				}
+				n += (size_t)snprintf(spec + n, 16, "%d", star);
+				continue;
+			}
+			spec[n++] = c;
+			if (strchr("diuxXocfFeEgGaAsp", c)) {
+				break;
+			}
+		}
+		spec[n] = '\0';
+		if (arg >= site->arg_count) {
+			break;
+		}
+
+		switch (site->arg_types[arg++]) {
+		case BINLOG_ARG_INT:
+			BINLOG_FORMAT_ARG(int);
+			break;
+		case BINLOG_ARG_LONG:
+			BINLOG_FORMAT_ARG(long);
+			break;
+		case BINLOG_ARG_LLONG:
+			BINLOG_FORMAT_ARG(long long);
+			break;
+		case BINLOG_ARG_SIZE:
+			BINLOG_FORMAT_ARG(size_t);
+			break;
+		case BINLOG_ARG_INTMAX:
+			BINLOG_FORMAT_ARG(intmax_t);
+			break;
+		case BINLOG_ARG_PTRDIFF:
+			BINLOG_FORMAT_ARG(ptrdiff_t);
+			break;
+		case BINLOG_ARG_DOUBLE:
+			BINLOG_FORMAT_ARG(double);
+			break;
+		case BINLOG_ARG_LDOUBLE:
+			BINLOG_FORMAT_ARG(long double);
+			break;
+		case BINLOG_ARG_POINTER:
+			BINLOG_FORMAT_ARG(void *);
+			break;
+		case BINLOG_ARG_STRING: {
+			u16 string_length;
+			if (offset + 2 > length) {
+				return;
+			}
+			memcpy(&string_length, payload + offset, 2);
+			if (offset + 2 + string_length > length) {
+				return;
+			}
+			// The recorded string is not terminated, pass it with a precision
+			char string_spec[80];
+			spec[n - 1] = '\0';
+			const char *dot = strchr(spec, '.');
+			int precision = string_length;
+			if (dot) {
+				precision = MIN(precision, atoi(dot + 1));
+				spec[dot - spec] = '\0';
+			}
+			snprintf(string_spec, sizeof(string_spec), "%s.*s", spec);
+			binlog_append_formatted(sb, string_spec, precision, payload + offset + 2);
+			offset += 2 + (size_t)string_length;
+			break;
+		}
+		}
+	}
+}
+
+NONSTD_DEF long binlog_decode(const char *data, size_t size, FILE *out) {
+	if (size < BINLOG_HEADER_V1 || memcmp(data, BINLOG_MAGIC, 8) != 0) {
+		return -1;
+	}
+	u32 version;
+	memcpy(&version, data + 8, 4);
+	// Version 1 files carry timestamps in ns
+	u64 base_ns = 0, base_cycles = 0, ticks_per_second = 1000000000ull;
+	size_t pos = BINLOG_HEADER_V1;
+	if (version == 2) {
+		if (size < BINLOG_HEADER_V2) {
+			return -1;
+		}
+		memcpy(&base_ns, data + 12, 8);
+		memcpy(&base_cycles, data + 20, 8);
+		memcpy(&ticks_per_second, data + 28, 8);
+		pos = BINLOG_HEADER_V2;
+	} else if (version != 1) {
+		return -1;
+	}
+	double ns_per_tick = ticks_per_second ? 1e9 / (double)ticks_per_second : 1.0;
+	array(BinlogDecodedSite) sites;
+	array(BinlogDecodedEvent) events;
+	array_init(sites);
+	array_init(events);
+	long result = 0;
+
+	// First pass: collect site definitions and event positions. Per-thread
+	// buffers reach the file in flush order, so events are sorted by time.
+	while (pos < size && result >= 0) {
+		u8 tag = (u8)data[pos];
+		if (tag == BINLOG_RECORD_SITE && pos + 14 <= size) {
+			u32 id;
+			u16 file_length, format_length;
+			memcpy(&id, data + pos + 1, 4);
+			memcpy(&file_length, data + pos + 10, 2);
+			memcpy(&format_length, data + pos + 12, 2);
+			if (pos + 14 + file_length + format_length > size || id == 0) {
+				result = -1;
+				break;
+			}
+			BinlogDecodedSite site = {0};
+			site.level = (u8)data[pos + 5];
+			site.file = data + pos + 14;
+			site.format = site.file + file_length;
+			site.format_length = format_length;
+			// Types are derived from the format again, it needs a terminator
+			char format[1024];
+			size_t copy = MIN((size_t)format_length, sizeof(format) - 1);
+			memcpy(format, site.format, copy);
+			format[copy] = '\0';
+			int count = binlog_parse_format(format, site.arg_types);
+			site.arg_count = (u8)MAX(count, 0);
+			while (sites.length < id) {
+				array_push(sites, (BinlogDecodedSite){0});
+			}
+			sites.data[id - 1] = site;
+			pos += 14 + (size_t)file_length + format_length;
+		} else if (tag == BINLOG_RECORD_EVENT && pos + BINLOG_EVENT_HEADER <= size) {
+			BinlogDecodedEvent event;
+			memcpy(&event.id, data + pos + 1, 4);
+			memcpy(&event.timestamp, data + pos + 5, 8);
+			memcpy(&event.length, data + pos + 13, 2);
+			if (pos + BINLOG_EVENT_HEADER + event.length > size) {
+				result = -1;
+				break;
+			}
+			event.payload = data + pos + BINLOG_EVENT_HEADER;
+			event.order = events.length;
+			array_push(events, event);
+			pos += BINLOG_EVENT_HEADER + (size_t)event.length;
+		} else {
+			result = -1;
+		}
+	}
+
+	if (result == 0 && events.length > 0) {
+		qsort(events.data, events.length, sizeof(BinlogDecodedEvent), binlog_event_compare);
+	}
+
+	// Second pass: render the events in the layout of log_message
+	stringb line;
+	sb_init(&line, 256);
+	for (size_t i = 0; result >= 0 && i < events.length; ++i) {
+		BinlogDecodedEvent *event = &events.data[i];
+		if (event->id == 0 || event->id > sites.length || !sites.data[event->id - 1].format) {
+			continue;
+		}
+		BinlogDecodedSite *site = &sites.data[event->id - 1];
+		LogLevel level = (LogLevel)MIN(site->level, (u8)LOG_DEBUG);
+
+		line.length = 0;
+		sb_ensure(&line, LOG_PREFIX_SIZE);
+		i64 ticks = (i64)(event->timestamp - base_cycles);
+		u64 ns = base_ns + (u64)(i64)((double)ticks * ns_per_tick);
+		time_t seconds = (time_t)(ns / 1000000000ull);
+		int ms = (int)(ns % 1000000000ull / 1000000ull);
+		line.length = log_format_prefix(line.data, 0, level, seconds, ms);
+		binlog_format_event(&line, site, event->payload, event->length);
+		sb_append_char(&line, '\n');
+		fwrite(line.data, 1, line.length, out);
+		++result;
+	}
+
+	sb_free(&line);
+	array_free(sites);
+	array_free(events);
+	return result;
+}
+
+// PPM Image Implementation
+
+NONSTD_DEF Canvas ppm_init(u32 width, u32 height) {
+	Canvas img = {0};
+	img.width = width;
+	img.height = height;
+	img.pixels = ALLOC(Color, width * height);
+	if (img.pixels) {
+		memset(img.pixels, 0, sizeof(Color) * width * height);
+	}
+	return img;
+}
+
+NONSTD_DEF void ppm_free(Canvas *img) {
+	if (img->pixels) {
+		FREE(img->pixels);
+	}
+	img->width = 0;
+	img->height = 0;
+}
+
+NONSTD_DEF void ppm_set_pixel(Canvas *img, u32 x, u32 y, Color color) {
+	if (x < img->width && y < img->height) {
+		img->pixels[y * img->width + x] = color;
+	}
+}
+
+NONSTD_DEF Color ppm_get_pixel(const Canvas *img, u32 x, u32 y) {
+	if (x < img->width && y < img->height) {
+		return img->pixels[y * img->width + x];
+	}
+	return (Color){0, 0, 0};
+}
+
+NONSTD_DEF int ppm_save(const Canvas *img, const char *filename) {
+	FILE *f = fopen(filename, "w");
+	if (!f) {
+		return 0;
+	}
+
+	fprintf(f, "P3\n%u %u\n255\n", img->width, img->height);
+	for (u32 y = 0; y < img->height; ++y) {
+		for (u32 x = 0; x < img->width; ++x) {
+			Color c = ppm_get_pixel(img, x, y);
+			fprintf(f, "%d %d %d ", c.r, c.g, c.b);
+		}
+		fprintf(f, "\n");
+	}
+
+	fclose(f);
+	return 1;
+}
+
+NONSTD_DEF int ppm_save_binary(const Canvas *img, const char *filename) {
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		return 0;
+	}
+
+	fprintf(f, "P6\n%u %u\n255\n", img->width, img->height);
+
+	size_t count = (size_t)img->width * img->height;
+	int ok = 1;
+	if (sizeof(Color) == 3) {
+		// Color is tightly packed RGB, so the pixel buffer is already the P6 payload.
+		ok = fwrite(img->pixels, 3, count, f) == count;
+	} else {
+		for (size_t i = 0; i < count && ok; ++i) {
+			u8 rgb[3] = {img->pixels[i].r, img->pixels[i].g, img->pixels[i].b};
+			ok = fwrite(rgb, 1, 3, f) == 3;
+		}
+	}
+
+	if (fclose(f) != 0) {
+		ok = 0;
+	}
+	return ok;
+}
+
+// Reads one header number, skipping whitespace and '#' comments. Consumes the
+// single whitespace character after the number, so binary data starts right after.
+static int ppm_read_header_value(FILE *f, u32 *out) {
+	int c = fgetc(f);
+	while (c != EOF) {
+		if (c == '#') {
+			while (c != EOF && c != '\n') {
+				c = fgetc(f);
+			}
+		} else if (!isspace(c)) {
+			break;
+		}
+		c = fgetc(f);
+	}
 
-NONSTD_DEF void arena_grow(Arena *a, size_t min_size) {
-	size_t size = MAX(ARENA_DEFAULT_BLOCK_SIZE, min_size);
-	char *block = ALLOC(char, size);
-	a->ptr = block;
-	a->end = block + size;
-	array_push(a->blocks, block);
+	if (c < '0' || c > '9') {
+		return 0;
+	}
+
+	u64 value = 0;
+	while (c >= '0' && c <= '9') {
+		value = value * 10 + (u64)(c - '0');
+		if (value > UINT32_MAX) {
+			return 0;
+		}
+		c = fgetc(f);
+	}
+
+	if (c != EOF && !isspace(c)) {
+		return 0;
+	}
+
+	*out = (u32)value;
+	return 1;
 }
 
-NONSTD_DEF void *arena_alloc(Arena *a, size_t size) {
-	// Align to 8 bytes basically
-	size_t align = sizeof(void *);
-	uintptr_t current = (uintptr_t)a->ptr;
-	uintptr_t aligned = (current + align - 1) & ~(align - 1);
-	uintptr_t end = (uintptr_t)a->end;
+static u8 ppm_scale_sample(u32 value, u32 max_val) {
+	if (max_val == 255) {
+		return (u8)value;
+	}
+	if (value >= max_val) {
+		return 255;
+	}
+	return (u8)((value * 255 + max_val / 2) / max_val);
+}
 
-	// Check for overflow (aligned wrapped around) or out of bounds (aligned >= end)
-	// or not enough space ((end - aligned) < size)
-	if (aligned < current || aligned >= end || (end - aligned) < size) {
-		arena_grow(a, size);
-		current = (uintptr_t)a->ptr;
-		aligned = (current + align - 1) & ~(align - 1);
-		end = (uintptr_t)a->end;
+static int ppm_read_binary_pixels(FILE *f, Canvas *img, u32 max_val) {
+	size_t count = (size_t)img->width * img->height;
+
+	if (max_val == 255 && sizeof(Color) == 3) {
+		return fread(img->pixels, 3, count, f) == count;
 	}
 
-	// Double check after grow (in case grow failed or size is just too huge)
-	if (aligned < current || aligned >= end || (end - aligned) < size) {
-		return NULL;
+	// Samples wider than a byte are stored as 16-bit big-endian values.
+	size_t sample_size = max_val < 256 ? 1 : 2;
+	size_t size = count * 3 * sample_size;
+	u8 *raw = ALLOC(u8, size);
+	if (!raw) {
+		return 0;
 	}
 
-	a->ptr = (char *)(aligned + size);
-	return (void *)aligned;
-}
+	if (fread(raw, 1, size, f) != size) {
+		FREE(raw);
+		return 0;
+	}
 
-NONSTD_DEF void arena_free(Arena *a) {
-	char *block;
-	array_foreach(a->blocks, block) { FREE(block); }
-	array_free(a->blocks);
-	a->ptr = NULL;
-	a->end = NULL;
+	for (size_t i = 0; i < count; ++i) {
+		u32 rgb[3];
+		for (size_t k = 0; k < 3; ++k) {
+			const u8 *p = raw + (i * 3 + k) * sample_size;
+			rgb[k] = sample_size == 1 ? p[0] : (u32)((p[0] << 8) | p[1]);
+		}
+		img->pixels[i] = (Color){ppm_scale_sample(rgb[0], max_val), ppm_scale_sample(rgb[1], max_val), ppm_scale_sample(rgb[2], max_val)};
+	}
+
+	FREE(raw);
+	return 1;
 }
 
-// File I/O Implementation
+static int ppm_read_ascii_pixels(FILE *f, Canvas *img, u32 max_val) {
+	size_t count = (size_t)img->width * img->height;
+	for (size_t i = 0; i < count; ++i) {
+		u32 r, g, b;
+		if (fscanf(f, "%u %u %u", &r, &g, &b) != 3) {
+			return 0;
+		}
+		img->pixels[i] = (Color){ppm_scale_sample(r, max_val), ppm_scale_sample(g, max_val), ppm_scale_sample(b, max_val)};
+	}
+	return 1;
+}
 
-NONSTD_DEF char *read_entire_file(const char *filepath, size_t *out_size) {
-	FILE *f = fopen(filepath, "rb");
+NONSTD_DEF Canvas ppm_read(const char *filename) {
+	Canvas img = {0};
+	FILE *f = fopen(filename, "rb");
 	if (!f) {
-		return NULL;
+		return img;
 	}
 
-	fseek(f, 0, SEEK_END);
-	long length = ftell(f);
-	fseek(f, 0, SEEK_SET);
+	char magic[2];
+	if (fread(magic, 1, 2, f) != 2 || magic[0] != 'P' || (magic[1] != '3' && magic[1] != '6')) {
+		fclose(f);
+		return img;
+	}
+	int binary = magic[1] == '6';
 
-	if (length < 0) {
+	u32 w, h, max_val;
+	if (!ppm_read_header_value(f, &w) || !ppm_read_header_value(f, &h) || !ppm_read_header_value(f, &max_val)) {
 		fclose(f);
-		return NULL;
+		return img;
 	}
 
-	size_t size = (size_t)length;
-	char *buffer = ALLOC(char, size + 1);
-	if (!buffer) {
+	if (max_val == 0 || max_val > 65535 || (u64)w * h > UINT32_MAX) {
 		fclose(f);
-		return NULL;
+		return img;
 	}
 
-	size_t read = fread(buffer, 1, size, f);
+	img = ppm_init(w, h);
+	if (!img.pixels) {
+		fclose(f);
+		return img;
+	}
+
+	int ok = binary ? ppm_read_binary_pixels(f, &img, max_val) : ppm_read_ascii_pixels(f, &img, max_val);
 	fclose(f);
 
-	if (read != size) {
-		FREE(buffer);
+	if (!ok) {
+		ppm_free(&img);
+		return (Canvas){0};
+	}
+
+	return img;
+}
+
+NONSTD_DEF void ppm_fill(Canvas *canvas, Color color) {
+	for (u32 i = 0; i < canvas->width * canvas->height; ++i) {
+		canvas->pixels[i] = color;
+	}
+}
+
+NONSTD_DEF void ppm_draw_rect(Canvas *canvas, u32 x, u32 y, u32 w, u32 h, Color color) {
+	if (w == 0 || h == 0) {
+		return;
+	}
+	for (u32 i = x; i < x + w; ++i) {
+		ppm_set_pixel(canvas, i, y, color);
+		ppm_set_pixel(canvas, i, y + h - 1, color);
+	}
+	for (u32 j = y; j < y + h; ++j) {
+		ppm_set_pixel(canvas, x, j, color);
+		ppm_set_pixel(canvas, x + w - 1, j, color);
+	}
+}
+
+NONSTD_DEF void ppm_draw_line(Canvas *canvas, i32 x0, i32 y0, i32 x1, i32 y1, Color color) {
+	i32 dx = abs(x1 - x0);
+	i32 dy = -abs(y1 - y0);
+	i32 sx = x0 < x1 ? 1 : -1;
+	i32 sy = y0 < y1 ? 1 : -1;
+	i32 err = dx + dy;
+
+	while (1) {
+		ppm_set_pixel(canvas, (u32)x0, (u32)y0, color);
+		if (x0 == x1 && y0 == y1) {
+			break;
+		}
+
+		i32 e2 = 2 * err;
+		if (e2 >= dy) {
+			err += dy;
+			x0 += sx;
+		}
+		if (e2 <= dx) {
+			err += dx;
+			y0 += sy;
+		}
+	}
+}
+
+NONSTD_DEF void ppm_draw_circle(Canvas *canvas, i32 xm, i32 ym, i32 r, Color color) {
+	i32 x = -r, y = 0, err = 2 - 2 * r;
+	do {
+		ppm_set_pixel(canvas, (u32)(xm - x), (u32)(ym + y), color);
+		ppm_set_pixel(canvas, (u32)(xm - y), (u32)(ym - x), color);
+		ppm_set_pixel(canvas, (u32)(xm + x), (u32)(ym - y), color);
+		ppm_set_pixel(canvas, (u32)(xm + y), (u32)(ym + x), color);
+		r = err;
+		if (r <= y) {
+			err += ++y * 2 + 1;
+		}
+		if (r > x || err > y) {
+			err += ++x * 2 + 1;
+		}
+	} while (x < 0);
+}
+
+NONSTD_DEF void ppm_draw_triangle(Canvas *canvas, i32 x0, i32 y0, i32 x1, i32 y1, i32 x2, i32 y2, Color color) {
+	ppm_draw_line(canvas, x0, y0, x1, y1, color);
+	ppm_draw_line(canvas, x1, y1, x2, y2, color);
+	ppm_draw_line(canvas, x2, y2, x0, y0, color);
+}
+
+// Timing Implementation
+
+NONSTD_DEF u64 time_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+NONSTD_DEF u64 cycles_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+	u64 value;
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(value));
+	return value;
+#else
+	return time_now_ns();
+#endif
+}
+
+static double timer_cycles_per_ns = 1.0;
+static pthread_once_t timer_calibrate_once = PTHREAD_ONCE_INIT;
+
+// Measures the cycle counter against the monotonic clock over about 10 ms
+static void timer_calibrate(void) {
+	u64 ns_start = time_now_ns();
+	u64 cycles_start = cycles_now();
+	struct timespec pause = {0, 10 * 1000 * 1000};
+	nanosleep(&pause, NULL);
+	u64 ns_elapsed = time_now_ns() - ns_start;
+	u64 cycles_elapsed = cycles_now() - cycles_start;
+	if (ns_elapsed && cycles_elapsed) {
+		timer_cycles_per_ns = (double)cycles_elapsed / (double)ns_elapsed;
+	}
+}
+
+NONSTD_DEF double cycles_per_ns(void) {
+	pthread_once(&timer_calibrate_once, timer_calibrate);
+	return timer_cycles_per_ns;
+}
+
+NONSTD_DEF u64 cycles_to_ns(u64 cycles) {
+	return (u64)((double)cycles / cycles_per_ns());
+}
+
+static TimerSite *timer_sites = NULL;
+
+NONSTD_DEF TimerScope timer_begin(TimerSite *site) {
+	return (TimerScope){site, cycles_now()};
+}
+
+NONSTD_DEF void timer_end(TimerScope *scope) {
+	timer_record(scope->site, cycles_now() - scope->start);
+	scope->site = NULL;
+}
+
+NONSTD_DEF void timer_record(TimerSite *site, u64 cycles) {
+	// The first recording links the site into the list, lock-free
+	if (!__atomic_load_n(&site->registered, __ATOMIC_ACQUIRE)) {
+		int expected = 0;
+		if (__atomic_compare_exchange_n(&site->registered, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			TimerSite *head = __atomic_load_n(&timer_sites, __ATOMIC_ACQUIRE);
+			do {
+				site->next = head;
+			} while (!__atomic_compare_exchange_n(&timer_sites, &head, site, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+		}
+	}
+
+	__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&site->total, cycles, __ATOMIC_RELAXED);
+	u64 min = __atomic_load_n(&site->min, __ATOMIC_RELAXED);
+	while (cycles < min && !__atomic_compare_exchange_n(&site->min, &min, cycles, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+	u64 max = __atomic_load_n(&site->max, __ATOMIC_RELAXED);
+	while (cycles > max && !__atomic_compare_exchange_n(&site->max, &max, cycles, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+
+// Formats one summary line, times are converted from cycles to microseconds
+static void timer_format_site(char *buf, size_t size, const TimerSite *site) {
+	u64 count = __atomic_load_n(&site->count, __ATOMIC_RELAXED);
+	double per_us = cycles_per_ns() * 1000.0;
+	double total = (double)__atomic_load_n(&site->total, __ATOMIC_RELAXED) / per_us;
+	double min = count ? (double)__atomic_load_n(&site->min, __ATOMIC_RELAXED) / per_us : 0.0;
+	double max = (double)__atomic_load_n(&site->max, __ATOMIC_RELAXED) / per_us;
+	snprintf(buf, size, "%-24s %10llu %14.3f %12.3f %12.3f %12.3f", site->name, (unsigned long long)count,
+	         total, count ? total / (double)count : 0.0, min, max);
+}
+
+NONSTD_DEF void timer_summary(FILE *stream) {
+	fprintf(stream, "%-24s %10s %14s %12s %12s %12s\n", "timer", "count", "total us", "avg us", "min us", "max us");
+	char line[160];
+	for (TimerSite *site = __atomic_load_n(&timer_sites, __ATOMIC_ACQUIRE); site; site = site->next) {
+		timer_format_site(line, sizeof(line), site);
+		fprintf(stream, "%s\n", line);
+	}
+	fflush(stream);
+}
+
+NONSTD_DEF void timer_log_summary(LogLevel level) {
+	timer_log_summary_stream(stdout, level);
+}
+
+NONSTD_DEF void timer_log_summary_stream(FILE *stream, LogLevel level) {
+	char line[160];
+	for (TimerSite *site = __atomic_load_n(&timer_sites, __ATOMIC_ACQUIRE); site; site = site->next) {
+		timer_format_site(line, sizeof(line), site);
+		log_message(stream, level, "timer %s", line);
+	}
+}
+
+NONSTD_DEF void timer_reset_all(void) {
+	for (TimerSite *site = __atomic_load_n(&timer_sites, __ATOMIC_ACQUIRE); site; site = site->next) {
+		__atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->total, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->min, UINT64_MAX, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->max, 0, __ATOMIC_RELAXED);
+	}
+}
+
+// Tracing Implementation
+
+#define TRACE_CHUNK_EVENTS 4096
+
+typedef struct TraceChunk {
+	struct TraceChunk *next;
+	size_t count; // published with release after the event is written
+	TraceEvent events[TRACE_CHUNK_EVENTS];
+} TraceChunk;
+
+typedef struct TraceThread {
+	struct TraceThread *next;
+	TraceChunk *first;
+	TraceChunk *last;
+	u32 tid;
+	char name[32];
+} TraceThread;
+
+static struct {
+	int enabled;
+	u32 generation; // bumped by trace_clear, invalidates the per-thread pointers
+	u32 next_tid;
+	u64 origin;
+	TraceThread *threads;
+	pthread_mutex_t mutex;
+} trace = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static NONSTD_THREAD_LOCAL TraceThread *trace_thread;
+static NONSTD_THREAD_LOCAL u32 trace_thread_generation;
+
+// Buffers stay in the global list after their thread exits so a later
+// trace_write still sees their events
+static TraceThread *trace_current_thread(void) {
+	TraceThread *thread = trace_thread;
+	u32 generation = __atomic_load_n(&trace.generation, __ATOMIC_ACQUIRE);
+	if (thread && trace_thread_generation == generation) {
+		return thread;
+	}
+
+	thread = ALLOC(TraceThread, 1);
+	TraceChunk *chunk = ALLOC(TraceChunk, 1);
+	if (!thread || !chunk) {
+		FREE(thread);
+		FREE(chunk);
 		return NULL;
 	}
+	*thread = (TraceThread){0};
+	chunk->next = NULL;
+	chunk->count = 0;
+	thread->first = thread->last = chunk;
+
+	pthread_mutex_lock(&trace.mutex);
+	thread->tid = ++trace.next_tid;
+	thread->next = trace.threads;
+	trace.threads = thread;
+	trace_thread_generation = trace.generation;
+	pthread_mutex_unlock(&trace.mutex);
+	trace_thread = thread;
+	return thread;
+}
+
+NONSTD_DEF void trace_start(void) {
+	pthread_mutex_lock(&trace.mutex);
+	if (!trace.origin) {
+		trace.origin = cycles_now();
+	}
+	pthread_mutex_unlock(&trace.mutex);
+	__atomic_store_n(&trace.enabled, 1, __ATOMIC_RELEASE);
+}
+
+NONSTD_DEF void trace_stop(void) {
+	__atomic_store_n(&trace.enabled, 0, __ATOMIC_RELEASE);
+}
+
+NONSTD_DEF void trace_event(char phase, const char *name, const char *arg_name, i64 arg_value) {
+	if (!__atomic_load_n(&trace.enabled, __ATOMIC_RELAXED)) {
+		return;
+	}
+	TraceThread *thread = trace_current_thread();
+	if (!thread) {
+		return;
+	}
+
+	TraceChunk *chunk = thread->last;
+	size_t count = chunk->count;
+	if (count == TRACE_CHUNK_EVENTS) {
+		TraceChunk *next = ALLOC(TraceChunk, 1);
+		if (!next) {
+			return;
+		}
+		next->next = NULL;
+		next->count = 0;
+		__atomic_store_n(&chunk->next, next, __ATOMIC_RELEASE);
+		thread->last = chunk = next;
+		count = 0;
+	}
+
+	chunk->events[count] = (TraceEvent){name, arg_name, arg_value, cycles_now(), phase};
+	__atomic_store_n(&chunk->count, count + 1, __ATOMIC_RELEASE);
+}
+
+NONSTD_DEF void trace_set_thread_name(const char *name) {
+	TraceThread *thread = trace_current_thread();
+	if (thread) {
+		pthread_mutex_lock(&trace.mutex);
+		snprintf(thread->name, sizeof(thread->name), "%s", name);
+		pthread_mutex_unlock(&trace.mutex);
+	}
+}
+
+NONSTD_DEF size_t trace_event_count(void) {
+	size_t total = 0;
+	pthread_mutex_lock(&trace.mutex);
+	for (TraceThread *thread = trace.threads; thread; thread = thread->next) {
+		for (TraceChunk *chunk = thread->first; chunk; chunk = __atomic_load_n(&chunk->next, __ATOMIC_ACQUIRE)) {
+			total += __atomic_load_n(&chunk->count, __ATOMIC_ACQUIRE);
+		}
+	}
+	pthread_mutex_unlock(&trace.mutex);
+	return total;
+}
+
+// Appends the event header shared by every phase, up to and including "tid"
+static void trace_append_header(stringb *sb, const char *name, char phase, u32 pid, u32 tid) {
+	sb_append_cstr(sb, "{\"name\":\"");
+	log_append_escaped(sb, sv_from_cstr(name));
+	sb_append_cstr(sb, "\",\"ph\":\"");
+	sb_append_char(sb, phase);
+	sb_append_cstr(sb, "\",\"pid\":");
+	log_append_u64(sb, pid, 0);
+	sb_append_cstr(sb, ",\"tid\":");
+	log_append_u64(sb, tid, 0);
+}
+
+static void trace_append_event(stringb *sb, const TraceEvent *event, u32 pid, u32 tid, u64 origin, double per_ns) {
+	trace_append_header(sb, event->name, event->phase, pid, tid);
+
+	// Timestamps are microseconds with nanosecond precision
+	u64 cycles = event->timestamp > origin ? event->timestamp - origin : 0;
+	u64 ns = (u64)((double)cycles / per_ns);
+	char fraction[4] = {'.', (char)('0' + ns / 100 % 10), (char)('0' + ns / 10 % 10), (char)('0' + ns % 10)};
+	sb_append_cstr(sb, ",\"ts\":");
+	log_append_u64(sb, ns / 1000, 0);
+	sb_append_sv(sb, sv_from_parts(fraction, sizeof(fraction)));
+
+	if (event->phase == 'i') {
+		sb_append_cstr(sb, ",\"s\":\"t\"");
+	}
+	if (event->arg_name) {
+		sb_append_cstr(sb, ",\"args\":{\"");
+		log_append_escaped(sb, sv_from_cstr(event->arg_name));
+		sb_append_cstr(sb, "\":");
+		u64 magnitude = event->arg_value < 0 ? 0 - (u64)event->arg_value : (u64)event->arg_value;
+		log_append_u64(sb, magnitude, event->arg_value < 0);
+		sb_append_char(sb, '}');
+	}
+	sb_append_char(sb, '}');
+}
+
+NONSTD_DEF void trace_render(stringb *sb) {
+	u32 pid = (u32)getpid();
+	double per_ns = cycles_per_ns();
+	int first = 1;
+
+	sb_append_cstr(sb, "{\"traceEvents\":[");
+	pthread_mutex_lock(&trace.mutex);
+	for (TraceThread *thread = trace.threads; thread; thread = thread->next) {
+		if (thread->name[0]) {
+			sb_append_cstr(sb, first ? "\n" : ",\n");
+			first = 0;
+			trace_append_header(sb, "thread_name", 'M', pid, thread->tid);
+			sb_append_cstr(sb, ",\"args\":{\"name\":\"");
+			log_append_escaped(sb, sv_from_cstr(thread->name));
+			sb_append_cstr(sb, "\"}}");
+		}
+		for (TraceChunk *chunk = thread->first; chunk; chunk = __atomic_load_n(&chunk->next, __ATOMIC_ACQUIRE)) {
+			size_t count = __atomic_load_n(&chunk->count, __ATOMIC_ACQUIRE);
+			for (size_t i = 0; i < count; ++i) {
+				sb_append_cstr(sb, first ? "\n" : ",\n");
+				first = 0;
+				trace_append_event(sb, &chunk->events[i], pid, thread->tid, trace.origin, per_ns);
+			}
+		}
+	}
+	pthread_mutex_unlock(&trace.mutex);
+	sb_append_cstr(sb, "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+NONSTD_DEF int trace_write(const char *path) {
+	stringb sb;
+	sb_init(&sb, 1 << 16);
+	trace_render(&sb);
+	int ok = write_entire_file(path, sb.data, sb.length);
+	sb_free(&sb);
+	return ok;
+}
+
+NONSTD_DEF void trace_clear(void) {
+	pthread_mutex_lock(&trace.mutex);
+	TraceThread *thread = trace.threads;
+	while (thread) {
+		TraceChunk *chunk = thread->first;
+		while (chunk) {
+			TraceChunk *next = chunk->next;
+			FREE(chunk);
+			chunk = next;
+		}
+		TraceThread *next = thread->next;
+		FREE(thread);
+		thread = next;
+	}
+	trace.threads = NULL;
+	trace.origin = __atomic_load_n(&trace.enabled, __ATOMIC_RELAXED) ? cycles_now() : 0;
+	__atomic_add_fetch(&trace.generation, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&trace.mutex);
+}
+
+// Histogram Implementation
+
+NONSTD_DEF void hist_init(Histogram *h) {
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+NONSTD_DEF void hist_reset(Histogram *h) {
+	hist_init(h);
+}
+
+// Bucket index: the exponent picks a group of HIST_SUB_COUNT buckets, the
+// HIST_SUB_BITS bits below the leading one pick the bucket inside it
+NONSTD_DEF size_t hist_bucket_index(u64 value) {
+	if (value < HIST_SUB_COUNT) {
+		return (size_t)value;
+	}
+	int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+	return ((size_t)(shift + 1) << HIST_SUB_BITS) + (size_t)((value >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+NONSTD_DEF u64 hist_bucket_low(size_t index) {
+	if (index < HIST_SUB_COUNT) {
+		return index;
+	}
+	int shift = (int)(index >> HIST_SUB_BITS) - 1;
+	return (u64)(HIST_SUB_COUNT + (index & (HIST_SUB_COUNT - 1))) << shift;
+}
+
+NONSTD_DEF u64 hist_bucket_high(size_t index) {
+	if (index < HIST_SUB_COUNT) {
+		return index;
+	}
+	int shift = (int)(index >> HIST_SUB_BITS) - 1;
+	return hist_bucket_low(index) + (((u64)1 << shift) - 1);
+}
 
-	buffer[size] = '\0';
-	if (out_size) {
-		*out_size = size;
+NONSTD_DEF void hist_record(Histogram *h, u64 value) {
+	h->counts[hist_bucket_index(value)]++;
+	h->total++;
+	h->sum += value;
+	h->min = MIN(h->min, value);
+	h->max = MAX(h->max, value);
+}
+
+NONSTD_DEF void hist_record_n(Histogram *h, u64 value, u64 count) {
+	if (count == 0) {
+		return;
 	}
+	h->counts[hist_bucket_index(value)] += count;
+	h->total += count;
+	h->sum += value * count;
+	h->min = MIN(h->min, value);
+	h->max = MAX(h->max, value);
+}
 
-	return buffer;
+NONSTD_DEF void hist_merge(Histogram *dst, const Histogram *src) {
+	for (size_t i = 0; i < HIST_BUCKETS; ++i) {
+		dst->counts[i] += src->counts[i];
+	}
+	dst->total += src->total;
+	dst->sum += src->sum;
+	dst->min = MIN(dst->min, src->min);
+	dst->max = MAX(dst->max, src->max);
 }
 
-NONSTD_DEF int write_entire_file(const char *filepath, const void *data, size_t size) {
-	FILE *f = fopen(filepath, "wb");
-	if (!f) {
+// Returns the highest value equivalent to the bucket holding the requested
+// rank, clamped to the recorded range
+NONSTD_DEF u64 hist_percentile(const Histogram *h, double percentile) {
+	if (h->total == 0) {
 		return 0;
 	}
+	if (percentile <= 0.0) {
+		return h->min;
+	}
+	double rank = MIN(percentile, 100.0) / 100.0 * (double)h->total;
+	u64 target = (u64)rank;
+	if ((double)target < rank || target == 0) {
+		++target;
+	}
+	u64 seen = 0;
+	for (size_t i = 0; i < HIST_BUCKETS; ++i) {
+		seen += h->counts[i];
+		if (seen >= target) {
+			return CLAMP(hist_bucket_high(i), h->min, h->max);
+		}
+	}
+	return h->max;
+}
 
-	size_t written = fwrite(data, 1, size, f);
-	fclose(f);
-
-	return written == size;
+NONSTD_DEF double hist_mean(const Histogram *h) {
+	return h->total ? (double)h->sum / (double)h->total : 0.0;
 }
 
-NONSTD_DEF stringb read_entire_file_sb(const char *filepath) {
-	size_t size = 0;
-	char *data = read_entire_file(filepath, &size);
-	stringb sb = {0};
-	if (data) {
-		sb.data = data;
-		sb.length = size;
-		sb.capacity = size + 1;
+NONSTD_DEF void hist_dump(const Histogram *h, FILE *stream) {
+	fprintf(stream, "count=%llu min=%llu mean=%.1f max=%llu\n", (unsigned long long)h->total,
+	        (unsigned long long)(h->total ? h->min : 0), hist_mean(h), (unsigned long long)h->max);
+	fprintf(stream, "%20s %12s %14s\n", "value", "percentile", "count");
+	u64 seen = 0;
+	for (size_t i = 0; i < HIST_BUCKETS && h->total; ++i) {
+		if (h->counts[i] == 0) {
+			continue;
+		}
+		seen += h->counts[i];
+		fprintf(stream, "%20llu %12.6f %14llu\n", (unsigned long long)CLAMP(hist_bucket_high(i), h->min, h->max),
+		        100.0 * (double)seen / (double)h->total, (unsigned long long)seen);
 	}
-	return sb;
+	fflush(stream);
 }
 
-NONSTD_DEF int write_file_sv(const char *filepath, stringv sv) {
-	return write_entire_file(filepath, sv.data, sv.length);
+NONSTD_DEF void hist_log(const Histogram *h, FILE *stream, LogLevel level, const char *name) {
+	log_message(stream, level, "%s count=%llu min=%llu mean=%.1f p50=%llu p90=%llu p99=%llu p99.9=%llu max=%llu", name,
+	            (unsigned long long)h->total, (unsigned long long)(h->total ? h->min : 0), hist_mean(h),
+	            (unsigned long long)hist_percentile(h, 50.0), (unsigned long long)hist_percentile(h, 90.0),
+	            (unsigned long long)hist_percentile(h, 99.0), (unsigned long long)hist_percentile(h, 99.9),
+	            (unsigned long long)h->max);
 }
 
-NONSTD_DEF int write_file_sb(const char *filepath, const stringb *sb) {
-	return write_entire_file(filepath, sb->data, sb->length);
+NONSTD_DEF int hist_set_init(HistogramSet *set) {
+	array_init(set->parts);
+	if (pthread_mutex_init(&set->mutex, NULL) != 0) {
+		return 0;
+	}
+	if (pthread_key_create(&set->key, NULL) != 0) {
+		pthread_mutex_destroy(&set->mutex);
+		return 0;
+	}
+	return 1;
 }
 
-// Logging Implementation
+// Only the owning thread writes its histogram. Relaxed atomic loads and
+// stores compile to plain moves but let hist_set_merge read it concurrently.
+#define HIST_RELAXED_ADD(field, value) \
+	__atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+
+NONSTD_DEF void hist_set_record(HistogramSet *set, u64 value) {
+	Histogram *h = pthread_getspecific(set->key);
+	if (!h) {
+		h = ALLOC(Histogram, 1);
+		if (!h) {
+			return;
+		}
+		hist_init(h);
+		pthread_mutex_lock(&set->mutex);
+		array_push(set->parts, h);
+		pthread_mutex_unlock(&set->mutex);
+		pthread_setspecific(set->key, h);
+	}
+	HIST_RELAXED_ADD(h->counts[hist_bucket_index(value)], 1);
+	HIST_RELAXED_ADD(h->total, 1);
+	HIST_RELAXED_ADD(h->sum, value);
+	if (value < __atomic_load_n(&h->min, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&h->min, value, __ATOMIC_RELAXED);
+	}
+	if (value > __atomic_load_n(&h->max, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+	}
+}
 
-static LogLevel max_level = LOG_INFO;
+NONSTD_DEF void hist_set_merge(HistogramSet *set, Histogram *out) {
+	hist_init(out);
+	pthread_mutex_lock(&set->mutex);
+	for (size_t p = 0; p < set->parts.length; ++p) {
+		Histogram *h = set->parts.data[p];
+		for (size_t i = 0; i < HIST_BUCKETS; ++i) {
+			out->counts[i] += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+		}
+		out->total += __atomic_load_n(&h->total, __ATOMIC_RELAXED);
+		out->sum += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+		out->min = MIN(out->min, __atomic_load_n(&h->min, __ATOMIC_RELAXED));
+		out->max = MAX(out->max, __atomic_load_n(&h->max, __ATOMIC_RELAXED));
+	}
+	pthread_mutex_unlock(&set->mutex);
+}
 
-static const char *level_strings[] = {
-	"ERROR",
-	"WARN",
-	"INFO",
-	"DEBUG",
-};
+NONSTD_DEF void hist_set_free(HistogramSet *set) {
+	pthread_key_delete(set->key);
+	for (size_t p = 0; p < set->parts.length; ++p) {
+		FREE(set->parts.data[p]);
+	}
+	array_free(set->parts);
+	pthread_mutex_destroy(&set->mutex);
+}
 
-static const char *level_colors[] = {
-	COLOR_ERROR,
-	COLOR_WARNING,
-	COLOR_INFO,
-	COLOR_DEBUG,
-};
+// Thread Pool Implementation
 
-NONSTD_DEF void set_log_level(LogLevel level) {
-	max_level = level;
+NONSTD_DEF void wait_group_init(WaitGroup *wg) {
+	wg->count = 0;
+	pthread_mutex_init(&wg->mutex, NULL);
+	pthread_cond_init(&wg->cond, NULL);
 }
 
-NONSTD_DEF LogLevel get_log_level_from_env(void) {
-	const char *env = getenv("LOG_LEVEL");
-	if (env) {
-		int level = atoi(env);
-		if (level >= 0 && level <= 3) {
-			return (LogLevel)level;
-		}
-	}
+NONSTD_DEF void wait_group_add(WaitGroup *wg, i64 delta) {
+	__atomic_add_fetch(&wg->count, delta, __ATOMIC_ACQ_REL);
+}
 
-	return max_level;
+// The count is lowered under the mutex so a waiter cannot return and destroy
+// the group while the last wait_group_done still uses it
+NONSTD_DEF void wait_group_done(WaitGroup *wg) {
+	pthread_mutex_lock(&wg->mutex);
+	if (__atomic_sub_fetch(&wg->count, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_cond_broadcast(&wg->cond);
+	}
+	pthread_mutex_unlock(&wg->mutex);
 }
 
-NONSTD_DEF void log_message(FILE *stream, LogLevel level, const char *format, ...) {
-	if (max_level < level)
-		return;
+NONSTD_DEF void wait_group_wait(WaitGroup *wg) {
+	pthread_mutex_lock(&wg->mutex);
+	while (__atomic_load_n(&wg->count, __ATOMIC_ACQUIRE) > 0) {
+		pthread_cond_wait(&wg->cond, &wg->mutex);
+	}
+	pthread_mutex_unlock(&wg->mutex);
+}
 
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	struct tm *tm_info = localtime(&tv.tv_sec);
+NONSTD_DEF void wait_group_destroy(WaitGroup *wg) {
+	pthread_mutex_destroy(&wg->mutex);
+	pthread_cond_destroy(&wg->cond);
+}
 
-	char time_str[24];
-	strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
+#define POOL_DEQUE_INITIAL_CAPACITY 256
+#define POOL_SPIN_ROUNDS 32
 
-	const char *color = isatty(fileno(stream)) ? level_colors[level] : "";
-	const char *reset = isatty(fileno(stream)) ? COLOR_RESET : "";
+typedef struct {
+	TaskFn fn;
+	void *arg;
+	WaitGroup *wg;
+} PoolTask;
+
+// Replaced buffers stay reachable through `previous` until the pool is
+// destroyed, since a thief may still be reading from one
+typedef struct PoolDequeBuffer {
+	struct PoolDequeBuffer *previous;
+	i64 capacity;
+	PoolTask slots[];
+} PoolDequeBuffer;
+
+// The owner pushes and pops at bottom, thieves take from top
+typedef struct {
+	i64 top;
+	char padding[64 - sizeof(i64)];
+	i64 bottom;
+	PoolDequeBuffer *buffer;
+} PoolDeque;
 
-	const char *log_format = "%s[%s.%03d] [%-5s] ";
-	fprintf(stream, log_format, color, time_str, (int)(tv.tv_usec / 1000), level_strings[level]);
+typedef struct {
+	ThreadPool *pool;
+	pthread_t thread;
+	u64 rng;
+	PoolDeque deque;
+} PoolWorker;
+
+struct ThreadPool {
+	PoolWorker *workers;
+	size_t worker_count;
+	size_t started;
+	pthread_mutex_t mutex;
+	pthread_cond_t wake;
+	array(PoolTask) injector; // under mutex, consumed from injector_head
+	size_t injector_head;
+	size_t injector_size;
+	i64 pending; // queued tasks not yet taken by any thread
+	int sleeping;
+	int stopping;
+};
 
-	va_list args;
-	va_start(args, format);
-	vfprintf(stream, format, args);
-	va_end(args);
+static NONSTD_THREAD_LOCAL PoolWorker *pool_current_worker;
 
-	fprintf(stream, "%s\n", reset);
-	fflush(stream);
+// Slots are read by thieves while the owner may reuse them; a torn read only
+// happens when the thief's CAS on top then fails, so relaxed atomics suffice
+static void pool_slot_store(PoolDequeBuffer *buffer, i64 index, PoolTask task) {
+	PoolTask *slot = &buffer->slots[index & (buffer->capacity - 1)];
+	__atomic_store_n(&slot->fn, task.fn, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->arg, task.arg, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->wg, task.wg, __ATOMIC_RELAXED);
 }
 
-// PPM Image Implementation
+static PoolTask pool_slot_load(PoolDequeBuffer *buffer, i64 index) {
+	PoolTask *slot = &buffer->slots[index & (buffer->capacity - 1)];
+	PoolTask task;
+	task.fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+	task.arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+	task.wg = __atomic_load_n(&slot->wg, __ATOMIC_RELAXED);
+	return task;
+}
 
-NONSTD_DEF Canvas ppm_init(u32 width, u32 height) {
-	Canvas img = {0};
-	img.width = width;
-	img.height = height;
-	img.pixels = ALLOC(Color, width * height);
-	if (img.pixels) {
-		memset(img.pixels, 0, sizeof(Color) * width * height);
+static PoolDequeBuffer *pool_buffer_new(i64 capacity) {
+	size_t size = sizeof(PoolDequeBuffer) + (size_t)capacity * sizeof(PoolTask);
+	PoolDequeBuffer *buffer = (PoolDequeBuffer *)ALLOC(char, size);
+	if (!buffer) {
+		return NULL;
 	}
-	return img;
+	buffer->previous = NULL;
+	buffer->capacity = capacity;
+	return buffer;
 }
 
-NONSTD_DEF void ppm_free(Canvas *img) {
-	if (img->pixels) {
-		FREE(img->pixels);
+// Returns 0 when the deque is full and cannot grow
+static int pool_deque_push(PoolDeque *deque, PoolTask task) {
+	i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+	i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	PoolDequeBuffer *buffer = __atomic_load_n(&deque->buffer, __ATOMIC_RELAXED);
+	if (bottom - top >= buffer->capacity) {
+		PoolDequeBuffer *grown = pool_buffer_new(buffer->capacity * 2);
+		if (!grown) {
+			return 0;
+		}
+		for (i64 i = top; i < bottom; ++i) {
+			pool_slot_store(grown, i, pool_slot_load(buffer, i));
+		}
+		grown->previous = buffer;
+		__atomic_store_n(&deque->buffer, grown, __ATOMIC_RELEASE);
+		buffer = grown;
 	}
-	img->width = 0;
-	img->height = 0;
+	pool_slot_store(buffer, bottom, task);
+	__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+	return 1;
 }
 
-NONSTD_DEF void ppm_set_pixel(Canvas *img, u32 x, u32 y, Color color) {
-	if (x < img->width && y < img->height) {
-		img->pixels[y * img->width + x] = color;
+static int pool_deque_pop(PoolDeque *deque, PoolTask *out) {
+	i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+	PoolDequeBuffer *buffer = __atomic_load_n(&deque->buffer, __ATOMIC_RELAXED);
+	// Publishing the new bottom before reading top is what keeps the owner
+	// and a thief from both taking the last task
+	__atomic_store_n(&deque->bottom, bottom, __ATOMIC_SEQ_CST);
+	i64 top = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST);
+	if (top > bottom) {
+		__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	PoolTask task = pool_slot_load(buffer, bottom);
+	if (top == bottom) {
+		int won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+		__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+		if (!won) {
+			return 0;
+		}
 	}
+	*out = task;
+	return 1;
 }
 
-NONSTD_DEF Color ppm_get_pixel(const Canvas *img, u32 x, u32 y) {
-	if (x < img->width && y < img->height) {
-		return img->pixels[y * img->width + x];
+static int pool_deque_steal(PoolDeque *deque, PoolTask *out) {
+	i64 top = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST);
+	i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST);
+	if (top >= bottom) {
+		return 0;
 	}
-	return (Color){0, 0, 0};
+	PoolDequeBuffer *buffer = __atomic_load_n(&deque->buffer, __ATOMIC_ACQUIRE);
+	PoolTask task = pool_slot_load(buffer, top);
+	if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+	*out = task;
+	return 1;
 }
 
-NONSTD_DEF int ppm_save(const Canvas *img, const char *filename) {
-	FILE *f = fopen(filename, "w");
-	if (!f) {
+static int pool_injector_pop(ThreadPool *pool, PoolTask *out) {
+	if (__atomic_load_n(&pool->injector_size, __ATOMIC_ACQUIRE) == 0) {
 		return 0;
 	}
-
-	fprintf(f, "P3\n%u %u\n255\n", img->width, img->height);
-	for (u32 y = 0; y < img->height; ++y) {
-		for (u32 x = 0; x < img->width; ++x) {
-			Color c = ppm_get_pixel(img, x, y);
-			fprintf(f, "%d %d %d ", c.r, c.g, c.b);
+	int found = 0;
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->injector_head < pool->injector.length) {
+		*out = pool->injector.data[pool->injector_head++];
+		found = 1;
+		// Compact once the consumed prefix dominates, keeping pops O(1) amortized
+		if (pool->injector_head == pool->injector.length) {
+			pool->injector.length = pool->injector_head = 0;
+		} else if (pool->injector_head * 2 >= pool->injector.length && pool->injector_head >= 64) {
+			size_t remaining = pool->injector.length - pool->injector_head;
+			memmove(pool->injector.data, pool->injector.data + pool->injector_head, remaining * sizeof(PoolTask));
+			pool->injector.length = remaining;
+			pool->injector_head = 0;
 		}
-		fprintf(f, "\n");
+		__atomic_store_n(&pool->injector_size, pool->injector.length - pool->injector_head, __ATOMIC_RELEASE);
 	}
+	pthread_mutex_unlock(&pool->mutex);
+	return found;
+}
 
-	fclose(f);
-	return 1;
+// Own deque first (newest task, still in cache), then the injector, then
+// steal the oldest task of the other workers starting at a random victim
+static int pool_find_task(ThreadPool *pool, PoolWorker *self, PoolTask *out) {
+	int found = (self && pool_deque_pop(&self->deque, out)) || pool_injector_pop(pool, out);
+	if (!found && pool->worker_count > 0) {
+		size_t start = 0;
+		if (self) {
+			self->rng ^= self->rng << 13;
+			self->rng ^= self->rng >> 7;
+			self->rng ^= self->rng << 17;
+			start = (size_t)(self->rng % pool->worker_count);
+		}
+		for (size_t i = 0; i < pool->worker_count && !found; ++i) {
+			PoolWorker *victim = &pool->workers[(start + i) % pool->worker_count];
+			found = victim != self && pool_deque_steal(&victim->deque, out);
+		}
+	}
+	if (found) {
+		__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+	}
+	return found;
 }
 
-NONSTD_DEF Canvas ppm_read(const char *filename) {
-	Canvas img = {0};
-	FILE *f = fopen(filename, "r");
-	if (!f) {
-		return img;
+static void pool_run_task(PoolTask *task) {
+	task->fn(task->arg);
+	if (task->wg) {
+		wait_group_done(task->wg);
 	}
+}
 
-	char magic[3];
-	if (fscanf(f, "%2s", magic) != 1 || strcmp(magic, "P3") != 0) {
-		fclose(f);
-		return img;
+static void *pool_worker_main(void *arg) {
+	PoolWorker *self = arg;
+	ThreadPool *pool = self->pool;
+	pool_current_worker = self;
+	for (;;) {
+		PoolTask task;
+		int found = 0;
+		for (int round = 0; round < POOL_SPIN_ROUNDS && !found; ++round) {
+			found = pool_find_task(pool, self, &task);
+			if (!found && __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0) {
+				break;
+			}
+			if (!found) {
+				sched_yield();
+			}
+		}
+		if (found) {
+			pool_run_task(&task);
+			continue;
+		}
+
+		// Sleep until a submit raises pending. Submitters raise pending before
+		// checking sleeping and workers do the reverse, so one sees the other.
+		pthread_mutex_lock(&pool->mutex);
+		__atomic_add_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+		while (!pool->stopping && __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0) {
+			pthread_cond_wait(&pool->wake, &pool->mutex);
+		}
+		__atomic_sub_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+		int done = pool->stopping && __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0;
+		pthread_mutex_unlock(&pool->mutex);
+		if (done) {
+			break;
+		}
 	}
+	pool_current_worker = NULL;
+	return NULL;
+}
 
-	u32 w, h, max_val;
-	if (fscanf(f, "%u %u %u", &w, &h, &max_val) != 3) {
-		fclose(f);
-		return img;
+NONSTD_DEF ThreadPool *pool_create(size_t thread_count) {
+	if (thread_count == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = cpus > 0 ? (size_t)cpus : 1;
+	}
+	ThreadPool *pool = ALLOC(ThreadPool, 1);
+	PoolWorker *workers = ALLOC(PoolWorker, thread_count);
+	if (!pool || !workers) {
+		FREE(pool);
+		FREE(workers);
+		return NULL;
+	}
+	*pool = (ThreadPool){0};
+	memset(workers, 0, thread_count * sizeof(PoolWorker));
+	pool->workers = workers;
+	pool->worker_count = thread_count;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	array_init(pool->injector);
+
+	for (size_t i = 0; i < thread_count; ++i) {
+		PoolWorker *worker = &workers[i];
+		worker->pool = pool;
+		worker->rng = 0x9e3779b97f4a7c15ull * (i + 1);
+		worker->deque.buffer = pool_buffer_new(POOL_DEQUE_INITIAL_CAPACITY);
+		if (!worker->deque.buffer) {
+			pool_destroy(pool);
+			return NULL;
+		}
+	}
+	for (size_t i = 0; i < thread_count; ++i) {
+		if (pthread_create(&workers[i].thread, NULL, pool_worker_main, &workers[i]) != 0) {
+			// Stop the threads already running; destroy only joins started ones
+			pool->started = i;
+			pool_destroy(pool);
+			return NULL;
+		}
 	}
+	pool->started = thread_count;
+	return pool;
+}
 
-	img = ppm_init(w, h);
-	if (!img.pixels) {
-		fclose(f);
-		return img;
+NONSTD_DEF void pool_destroy(ThreadPool *pool) {
+	if (!pool) {
+		return;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->mutex);
+	for (size_t i = 0; i < pool->started; ++i) {
+		pthread_join(pool->workers[i].thread, NULL);
 	}
 
-	for (u32 i = 0; i < w * h; ++i) {
-		int r, g, b;
-		if (fscanf(f, "%d %d %d", &r, &g, &b) != 3) {
-			ppm_free(&img);
-			fclose(f);
-			return (Canvas){0};
+	for (size_t i = 0; i < pool->worker_count; ++i) {
+		PoolDequeBuffer *buffer = pool->workers[i].deque.buffer;
+		while (buffer) {
+			PoolDequeBuffer *previous = buffer->previous;
+			FREE(buffer);
+			buffer = previous;
 		}
-		img.pixels[i] = (Color){(u8)r, (u8)g, (u8)b};
 	}
-
-	fclose(f);
-	return img;
+	array_free(pool->injector);
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->wake);
+	FREE(pool->workers);
+	FREE(pool);
 }
 
-NONSTD_DEF void ppm_fill(Canvas *canvas, Color color) {
-	for (u32 i = 0; i < canvas->width * canvas->height; ++i) {
-		canvas->pixels[i] = color;
-	}
+NONSTD_DEF size_t pool_thread_count(const ThreadPool *pool) {
+	return pool->worker_count;
 }
 
-NONSTD_DEF void ppm_draw_rect(Canvas *canvas, u32 x, u32 y, u32 w, u32 h, Color color) {
-	if (w == 0 || h == 0) {
-		return;
+NONSTD_DEF void pool_submit(ThreadPool *pool, WaitGroup *wg, TaskFn fn, void *arg) {
+	if (wg) {
+		wait_group_add(wg, 1);
 	}
-	for (u32 i = x; i < x + w; ++i) {
-		ppm_set_pixel(canvas, i, y, color);
-		ppm_set_pixel(canvas, i, y + h - 1, color);
+	PoolTask task = {fn, arg, wg};
+	PoolWorker *self = pool_current_worker;
+	int queued;
+	if (self && self->pool == pool) {
+		queued = pool_deque_push(&self->deque, task);
+	} else {
+		pthread_mutex_lock(&pool->mutex);
+		size_t length = pool->injector.length;
+		array_push(pool->injector, task);
+		queued = pool->injector.length > length;
+		__atomic_store_n(&pool->injector_size, pool->injector.length - pool->injector_head, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&pool->mutex);
 	}
-	for (u32 j = y; j < y + h; ++j) {
-		ppm_set_pixel(canvas, x, j, color);
-		ppm_set_pixel(canvas, x + w - 1, j, color);
+	if (!queued) {
+		// Out of memory: running it here keeps wg and pending consistent
+		pool_run_task(&task);
+		return;
+	}
+
+	__atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pool->sleeping, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&pool->mutex);
+		pthread_cond_signal(&pool->wake);
+		pthread_mutex_unlock(&pool->mutex);
 	}
 }
 
-NONSTD_DEF void ppm_draw_line(Canvas *canvas, i32 x0, i32 y0, i32 x1, i32 y1, Color color) {
-	i32 dx = abs(x1 - x0);
-	i32 dy = -abs(y1 - y0);
-	i32 sx = x0 < x1 ? 1 : -1;
-	i32 sy = y0 < y1 ? 1 : -1;
-	i32 err = dx + dy;
+NONSTD_DEF void pool_wait(ThreadPool *pool, WaitGroup *wg) {
+	PoolWorker *self = pool_current_worker;
+	if (self && self->pool != pool) {
+		self = NULL;
+	}
+	int idle = 0;
+	while (__atomic_load_n(&wg->count, __ATOMIC_ACQUIRE) > 0 && idle < POOL_SPIN_ROUNDS) {
+		PoolTask task;
+		if (pool_find_task(pool, self, &task)) {
+			pool_run_task(&task);
+			idle = 0;
+		} else {
+			++idle;
+			sched_yield();
+		}
+	}
+	// The remaining tasks of wg are running elsewhere, and any task they
+	// spawn is drained by the thread that spawned it
+	wait_group_wait(wg);
+}
 
-	while (1) {
-		ppm_set_pixel(canvas, (u32)x0, (u32)y0, color);
-		if (x0 == x1 && y0 == y1) {
+typedef struct {
+	size_t begin;
+	size_t end;
+	size_t grain;
+	size_t chunks;
+	size_t next;
+	ParallelForFn fn;
+	void *ctx;
+} PoolRange;
+
+// Every participant claims chunks from a shared counter until none are left
+static void pool_range_run(void *arg) {
+	PoolRange *range = arg;
+	for (;;) {
+		size_t chunk = __atomic_fetch_add(&range->next, 1, __ATOMIC_RELAXED);
+		if (chunk >= range->chunks) {
 			break;
 		}
+		size_t begin = range->begin + chunk * range->grain;
+		size_t end = range->end - begin > range->grain ? begin + range->grain : range->end;
+		range->fn(begin, end, range->ctx);
+	}
+}
 
-		i32 e2 = 2 * err;
-		if (e2 >= dy) {
-			err += dy;
-			x0 += sx;
-		}
-		if (e2 <= dx) {
-			err += dx;
-			y0 += sy;
-		}
+NONSTD_DEF void pool_parallel_for(ThreadPool *pool, size_t begin, size_t end, size_t grain, ParallelForFn fn, void *ctx) {
+	if (begin >= end) {
+		return;
+	}
+	size_t count = end - begin;
+	size_t threads = pool ? pool->worker_count + 1 : 1;
+	if (grain == 0) {
+		// A few chunks per thread leaves room to balance uneven chunks
+		grain = MAX((size_t)1, count / (threads * 8));
+	}
+	size_t chunks = count / grain + (count % grain != 0);
+	PoolRange range = {begin, end, grain, chunks, 0, fn, ctx};
+	if (!pool || chunks == 1) {
+		pool_range_run(&range);
+		return;
 	}
+
+	WaitGroup wg;
+	wait_group_init(&wg);
+	size_t helpers = MIN(pool->worker_count, chunks - 1);
+	for (size_t i = 0; i < helpers; ++i) {
+		pool_submit(pool, &wg, pool_range_run, &range);
+	}
+	pool_range_run(&range);
+	pool_wait(pool, &wg);
+	wait_group_destroy(&wg);
 }
 
-NONSTD_DEF void ppm_draw_circle(Canvas *canvas, i32 xm, i32 ym, i32 r, Color color) {
-	i32 x = -r, y = 0, err = 2 - 2 * r;
-	do {
-		ppm_set_pixel(canvas, (u32)(xm - x), (u32)(ym + y), color);
-		ppm_set_pixel(canvas, (u32)(xm - y), (u32)(ym - x), color);
-		ppm_set_pixel(canvas, (u32)(xm + x), (u32)(ym - y), color);
-		ppm_set_pixel(canvas, (u32)(xm + y), (u32)(ym + x), color);
-		r = err;
-		if (r <= y) {
-			err += ++y * 2 + 1;
-		}
-		if (r > x || err > y) {
-			err += ++x * 2 + 1;
-		}
-	} while (x < 0);
+static ThreadPool *pool_default_instance = NULL;
+static pthread_once_t pool_default_once = PTHREAD_ONCE_INIT;
+
+static void pool_default_init(void) {
+	pool_default_instance = pool_create(0);
 }
 
-NONSTD_DEF void ppm_draw_triangle(Canvas *canvas, i32 x0, i32 y0, i32 x1, i32 y1, i32 x2, i32 y2, Color color) {
-	ppm_draw_line(canvas, x0, y0, x1, y1, color);
-	ppm_draw_line(canvas, x1, y1, x2, y2, color);
-	ppm_draw_line(canvas, x2, y2, x0, y0, color);
+NONSTD_DEF ThreadPool *pool_default(void) {
+	pthread_once(&pool_default_once, pool_default_init);
+	return pool_default_instance;
+}
+
+NONSTD_DEF void parallel_for(size_t begin, size_t end, size_t grain, ParallelForFn fn, void *ctx) {
+	pool_parallel_for(pool_default(), begin, end, grain, fn, ctx);
 }
 
 #endif // NONSTD_IMPLEMENTATION
@@ -1,4 +1,5 @@
 #define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE
 #include "minunit.h"
 
 #define NONSTD_IMPLEMENTATION
@@ -151,6 +152,172 @@ MU_TEST(test_sv_ends_with_longer_suffix) {
 	mu_check(!sv_ends_with(sv, suffix));
 }
 
+MU_TEST(test_sv_find_char) {
+	stringv sv = sv_from_cstr("key=value;other=thing");
+	mu_assert_int_eq(3, sv_find_char(sv, '='));
+	mu_assert_int_eq(15, sv_rfind_char(sv, '='));
+	mu_assert_int_eq(9, sv_find_char(sv, ';'));
+	mu_check(sv_find_char(sv, '#') == SV_NPOS);
+	mu_check(sv_rfind_char(sv, '#') == SV_NPOS);
+	mu_check(sv_find_char(sv_from_cstr(""), 'a') == SV_NPOS);
+}
+
+MU_TEST(test_sv_find_char_long) {
+	// Long enough to exercise the vector loops and their scalar tails
+	char buf[1000];
+	memset(buf, 'a', sizeof(buf));
+	stringv sv = sv_from_parts(buf, sizeof(buf));
+	mu_check(sv_find_char(sv, 'b') == SV_NPOS);
+	mu_assert_int_eq(0, sv_count_char(sv, 'b'));
+	mu_assert_int_eq(1000, sv_count_char(sv, 'a'));
+
+	size_t positions[] = {0, 15, 16, 31, 32, 33, 500, 998, 999};
+	size_t pos;
+	static_foreach(size_t, pos, positions) {
+		buf[pos] = 'b';
+		mu_assert_int_eq(pos, sv_find_char(sv, 'b'));
+		mu_assert_int_eq(pos, sv_rfind_char(sv, 'b'));
+		mu_assert_int_eq(1, sv_count_char(sv, 'b'));
+		buf[pos] = 'a';
+	}
+
+	buf[17] = 'b';
+	buf[900] = 'b';
+	mu_assert_int_eq(17, sv_find_char(sv, 'b'));
+	mu_assert_int_eq(900, sv_rfind_char(sv, 'b'));
+	mu_assert_int_eq(2, sv_count_char(sv, 'b'));
+}
+
+MU_TEST(test_sv_count_char_large) {
+	// More than 255 vector blocks so the byte counters have to be folded
+	size_t len = 100000;
+	char *buf = ALLOC(char, len);
+	size_t expected = 0;
+	for (size_t i = 0; i < len; ++i) {
+		buf[i] = (i % 7 == 0) ? '\n' : 'x';
+		expected += buf[i] == '\n';
+	}
+	mu_assert_int_eq(expected, sv_count_char(sv_from_parts(buf, len), '\n'));
+	FREE(buf);
+}
+
+MU_TEST(test_sv_find_substring) {
+	stringv sv = sv_from_cstr("GET /index.html HTTP/1.1\r\nHost: example.com\r\n\r\n");
+	mu_assert_int_eq(0, sv_find(sv, sv_from_cstr("GET")));
+	mu_assert_int_eq(16, sv_find(sv, sv_from_cstr("HTTP/1.1")));
+	mu_assert_int_eq(24, sv_find(sv, sv_from_cstr("\r\n")));
+	mu_assert_int_eq(43, sv_find(sv, sv_from_cstr("\r\n\r\n")));
+	mu_assert_int_eq(0, sv_find(sv, sv_from_cstr("")));
+	mu_check(sv_find(sv, sv_from_cstr("HTTP/2")) == SV_NPOS);
+	mu_check(sv_find(sv_from_cstr("ab"), sv_from_cstr("abc")) == SV_NPOS);
+
+	mu_check(sv_contains(sv, sv_from_cstr("example.com")));
+	mu_check(!sv_contains(sv, sv_from_cstr("example.org")));
+}
+
+MU_TEST(test_sv_find_substring_long) {
+	char buf[700];
+	memset(buf, 'a', sizeof(buf));
+	stringv sv = sv_from_parts(buf, sizeof(buf));
+	stringv needle = sv_from_cstr("aab");
+	mu_check(sv_find(sv, needle) == SV_NPOS);
+
+	size_t positions[] = {2, 30, 31, 32, 64, 350, 699};
+	size_t pos;
+	static_foreach(size_t, pos, positions) {
+		buf[pos] = 'b';
+		mu_assert_int_eq(pos - 2, sv_find(sv, needle));
+		mu_assert_int_eq(pos, sv_find(sv, sv_from_cstr("b")));
+		buf[pos] = 'a';
+	}
+}
+
+MU_TEST(test_sv_find_any) {
+	stringv set = sv_from_cstr(",;= ");
+	mu_assert_int_eq(3, sv_find_any(sv_from_cstr("key=value"), set));
+	mu_assert_int_eq(1, sv_find_any(sv_from_cstr("a;b,c"), set));
+	mu_check(sv_find_any(sv_from_cstr("abcdef"), set) == SV_NPOS);
+	mu_check(sv_find_any(sv_from_cstr("abc"), sv_from_cstr("")) == SV_NPOS);
+
+	char buf[300];
+	memset(buf, 'x', sizeof(buf));
+	stringv sv = sv_from_parts(buf, sizeof(buf));
+	size_t positions[] = {0, 15, 16, 31, 32, 200, 299};
+	size_t pos;
+	static_foreach(size_t, pos, positions) {
+		buf[pos] = ';';
+		mu_assert_int_eq(pos, sv_find_any(sv, set));
+		buf[pos] = 'x';
+	}
+
+	// Bytes outside ASCII take the scalar bitmap path
+	buf[100] = (char)0xE9;
+	mu_assert_int_eq(100, sv_find_any(sv, sv_from_cstr("\xE9;")));
+}
+
+MU_TEST(test_sv_split_next) {
+	stringv rest = sv_from_cstr("a,bb,,ccc,");
+	stringv field;
+	const char *expected[] = {"a", "bb", "", "ccc", ""};
+	size_t count = 0;
+	while (sv_split_next(&rest, ',', &field)) {
+		mu_check(count < countof(expected));
+		mu_check(sv_equals(field, sv_from_cstr(expected[count])));
+		count++;
+	}
+	mu_assert_int_eq(5, count);
+	mu_check(!sv_split_next(&rest, ',', &field));
+
+	rest = sv_from_cstr("single");
+	mu_check(sv_split_next(&rest, ',', &field));
+	mu_check(sv_equals(field, sv_from_cstr("single")));
+	mu_check(!sv_split_next(&rest, ',', &field));
+}
+
+MU_TEST(test_sv_split_any_next) {
+	stringv rest = sv_from_cstr("k1=v1;k2=v2");
+	stringv field;
+	const char *expected[] = {"k1", "v1", "k2", "v2"};
+	size_t count = 0;
+	while (sv_split_any_next(&rest, sv_from_cstr("=;"), &field)) {
+		mu_check(sv_equals(field, sv_from_cstr(expected[count])));
+		count++;
+	}
+	mu_assert_int_eq(4, count);
+}
+
+MU_TEST(test_sv_split_whitespace_next) {
+	stringv rest = sv_from_cstr("  hello \t world\n  again  ");
+	stringv field;
+	const char *expected[] = {"hello", "world", "again"};
+	size_t count = 0;
+	while (sv_split_whitespace_next(&rest, &field)) {
+		mu_check(sv_equals(field, sv_from_cstr(expected[count])));
+		count++;
+	}
+	mu_assert_int_eq(3, count);
+
+	rest = sv_from_cstr("   ");
+	mu_check(!sv_split_whitespace_next(&rest, &field));
+}
+
+MU_TEST(test_sv_split_line_next) {
+	stringv rest = sv_from_cstr("first\r\nsecond\n\nlast\n");
+	stringv line;
+	const char *expected[] = {"first", "second", "", "last"};
+	size_t count = 0;
+	while (sv_split_line_next(&rest, &line)) {
+		mu_check(sv_equals(line, sv_from_cstr(expected[count])));
+		count++;
+	}
+	mu_assert_int_eq(4, count);
+
+	rest = sv_from_cstr("no newline");
+	mu_check(sv_split_line_next(&rest, &line));
+	mu_check(sv_equals(line, sv_from_cstr("no newline")));
+	mu_check(!sv_split_line_next(&rest, &line));
+}
+
 // Macro tests
 MU_TEST(test_countof) {
 	int array[10];
@@ -598,9 +765,255 @@ MU_TEST(test_array_remove) {
 	mu_assert_int_eq(30, arr.data[0]);
 	mu_assert_int_eq(1, arr.length);
 
+	array_remove(arr, 5); // Out of range is ignored
+	mu_assert_int_eq(1, arr.length);
+
+	array_free(arr);
+}
+
+MU_TEST(test_array_insert_from_self) {
+	array(int) arr;
+	array_init(arr);
+	for (int i = 0; i < 16; i++) {
+		array_push(arr, i);
+	}
+	// The array is full, so the insert reallocates after reading the value
+	array_insert(arr, 0, arr.data[15]);
+	mu_assert_int_eq(17, arr.length);
+	mu_assert_int_eq(15, arr.data[0]);
+	mu_assert_int_eq(0, arr.data[1]);
+	mu_assert_int_eq(15, arr.data[16]);
+	array_free(arr);
+}
+
+MU_TEST(test_array_push_n_extend) {
+	array(int) arr;
+	array_init(arr);
+	int values[] = {1, 2, 3, 4, 5};
+	array_push_n(arr, values, countof(values));
+	mu_assert_int_eq(5, arr.length);
+	mu_assert_int_eq(5, arr.data[4]);
+
+	array_push_n(arr, values, 0);
+	mu_assert_int_eq(5, arr.length);
+
+	array(int) other;
+	array_init(other);
+	for (int i = 0; i < 100; i++) {
+		array_push(other, 100 + i);
+	}
+	array_extend(arr, other);
+	mu_assert_int_eq(105, arr.length);
+	mu_assert_int_eq(100, arr.data[5]);
+	mu_assert_int_eq(199, arr.data[104]);
+	mu_check(arr.capacity >= 105);
+
+	// Anything with data and length works, such as a slice
+	struct {
+		int *data;
+		size_t length;
+	} view = {values + 1, 2};
+	array_extend(arr, view);
+	mu_assert_int_eq(107, arr.length);
+	mu_assert_int_eq(2, arr.data[105]);
+	mu_assert_int_eq(3, arr.data[106]);
+
+	array_free(other);
+	array_free(arr);
+}
+
+MU_TEST(test_array_insert_n) {
+	array(int) arr;
+	array_init(arr);
+	int values[] = {7, 8, 9};
+	array_insert_n(arr, 0, values, 3); // Into an empty array
+	mu_assert_int_eq(3, arr.length);
+
+	int middle[] = {100, 200};
+	array_insert_n(arr, 1, middle, 2);
+	int expected[] = {7, 100, 200, 8, 9};
+	mu_assert_int_eq(5, arr.length);
+	mu_check(memcmp(arr.data, expected, sizeof(expected)) == 0);
+
+	array_insert_n(arr, 5, values, 1); // At the end
+	mu_assert_int_eq(7, arr.data[5]);
+	array_insert_n(arr, 10, values, 3); // Past the end is ignored
+	mu_assert_int_eq(6, arr.length);
+	array_free(arr);
+}
+
+MU_TEST(test_array_remove_range_swap_remove) {
+	array(int) arr;
+	array_init(arr);
+	for (int i = 0; i < 10; i++) {
+		array_push(arr, i);
+	}
+	array_remove_range(arr, 2, 3);
+	int expected[] = {0, 1, 5, 6, 7, 8, 9};
+	mu_assert_int_eq(7, arr.length);
+	mu_check(memcmp(arr.data, expected, sizeof(expected)) == 0);
+
+	array_remove_range(arr, 5, 100); // Count is clamped to the end
+	mu_assert_int_eq(5, arr.length);
+	array_remove_range(arr, 5, 1); // Start past the end is ignored
+	mu_assert_int_eq(5, arr.length);
+
+	array_swap_remove(arr, 1); // The last element (7) fills the hole
+	mu_assert_int_eq(4, arr.length);
+	mu_assert_int_eq(7, arr.data[1]);
+	array_swap_remove(arr, 3); // Removing the last element
+	mu_assert_int_eq(3, arr.length);
+	int rest[] = {0, 7, 5};
+	mu_check(memcmp(arr.data, rest, sizeof(rest)) == 0);
+	array_swap_remove(arr, 3);
+	mu_assert_int_eq(3, arr.length);
+
 	array_free(arr);
 }
 
+MU_TEST(test_stable_array) {
+	stable_array(int) arr;
+	stable_array_init(arr, 0);
+	mu_check(arr.data != NULL);
+	mu_assert_int_eq(0, arr.capacity);
+
+	stable_array_push(arr, 42);
+	int *first = &stable_array_get(arr, 0);
+	int *base = arr.data;
+	for (int i = 1; i < 1000000; i++) {
+		stable_array_push(arr, i);
+	}
+	// Growing committed more pages in place: nothing moved
+	mu_assert_int_eq(1000000, arr.length);
+	mu_check(arr.data == base);
+	mu_check(first == &arr.data[0]);
+	mu_assert_int_eq(42, *first);
+	mu_check(arr.capacity >= arr.length);
+
+	int sum_ok = 1;
+	size_t index = 0;
+	int value;
+	stable_array_foreach(arr, value) {
+		if (index > 0 && value != (int)index) {
+			sum_ok = 0;
+		}
+		index++;
+	}
+	mu_check(sum_ok);
+	mu_assert_int_eq(999999, stable_array_pop(arr));
+
+	int batch[] = {7, 8, 9};
+	stable_array_push_n(arr, batch, countof(batch));
+	mu_assert_int_eq(1000002, arr.length);
+	mu_assert_int_eq(9, arr.data[arr.length - 1]);
+
+	// Trimming hands back the pages past the length but keeps the data
+	stable_array_clear(arr);
+	stable_array_push(arr, 5);
+	stable_array_trim(arr);
+	mu_check(arr.capacity < 1000000);
+	mu_check(arr.capacity >= 1);
+	mu_assert_int_eq(5, arr.data[0]);
+	stable_array_push(arr, 6);
+	mu_assert_int_eq(6, arr.data[1]);
+
+	stable_array_free(arr);
+	mu_check(arr.data == NULL);
+	mu_assert_int_eq(0, arr.length);
+}
+
+MU_TEST(test_stable_array_limit) {
+	stable_array(u64) arr;
+	stable_array_init(arr, 10);
+	mu_assert_int_eq(10, arr.reserved);
+
+	for (u64 i = 0; i < 20; i++) {
+		stable_array_push(arr, i);
+	}
+	// Pushes past the reservation are dropped
+	mu_assert_int_eq(10, arr.length);
+	mu_assert_int_eq(10, arr.capacity);
+	mu_check(arr.data[9] == 9);
+
+	u64 batch[4] = {0};
+	stable_array_pop(arr);
+	stable_array_push_n(arr, batch, countof(batch));
+	mu_assert_int_eq(9, arr.length);
+
+	stable_array_free(arr);
+}
+
+MU_TEST(test_small_array) {
+	small_array(int, 4) arr;
+	small_array_init(arr);
+	mu_assert_int_eq(4, arr.capacity);
+
+	for (int i = 0; i < 4; i++) {
+		small_array_push(arr, i * 10);
+	}
+	// Up to N elements nothing is allocated
+	mu_check(small_array_is_inline(arr));
+	mu_assert_int_eq(30, small_array_get(arr, 3));
+
+	// Pushing an element of the array itself while spilling
+	small_array_push(arr, small_array_get(arr, 1));
+	mu_check(!small_array_is_inline(arr));
+	mu_assert_int_eq(5, arr.length);
+	mu_assert_int_eq(8, arr.capacity);
+	int expected[] = {0, 10, 20, 30, 10};
+	mu_check(memcmp(small_array_data(arr), expected, sizeof(expected)) == 0);
+
+	small_array_set(arr, 0, 99);
+	small_array_set(arr, 5, 1); // Out of range is ignored
+	mu_assert_int_eq(99, small_array_get(arr, 0));
+	mu_assert_int_eq(10, small_array_pop(arr));
+	mu_assert_int_eq(4, arr.length);
+
+	int sum = 0;
+	int value;
+	small_array_foreach(arr, value) {
+		sum += value;
+	}
+	mu_assert_int_eq(99 + 10 + 20 + 30, sum);
+
+	SLICE_DEF(int);
+	slice(int) view = small_array_as_slice(int, arr);
+	mu_assert_int_eq(4, view.length);
+	mu_assert_int_eq(20, view.data[2]);
+
+	for (int i = 0; i < 100; i++) {
+		small_array_push(arr, i);
+	}
+	mu_assert_int_eq(104, arr.length);
+	mu_assert_int_eq(99, small_array_get(arr, 103));
+
+	small_array_free(arr);
+	mu_check(small_array_is_inline(arr));
+	mu_assert_int_eq(0, arr.length);
+	mu_assert_int_eq(0, small_array_pop(arr));
+	small_array_push(arr, 7); // Reusable after free, inline again
+	mu_check(small_array_is_inline(arr));
+	mu_assert_int_eq(7, small_array_get(arr, 0));
+	small_array_free(arr);
+}
+
+MU_TEST(test_small_array_copy) {
+	typedef small_array(u8, 8) Bytes;
+	Bytes a;
+	small_array_init(a);
+	small_array_push(a, 1);
+	small_array_push(a, 2);
+	// Inline storage is copied with the struct
+	Bytes b = a;
+	small_array_set(b, 0, 5);
+	mu_assert_int_eq(1, small_array_get(a, 0));
+	mu_assert_int_eq(5, small_array_get(b, 0));
+	small_array_clear(b);
+	mu_assert_int_eq(0, b.length);
+	mu_assert_int_eq(2, a.length);
+	small_array_free(a);
+}
+
 MU_TEST(test_array_growth) {
 	array(int) arr;
 	array_init_cap(arr, 4);
@@ -685,6 +1098,216 @@ MU_TEST(test_array_foreach_idx) {
 	array_free(arr);
 }
 
+// Hash tests
+MU_TEST(test_hash_bytes_basic) {
+	const char *text = "hello world";
+	u64 h1 = hash_bytes(text, strlen(text), 0);
+	mu_check(h1 == hash_bytes(text, strlen(text), 0));
+	mu_check(h1 != hash_bytes(text, strlen(text), 1));
+	mu_check(h1 != hash_bytes(text, strlen(text) - 1, 0));
+	mu_check(h1 == sv_hash64(sv_from_cstr(text), 0));
+	mu_check(hash_bytes("", 0, 0) != hash_bytes("", 0, 1));
+
+	// Every length up to a few blocks hashes differently from its neighbours
+	u8 data[256];
+	for (size_t i = 0; i < sizeof(data); ++i) {
+		data[i] = (u8)(i * 31 + 7);
+	}
+	for (size_t len = 1; len < sizeof(data); ++len) {
+		mu_check(hash_bytes(data, len, 0) != hash_bytes(data, len - 1, 0));
+	}
+}
+
+MU_TEST(test_hash_bytes_avalanche) {
+	// Flipping any single input bit should flip roughly half of the output bits
+	u8 key[32] = {0};
+	u64 base = hash_bytes(key, sizeof(key), 0);
+	int total = 0;
+	for (size_t bit = 0; bit < sizeof(key) * 8; ++bit) {
+		key[bit / 8] ^= (u8)(1u << (bit % 8));
+		total += __builtin_popcountll(base ^ hash_bytes(key, sizeof(key), 0));
+		key[bit / 8] ^= (u8)(1u << (bit % 8));
+	}
+	double average = (double)total / (sizeof(key) * 8);
+	mu_check(average > 28.0 && average < 36.0);
+}
+
+MU_TEST(test_hash_streaming) {
+	u8 data[400];
+	for (size_t i = 0; i < sizeof(data); ++i) {
+		data[i] = (u8)(i * 131 + (i >> 3));
+	}
+
+	size_t chunk_sizes[] = {1, 3, 16, 47, 48, 49, 100};
+	for (size_t len = 0; len <= sizeof(data); len += (len < 100 ? 1 : 37)) {
+		u64 expected = hash_bytes(data, len, 42);
+		size_t chunk;
+		static_foreach(size_t, chunk, chunk_sizes) {
+			HashState state;
+			hash_init(&state, 42);
+			for (size_t off = 0; off < len; off += chunk) {
+				hash_update(&state, data + off, MIN(chunk, len - off));
+			}
+			mu_check(hash_final(&state) == expected);
+		}
+	}
+}
+
+// Hash map tests
+MU_TEST(test_hashmap_put_get) {
+	hashmap(int, int) map;
+	hashmap_init(map);
+	mu_assert_int_eq(0, hashmap_length(map));
+	mu_check(hashmap_get(map, 1) == NULL);
+
+	hashmap_put(map, 1, 10);
+	hashmap_put(map, 2, 20);
+	hashmap_put(map, 3, 30);
+	mu_assert_int_eq(3, hashmap_length(map));
+	mu_assert_int_eq(10, *hashmap_get(map, 1));
+	mu_assert_int_eq(20, *hashmap_get(map, 2));
+	mu_assert_int_eq(30, *hashmap_get(map, 3));
+	mu_check(!hashmap_contains(map, 4));
+
+	// Overwrite keeps the length
+	hashmap_put(map, 2, 200);
+	mu_assert_int_eq(3, hashmap_length(map));
+	mu_assert_int_eq(200, *hashmap_get(map, 2));
+
+	// Values can be updated in place through the returned pointer
+	*hashmap_get(map, 3) += 5;
+	mu_assert_int_eq(35, *hashmap_get(map, 3));
+
+	// Lookups do not write to the map, so they work through a const view
+	const __typeof__(map) *view = &map;
+	mu_assert_int_eq(10, *hashmap_get(*view, 1));
+	mu_check(!hashmap_contains(*view, 4));
+
+	hashmap_free(map);
+	mu_assert_int_eq(0, hashmap_length(map));
+}
+
+MU_TEST(test_hashmap_remove) {
+	hashmap(u64, u64) map;
+	hashmap_init(map);
+	for (u64 i = 0; i < 100; ++i) {
+		hashmap_put(map, i, i * i);
+	}
+	mu_assert_int_eq(100, hashmap_length(map));
+
+	for (u64 i = 0; i < 100; i += 2) {
+		mu_check(hashmap_remove(map, i));
+	}
+	mu_check(!hashmap_remove(map, 0));
+	mu_assert_int_eq(50, hashmap_length(map));
+
+	for (u64 i = 0; i < 100; ++i) {
+		u64 *v = hashmap_get(map, i);
+		if (i % 2 == 0) {
+			mu_check(v == NULL);
+		} else {
+			mu_check(v != NULL && *v == i * i);
+		}
+	}
+
+	hashmap_free(map);
+}
+
+MU_TEST(test_hashmap_growth_and_churn) {
+	hashmap(u32, u32) map;
+	hashmap_init(map);
+	for (u32 i = 0; i < 10000; ++i) {
+		hashmap_put(map, i * 7919u, i);
+	}
+	mu_assert_int_eq(10000, hashmap_length(map));
+	mu_check(map.base.capacity >= 10000);
+	for (u32 i = 0; i < 10000; ++i) {
+		u32 *v = hashmap_get(map, i * 7919u);
+		mu_check(v != NULL);
+		mu_assert_int_eq(i, *v);
+	}
+
+	// Insert/remove churn must not leak capacity through tombstones
+	size_t capacity = map.base.capacity;
+	for (u32 round = 0; round < 50; ++round) {
+		for (u32 i = 0; i < 1000; ++i) {
+			hashmap_put(map, 100000000u + round * 1000u + i, i);
+		}
+		for (u32 i = 0; i < 1000; ++i) {
+			hashmap_remove(map, 100000000u + round * 1000u + i);
+		}
+	}
+	mu_assert_int_eq(10000, hashmap_length(map));
+	mu_check(map.base.capacity <= capacity * 2);
+
+	hashmap_free(map);
+}
+
+MU_TEST(test_hashmap_sv_keys) {
+	hashmap(stringv, int) counts;
+	hashmap_init_sv(counts);
+
+	stringv rest = sv_from_cstr("the quick fox jumps over the lazy dog the end");
+	stringv word;
+	while (sv_split_next(&rest, ' ', &word)) {
+		int *count = hashmap_get(counts, word);
+		if (count) {
+			(*count)++;
+		} else {
+			hashmap_put(counts, word, 1);
+		}
+	}
+
+	mu_assert_int_eq(8, hashmap_length(counts));
+	mu_assert_int_eq(3, *hashmap_get(counts, sv_from_cstr("the")));
+	mu_assert_int_eq(1, *hashmap_get(counts, sv_from_cstr("fox")));
+	mu_check(hashmap_get(counts, sv_from_cstr("cat")) == NULL);
+
+	// Keys compare by content, not by pointer
+	char buf[] = "lazy";
+	mu_assert_int_eq(1, *hashmap_get(counts, sv_from_parts(buf, 4)));
+
+	hashmap_free(counts);
+}
+
+MU_TEST(test_hashmap_foreach_reserve) {
+	hashmap(int, double) map;
+	hashmap_init(map);
+	hashmap_reserve(map, 1000);
+	size_t capacity = map.base.capacity;
+	mu_check(capacity >= 1000);
+
+	for (int i = 1; i <= 1000; ++i) {
+		hashmap_put(map, i, (double)i);
+	}
+	mu_assert_int_eq(capacity, map.base.capacity);
+
+	int key;
+	double value;
+	long key_sum = 0;
+	double value_sum = 0;
+	size_t seen = 0;
+	hashmap_foreach(map, key, value) {
+		key_sum += key;
+		value_sum += value;
+		seen++;
+	}
+	mu_assert_int_eq(1000, seen);
+	mu_assert_int_eq(500500, key_sum);
+	mu_assert_double_eq(500500.0, value_sum);
+
+	hashmap_clear(map);
+	mu_assert_int_eq(0, hashmap_length(map));
+	mu_check(hashmap_get(map, 5) == NULL);
+	seen = 0;
+	hashmap_foreach(map, key, value) {
+		seen++;
+	}
+	mu_assert_int_eq(0, seen);
+
+	hashmap_free(map);
+}
+
 // Slice Tests
 SLICE_DEF(int);
 
@@ -757,13 +1380,13 @@ MU_TEST(test_arena_growth) {
 	// Let's alloc a big chunk first.
 	void *big = arena_alloc(&a, 5000);
 	mu_check(big != NULL);
-	mu_check(a.blocks.length >= 1);
+	mu_check(a.blocks.length + a.large.length >= 1);
 
 	// Alloc another big chunk
 	void *big2 = arena_alloc(&a, 5000);
 	mu_check(big2 != NULL);
 	mu_check(big2 != big);
-	mu_check(a.blocks.length >= 2);
+	mu_check(a.blocks.length + a.large.length >= 2);
 
 	arena_free(&a);
 }
@@ -805,6 +1428,199 @@ MU_TEST(test_arena_safety) {
 	arena_free(&a);
 }
 
+MU_TEST(test_arena_reset_reuses_blocks) {
+	Arena a = arena_make();
+	arena_reset(&a); // No-op on an empty arena
+
+	void *first = arena_alloc(&a, 64);
+	for (int i = 0; i < 100; ++i) {
+		mu_check(arena_alloc(&a, 100) != NULL);
+	}
+	size_t blocks = a.blocks.length;
+	mu_check(blocks >= 2);
+
+	// Same allocation pattern after a reset lands in the same blocks
+	for (int round = 0; round < 5; ++round) {
+		arena_reset(&a);
+		mu_check(arena_alloc(&a, 64) == first);
+		for (int i = 0; i < 100; ++i) {
+			mu_check(arena_alloc(&a, 100) != NULL);
+		}
+		mu_assert_int_eq(blocks, a.blocks.length);
+	}
+
+	arena_free(&a);
+}
+
+MU_TEST(test_arena_mark_rewind) {
+	Arena a = arena_make();
+	ArenaMark empty = arena_mark(&a);
+
+	int *keep = arena_alloc(&a, sizeof(int));
+	*keep = 7;
+
+	ArenaMark mark = arena_mark(&a);
+	void *scratch = arena_alloc(&a, 32);
+	for (int i = 0; i < 50; ++i) {
+		arena_alloc(&a, 200); // Spill into further blocks
+	}
+	size_t blocks = a.blocks.length;
+
+	arena_rewind(&a, mark);
+	mu_check(arena_alloc(&a, 32) == scratch);
+	mu_assert_int_eq(7, *keep);
+
+	// Spilling again reuses the blocks kept by the rewind
+	for (int i = 0; i < 50; ++i) {
+		arena_alloc(&a, 200);
+	}
+	mu_assert_int_eq(blocks, a.blocks.length);
+
+	arena_rewind(&a, empty);
+	mu_check(arena_alloc(&a, sizeof(int)) == (void *)keep);
+
+	arena_free(&a);
+}
+
+MU_TEST(test_arena_geometric_growth) {
+	Arena a = arena_make_sized(1024);
+	a.max_block_size = 8192;
+
+	for (int i = 0; i < 200; ++i) {
+		mu_check(arena_alloc(&a, 200) != NULL);
+	}
+
+	// 1K, 2K, 4K, 8K, then capped at 8K
+	mu_check(a.blocks.length >= 5);
+	mu_assert_int_eq(1024, a.blocks.data[0].size);
+	mu_assert_int_eq(2048, a.blocks.data[1].size);
+	mu_assert_int_eq(4096, a.blocks.data[2].size);
+	mu_assert_int_eq(8192, a.blocks.data[3].size);
+	mu_assert_int_eq(8192, a.blocks.data[4].size);
+	mu_assert_int_eq(0, a.large.length);
+
+	arena_free(&a);
+}
+
+MU_TEST(test_arena_large_allocations) {
+	Arena a = arena_make();
+	char *small = arena_alloc(&a, 16);
+	char *ptr = a.ptr;
+
+	// An oversized request does not retire the current bump block
+	void *big = arena_alloc(&a, 100000);
+	mu_check(big != NULL);
+	memset(big, 0xAB, 100000);
+	mu_assert_int_eq(1, a.blocks.length);
+	mu_assert_int_eq(1, a.large.length);
+	mu_check(a.ptr == ptr);
+	mu_check(arena_alloc(&a, 16) == small + 16);
+
+	// Rewinding releases dedicated blocks made after the mark
+	ArenaMark mark = arena_mark(&a);
+	arena_alloc(&a, 50000);
+	arena_alloc(&a, 60000);
+	mu_assert_int_eq(3, a.large.length);
+	arena_rewind(&a, mark);
+	mu_assert_int_eq(1, a.large.length);
+
+	// An explicit threshold keeps mid-sized requests in bump blocks
+	a.large_threshold = 200000;
+	arena_alloc(&a, 100000);
+	mu_assert_int_eq(1, a.large.length);
+	mu_assert_int_eq(2, a.blocks.length);
+
+	arena_reset(&a);
+	mu_assert_int_eq(0, a.large.length);
+	arena_free(&a);
+}
+
+MU_TEST(test_arena_rewind_keeps_early_large) {
+	Arena a = arena_make();
+
+	// A large block made before the first bump allocation predates the mark
+	char *p = arena_alloc(&a, 2000);
+	mu_check(p != NULL);
+	p[0] = 'x';
+	mu_check(a.ptr == NULL);
+	ArenaMark mark = arena_mark(&a);
+	arena_alloc(&a, 16);
+	arena_rewind(&a, mark);
+
+	mu_assert_int_eq(1, a.large.length);
+	mu_check(p[0] == 'x');
+	mu_check(arena_alloc(&a, 16) == a.blocks.data[0].data);
+	arena_free(&a);
+}
+
+MU_TEST(test_arena_scratch_scope) {
+	Arena a = arena_make();
+	void *before = arena_alloc(&a, 16);
+	void *inside = NULL;
+
+	arena_scratch(&a) {
+		inside = arena_alloc(&a, 1024);
+		mu_check(inside != NULL);
+		arena_scratch(&a) {
+			arena_alloc(&a, 8000);
+		}
+	}
+
+	mu_check(arena_alloc(&a, 1024) == inside);
+	mu_check(before != inside);
+	arena_free(&a);
+}
+
+MU_TEST(test_arena_virtual) {
+	Arena a = arena_make_virtual(16 << 20, 0);
+	mu_check(a.vm_base != NULL);
+
+	// Allocations are contiguous and nothing goes to the block lists
+	char *first = arena_alloc(&a, 16);
+	char *second = arena_alloc(&a, 16);
+	mu_check(first == a.vm_base);
+	mu_check(second == first + 16);
+	char *big = arena_alloc(&a, 1 << 20);
+	mu_check(big == second + 16);
+	memset(big, 0xCD, 1 << 20);
+	mu_assert_int_eq(0, a.blocks.length);
+	mu_assert_int_eq(0, a.large.length);
+
+	// Only what was used is committed
+	mu_check((size_t)(a.end - a.vm_base) < (2u << 20));
+
+	ArenaMark mark = arena_mark(&a);
+	arena_alloc(&a, 4096);
+	arena_rewind(&a, mark);
+	mu_check(arena_alloc(&a, 8) == big + (1 << 20));
+
+	// Requests past the reservation fail instead of moving
+	mu_check(arena_alloc(&a, 32 << 20) == NULL);
+
+	// Reset decommits, so memory comes back zeroed
+	arena_reset(&a);
+	mu_check(a.ptr == a.vm_base);
+	char *again = arena_alloc(&a, 64);
+	mu_check(again == a.vm_base);
+	mu_assert_int_eq(0, again[0]);
+	mu_assert_int_eq(0, again[63]);
+
+	arena_free(&a);
+	mu_check(a.vm_base == NULL);
+}
+
+MU_TEST(test_arena_virtual_hugepages) {
+	Arena a = arena_make_virtual(0, ARENA_VM_HUGEPAGES);
+	mu_check(a.vm_base != NULL);
+	mu_check(a.vm_reserved >= ((size_t)256 << 20));
+	mu_assert_int_eq(ARENA_VM_HUGEPAGE_SIZE, a.block_size);
+	for (int i = 0; i < 1000; ++i) {
+		mu_check(arena_alloc(&a, 1000) != NULL);
+	}
+	mu_assert_int_eq(ARENA_VM_HUGEPAGE_SIZE, a.end - a.vm_base);
+	arena_free(&a);
+}
+
 // File I/O tests
 MU_TEST(test_file_io_basic) {
 	const char *filename = "test_io_basic.txt";
@@ -857,6 +1673,41 @@ MU_TEST(test_file_io_read_missing_sb) {
 	mu_assert_int_eq(0, sb.length);
 }
 
+MU_TEST(test_file_map_basic) {
+	const char *filename = "test_io_map.txt";
+	const char *content = "mapped line one\nmapped line two\n";
+	size_t len = strlen(content);
+	mu_check(write_entire_file(filename, content, len));
+
+	MappedFile mf = map_entire_file(filename, FILE_MAP_SEQUENTIAL | FILE_MAP_WILLNEED | FILE_MAP_HUGEPAGE);
+	mu_check(mf.data != NULL);
+	mu_assert_int_eq(len, mf.length);
+
+	stringv sv = mf_as_sv(&mf);
+	mu_check(sv_equals(sv, sv_from_cstr(content)));
+	mu_check(sv_starts_with(sv, sv_from_cstr("mapped")));
+
+	unmap_file(&mf);
+	mu_check(mf.data == NULL);
+	mu_assert_int_eq(0, mf.length);
+	remove(filename);
+}
+
+MU_TEST(test_file_map_empty_and_missing) {
+	const char *filename = "test_io_map_empty.txt";
+	mu_check(write_entire_file(filename, "", 0));
+
+	MappedFile mf = map_entire_file(filename, 0);
+	mu_check(mf.data != NULL);
+	mu_assert_int_eq(0, mf.length);
+	unmap_file(&mf);
+	remove(filename);
+
+	mf = map_entire_file("non_existent_file.txt", 0);
+	mu_check(mf.data == NULL);
+	mu_assert_int_eq(0, mf.length);
+}
+
 // Logging tests
 MU_TEST(test_logging_level_filtering) {
 	FILE *tmp = tmpfile();
@@ -915,6 +1766,1349 @@ MU_TEST(test_logging_format) {
 	fclose(tmp);
 }
 
+MU_TEST(test_logging_cached_timestamp) {
+	// Walk across several minute boundaries, patched seconds must match strftime
+	time_t start = 1700000000;
+	for (time_t t = start; t < start + 200; t += 7) {
+		struct tm tm_info;
+		char expected[24];
+		localtime_r(&t, &tm_info);
+		strftime(expected, sizeof(expected), "%Y-%m-%d %H:%M:%S", &tm_info);
+		mu_assert_string_eq(expected, log_time_string(t));
+		mu_assert_string_eq(expected, log_time_string(t));
+	}
+}
+
+MU_TEST(test_logging_tty_cache_follows_stream) {
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	int fd = fileno(tmp);
+	mu_check(fd < LOG_TTY_CACHE_SIZE);
+
+	// A terminal stream that used the same descriptor before must not leak
+	// its cached result into the new stream
+	log_tty_cache[fd] = (uintptr_t)stdout | 1;
+	mu_check(!log_stream_is_tty(tmp));
+	mu_check((log_tty_cache[fd] & ~(uintptr_t)1) == (uintptr_t)tmp);
+
+	log_message(tmp, LOG_ERROR, "plain");
+	rewind(tmp);
+	char buffer[256];
+	size_t read = fread(buffer, 1, sizeof(buffer) - 1, tmp);
+	buffer[read] = '\0';
+	mu_check(strstr(buffer, "plain") != NULL);
+	mu_check(strchr(buffer, '\x1b') == NULL);
+	fclose(tmp);
+}
+
+MU_TEST(test_logging_single_line_layout) {
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	log_register_stream(tmp);
+	set_log_level(LOG_DEBUG);
+
+	char long_message[3000];
+	memset(long_message, 'y', sizeof(long_message) - 1);
+	long_message[sizeof(long_message) - 1] = '\0';
+	log_message(tmp, LOG_WARN, "short %d", 7);
+	log_message(tmp, LOG_DEBUG, "%s", long_message);
+	set_log_level(LOG_INFO);
+
+	rewind(tmp);
+	char buffer[4096];
+	size_t read = fread(buffer, 1, sizeof(buffer) - 1, tmp);
+	buffer[read] = '\0';
+
+	// Not a terminal, so no color codes
+	mu_check(strchr(buffer, '\033') == NULL);
+	mu_check(strncmp(buffer + 24, "] [WARN ] short 7\n", 18) == 0);
+	mu_assert_int_eq('-', buffer[5]);
+	mu_assert_int_eq('.', buffer[20]);
+
+	// Lines longer than the stack buffer are written in full
+	stringv rest = sv_from_parts(buffer, read), line;
+	mu_check(sv_split_line_next(&rest, &line));
+	mu_check(sv_split_line_next(&rest, &line));
+	mu_check(sv_contains(line, sv_from_cstr("[DEBUG] yyyy")));
+	mu_assert_int_eq(34 + sizeof(long_message) - 1, line.length);
+
+	fclose(tmp);
+}
+
+static char *read_stream(FILE *stream, size_t *size) {
+	fseek(stream, 0, SEEK_END);
+	long length = ftell(stream);
+	rewind(stream);
+	char *buffer = malloc((size_t)length + 1);
+	*size = fread(buffer, 1, (size_t)length, stream);
+	buffer[*size] = '\0';
+	return buffer;
+}
+
+static int log_site_evaluations = 0;
+
+static int log_site_count_evaluation(void) {
+	return ++log_site_evaluations;
+}
+
+static void log_site_debug_line(FILE *stream) {
+	LOG_AT(stream, LOG_DEBUG, "site debug %d", log_site_count_evaluation());
+}
+
+static size_t log_stream_size(FILE *stream) {
+	fflush(stream);
+	fseek(stream, 0, SEEK_END);
+	return (size_t)ftell(stream);
+}
+
+MU_TEST(test_logging_call_sites) {
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	set_log_level(LOG_INFO);
+
+	// Disabled by level: arguments are not evaluated
+	log_site_debug_line(tmp);
+	mu_assert_int_eq(0, log_site_evaluations);
+	mu_assert_int_eq(0, log_stream_size(tmp));
+
+	// A rule on file:line enables the site above the runtime level
+	mu_assert_int_eq(1, log_enable_sites("*tests.c:*", 1));
+	log_site_debug_line(tmp);
+	mu_assert_int_eq(1, log_site_evaluations);
+	size_t size = log_stream_size(tmp);
+	mu_check(size > 0);
+
+	// The last matching rule wins
+	log_enable_sites("*tests.c:*", 0);
+	log_site_debug_line(tmp);
+	mu_assert_int_eq(size, log_stream_size(tmp));
+	mu_assert_int_eq(0, log_enable_sites("*other.c:*", 1));
+
+	// Without rules the level decides again, set_log_level refreshes sites
+	log_reset_site_rules();
+	log_site_debug_line(tmp);
+	mu_assert_int_eq(size, log_stream_size(tmp));
+	set_log_level(LOG_DEBUG);
+	log_site_debug_line(tmp);
+	mu_assert_int_eq(2, log_site_evaluations);
+	set_log_level(LOG_INFO);
+
+	size_t read;
+	char *contents = read_stream(tmp, &read);
+	mu_check(strstr(contents, "[DEBUG] site debug 1") != NULL);
+	mu_check(strstr(contents, "[DEBUG] site debug 2") != NULL);
+	free(contents);
+	fclose(tmp);
+
+	// Compiled-out levels never evaluate their arguments either
+	LOG_COMPILED_OUT("%d", log_site_count_evaluation());
+	mu_assert_int_eq(2, log_site_evaluations);
+}
+
+MU_TEST(test_logging_structured_json) {
+	stringb sb;
+	sb_init(&sb, 0);
+	LogKv fields[] = {
+		KV_INT("status", 200),
+		KV_INT("neg", -5),
+		KV_UINT("big", UINT64_MAX),
+		KV_FLOAT("ratio", 0.5),
+		KV_BOOL("ok", 1),
+		KV_CSTR("path", "a \"b\"\n\\c\001"),
+	};
+	log_kv_render(&sb, LOG_FORMAT_JSON, LOG_INFO, "hi", fields, countof(fields));
+
+	mu_check(strncmp(sb.data, "{\"time\":\"", 9) == 0);
+	mu_assert_int_eq('"', sb.data[32]);
+	mu_assert_string_eq(",\"level\":\"INFO\",\"msg\":\"hi\",\"status\":200,\"neg\":-5,"
+	                    "\"big\":18446744073709551615,\"ratio\":0.5,\"ok\":true,"
+	                    "\"path\":\"a \\\"b\\\"\\n\\\\c\\u0001\"}\n",
+	                    sb.data + 33);
+
+	// Long strings take the word-at-a-time path around the special byte
+	char long_value[101];
+	memset(long_value, 'v', 100);
+	long_value[100] = '\0';
+	long_value[50] = '"';
+	LogKv long_field = KV_CSTR("long", long_value);
+	sb.length = 0;
+	log_kv_render(&sb, LOG_FORMAT_JSON, LOG_WARN, "x", &long_field, 1);
+	mu_check(strstr(sb.data, "\"long\":\"vvvv") != NULL);
+	mu_check(strstr(sb.data, "v\\\"v") != NULL);
+	mu_check(sv_ends_with(sb_as_sv(&sb), sv_from_cstr("vvvv\"}\n")));
+	mu_assert_int_eq(33 + 15 + 10 + 9 + 101 + 3, sb.length);
+
+	sb_free(&sb);
+}
+
+MU_TEST(test_logging_structured_logfmt) {
+	stringb sb;
+	sb_init(&sb, 0);
+	LogKv fields[] = {
+		KV_INT("status", 404),
+		KV_STR("path", sv_from_cstr("/index")),
+		KV_BOOL("ok", 0),
+		KV_CSTR("empty", ""),
+		KV_CSTR("eq", "a=b"),
+		KV_FLOAT("nan", 0.0 / 0.0),
+	};
+	log_kv_render(&sb, LOG_FORMAT_LOGFMT, LOG_ERROR, "request done", fields, countof(fields));
+	mu_check(strncmp(sb.data, "time=\"", 6) == 0);
+	mu_assert_string_eq(" level=ERROR msg=\"request done\" status=404 path=/index ok=false empty=\"\" eq=\"a=b\" nan=NaN\n",
+	                    sb.data + 30);
+
+	// Keys cannot be quoted in logfmt, bytes that would break splitting become '_'
+	LogKv bad_keys[] = {KV_INT("user id", 1), KV_INT("a=b", 2), KV_INT("\"q\"\n", 3), KV_INT("", 4)};
+	sb.length = 0;
+	log_kv_render(&sb, LOG_FORMAT_LOGFMT, LOG_INFO, "keys", bad_keys, countof(bad_keys));
+	mu_check(strstr(sb.data, " msg=keys user_id=1 a_b=2 _q__=3 _=4\n") != NULL);
+	sb_free(&sb);
+
+	// Through the macro, with the runtime level and site flag applied
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	set_log_level(LOG_INFO);
+	log_set_format(LOG_FORMAT_JSON);
+	for (int i = 0; i < 3; ++i) {
+		LOG_KV(tmp, LOG_INFO, "tick", KV_INT("i", i));
+		LOG_KV(tmp, LOG_DEBUG, "hidden", KV_INT("i", i));
+	}
+	log_kv(tmp, LOG_WARN, "direct", NULL, 0);
+
+	size_t size;
+	char *contents = read_stream(tmp, &size);
+	mu_assert_int_eq(4, sv_count_char(sv_from_parts(contents, size), '\n'));
+	mu_check(strstr(contents, "\"msg\":\"tick\",\"i\":2}\n") != NULL);
+	mu_check(strstr(contents, "\"level\":\"WARN\",\"msg\":\"direct\"}\n") != NULL);
+	mu_check(strstr(contents, "hidden") == NULL);
+	free(contents);
+	fclose(tmp);
+}
+
+MU_TEST(test_logging_rate_limit_gcra) {
+	LogLimiter limiter = {0};
+	u64 second = 1000000000ull;
+	u64 now = 5 * second;
+
+	// A full second's worth of burst, then nothing until time passes
+	int allowed = 0;
+	for (int i = 0; i < 20; ++i) {
+		allowed += log_limit_allow_at(&limiter, 10, now);
+	}
+	mu_assert_int_eq(10, allowed);
+	mu_assert_int_eq(10, limiter.suppressed);
+
+	// One emission interval later exactly one more message fits
+	mu_check(log_limit_allow_at(&limiter, 10, now + second / 10));
+	mu_check(!log_limit_allow_at(&limiter, 10, now + second / 10));
+
+	// At a steady 10/s everything passes
+	now += 2 * second;
+	for (int i = 0; i < 30; ++i) {
+		mu_check(log_limit_allow_at(&limiter, 10, now + (u64)i * (second / 10)));
+	}
+	mu_check(!log_limit_allow_at(&limiter, 0, now));
+}
+
+static void log_storm(FILE *stream, int count) {
+	for (int i = 0; i < count; ++i) {
+		LOG_RATE_LIMITED(stream, LOG_WARN, 5, "flood %d", i);
+	}
+}
+
+MU_TEST(test_logging_rate_limit_storm_summary) {
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	set_log_level(LOG_INFO);
+
+	// Nothing is logged at the site after the storm, the flush reports it
+	log_storm(tmp, 1000);
+	log_limit_flush();
+	log_limit_flush(); // Nothing left to report
+
+	size_t size;
+	char *contents = read_stream(tmp, &size);
+	stringv rest = sv_from_parts(contents, size), line;
+	int floods = 0, summaries = 0;
+	while (sv_split_line_next(&rest, &line)) {
+		floods += sv_contains(line, sv_from_cstr("] flood "));
+		summaries += sv_contains(line, sv_from_cstr("] suppressed "));
+	}
+	mu_assert_int_eq(5, floods);
+	mu_assert_int_eq(1, summaries);
+	mu_check(strstr(contents, "suppressed 995 messages from ") != NULL);
+	free(contents);
+	fclose(tmp);
+}
+
+MU_TEST(test_logging_rate_limited_macro) {
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	set_log_level(LOG_INFO);
+
+	for (int round = 0; round < 2; ++round) {
+		for (int i = 0; i < 10000; ++i) {
+			LOG_RATE_LIMITED(tmp, LOG_WARN, 5, "storm %d", i);
+		}
+		if (round == 0) {
+			// Enough time for one more token at 5 per second
+			struct timespec pause = {0, 250 * 1000 * 1000};
+			nanosleep(&pause, NULL);
+		}
+	}
+	for (int i = 0; i < 100; ++i) {
+		LOG_SAMPLED(tmp, LOG_INFO, 10, "sample %d", i);
+	}
+	// The second storm ended without another message getting through
+	log_limit_flush();
+
+	size_t size;
+	char *contents = read_stream(tmp, &size);
+	stringv all = sv_from_parts(contents, size);
+	size_t storm = 0, samples = 0, summaries = 0;
+	stringv rest = all, line;
+	while (sv_split_line_next(&rest, &line)) {
+		storm += sv_contains(line, sv_from_cstr("] storm "));
+		samples += sv_contains(line, sv_from_cstr("] sample "));
+		summaries += sv_contains(line, sv_from_cstr("] suppressed "));
+	}
+	// The burst of 5, at least one after the pause, a summary before it and
+	// one for the end of the second storm
+	mu_check(storm >= 6 && storm <= 8);
+	mu_check(summaries >= 2);
+	mu_check(strstr(contents, "sample 0\n") != NULL);
+	mu_check(strstr(contents, "sample 90\n") != NULL);
+	mu_assert_int_eq(10, samples);
+	free(contents);
+	fclose(tmp);
+}
+
+#define ASYNC_LOG_THREADS 4
+#define ASYNC_LOG_PER_THREAD 2000
+
+static void *async_log_producer(void *arg) {
+	FILE *stream = ((void **)arg)[0];
+	int id = (int)(intptr_t)((void **)arg)[1];
+	for (int i = 0; i < ASYNC_LOG_PER_THREAD; ++i) {
+		log_message(stream, LOG_INFO, "t%d m%d", id, i);
+	}
+	return NULL;
+}
+
+MU_TEST(test_logging_async_threads) {
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	set_log_level(LOG_INFO);
+
+	// A small ring forces producers to wait on the writer
+	mu_check(log_async_start((LogAsyncConfig){.capacity = 64, .overflow = LOG_OVERFLOW_BLOCK}));
+	pthread_t threads[ASYNC_LOG_THREADS];
+	void *args[ASYNC_LOG_THREADS][2];
+	for (int i = 0; i < ASYNC_LOG_THREADS; ++i) {
+		args[i][0] = tmp;
+		args[i][1] = (void *)(intptr_t)i;
+		pthread_create(&threads[i], NULL, async_log_producer, args[i]);
+	}
+	for (int i = 0; i < ASYNC_LOG_THREADS; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	log_async_flush();
+	mu_assert_int_eq(0, log_async_dropped());
+
+	size_t size;
+	char *contents = read_stream(tmp, &size);
+	int next[ASYNC_LOG_THREADS] = {0};
+	int lines = 0, ordered = 1;
+	stringv rest = sv_from_parts(contents, size), line;
+	while (sv_split_line_next(&rest, &line)) {
+		int id, seq;
+		const char *msg = strstr(line.data, "] t");
+		if (!msg || sscanf(msg, "] t%d m%d", &id, &seq) != 2) {
+			continue;
+		}
+		// Lines from one thread keep their order
+		ordered &= seq == next[id]++;
+		++lines;
+	}
+	mu_assert_int_eq(ASYNC_LOG_THREADS * ASYNC_LOG_PER_THREAD, lines);
+	mu_check(ordered);
+	mu_check(strstr(contents, "[INFO ]") != NULL);
+
+	free(contents);
+	log_async_stop();
+	fclose(tmp);
+}
+
+MU_TEST(test_logging_async_stop_while_logging) {
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	set_log_level(LOG_INFO);
+
+	// Producers keep logging across the switch back to synchronous writes
+	mu_check(log_async_start((LogAsyncConfig){.capacity = 16, .overflow = LOG_OVERFLOW_BLOCK}));
+	pthread_t threads[ASYNC_LOG_THREADS];
+	void *args[ASYNC_LOG_THREADS][2];
+	for (int i = 0; i < ASYNC_LOG_THREADS; ++i) {
+		args[i][0] = tmp;
+		args[i][1] = (void *)(intptr_t)i;
+		pthread_create(&threads[i], NULL, async_log_producer, args[i]);
+	}
+	while (__atomic_load_n(&log_async.enqueue_pos, __ATOMIC_RELAXED) < 100) {
+		sched_yield();
+	}
+	log_async_stop();
+	for (int i = 0; i < ASYNC_LOG_THREADS; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	// No message is lost, whichever path it took
+	size_t size;
+	char *contents = read_stream(tmp, &size);
+	int lines = (int)sv_count_char(sv_from_parts(contents, size), '\n');
+	mu_assert_int_eq(ASYNC_LOG_THREADS * ASYNC_LOG_PER_THREAD, lines);
+	free(contents);
+	fclose(tmp);
+}
+
+MU_TEST(test_logging_async_drop) {
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	set_log_level(LOG_INFO);
+
+	int total = 5000;
+	mu_check(log_async_start((LogAsyncConfig){.capacity = 8, .overflow = LOG_OVERFLOW_DROP}));
+	for (int i = 0; i < total; ++i) {
+		log_message(tmp, LOG_INFO, "drop %d", i);
+	}
+	log_async_flush();
+
+	// Every message is either written or counted as dropped
+	size_t size;
+	char *contents = read_stream(tmp, &size);
+	int lines = (int)sv_count_char(sv_from_parts(contents, size), '\n');
+	mu_assert_int_eq(total, lines + (int)log_async_dropped());
+	free(contents);
+
+	log_async_stop();
+	fclose(tmp);
+}
+
+MU_TEST(test_logging_async_truncate_and_stop) {
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	set_log_level(LOG_INFO);
+
+	mu_check(log_async_start((LogAsyncConfig){.message_size = 64}));
+	char long_message[200];
+	memset(long_message, 'x', sizeof(long_message) - 1);
+	long_message[sizeof(long_message) - 1] = '\0';
+	log_message(tmp, LOG_INFO, "%s", long_message);
+	log_async_stop();
+
+	// After stopping, messages are written synchronously again
+	log_message(tmp, LOG_INFO, "after stop");
+
+	size_t size;
+	char *contents = read_stream(tmp, &size);
+	stringv rest = sv_from_parts(contents, size), line;
+	mu_check(sv_split_line_next(&rest, &line));
+	mu_check(line.length < 64);
+	mu_check(sv_ends_with(line, sv_from_cstr("xxxx")));
+	mu_check(sv_split_line_next(&rest, &line));
+	mu_check(sv_contains(line, sv_from_cstr("after stop")));
+	free(contents);
+	fclose(tmp);
+}
+
+MU_TEST(test_logging_async_stream_fallbacks) {
+	set_log_level(LOG_INFO);
+	mu_check(log_async_start((LogAsyncConfig){0}));
+
+	// A memory stream has no descriptor, the line is written synchronously
+	char memory[256] = {0};
+	FILE *mem = fmemopen(memory, sizeof(memory), "w");
+	mu_check(mem != NULL);
+	mu_check(fileno(mem) < 0);
+	log_message(mem, LOG_INFO, "in memory");
+	fclose(mem);
+	mu_check(strstr(memory, "in memory") != NULL);
+
+	// Text buffered in stdio before the first queued line comes out first
+	FILE *tmp = tmpfile();
+	mu_check(tmp != NULL);
+	fputs("buffered first\n", tmp);
+	log_message(tmp, LOG_INFO, "queued second");
+	log_async_flush();
+	size_t size;
+	char *contents = read_stream(tmp, &size);
+	char *first = strstr(contents, "buffered first");
+	char *second = strstr(contents, "queued second");
+	mu_check(first != NULL && second != NULL && first < second);
+	free(contents);
+
+	log_async_stop();
+	fclose(tmp);
+}
+
+static char *decode_binlog_file(const char *path, long *events) {
+	size_t size;
+	char *data = read_entire_file(path, &size);
+	if (!data) {
+		return NULL;
+	}
+	FILE *out = tmpfile();
+	*events = binlog_decode(data, size, out);
+	free(data);
+	char *text = read_stream(out, &size);
+	fclose(out);
+	return text;
+}
+
+MU_TEST(test_binlog_roundtrip) {
+	const char *path = "test_binlog.bin";
+	set_log_level(LOG_INFO);
+	mu_check(binlog_open(path));
+
+	time_t started = time(NULL);
+	for (int i = 0; i < 3; ++i) {
+		BINLOG_INFO("request %d took %.2f ms for %s", i, 1.5 * i, "user");
+	}
+	BINLOG_WARN("no arguments at all");
+	BINLOG_DEBUG("filtered by level %d", 1);
+	BINLOG_ERROR("[%*d] [%-4s] %zu %lld %c %x %.3s 100%%", 5, 42, "ab", (size_t)7, -9ll, 'q', 255u, "truncated");
+	time_t finished = time(NULL);
+	binlog_close();
+	// Closing releases the calling thread's buffer
+	mu_check(binlog_buffer == NULL);
+
+	long events = 0;
+	char *text = decode_binlog_file(path, &events);
+	mu_check(text != NULL);
+	mu_assert_int_eq(5, events);
+
+	// Same layout as log_message, without colors
+	stringv rest = sv_from_cstr(text), line;
+	mu_check(sv_split_line_next(&rest, &line));
+	mu_assert_int_eq('[', line.data[0]);
+	mu_assert_int_eq('.', line.data[20]);
+	mu_check(sv_ends_with(line, sv_from_cstr("] [INFO ] request 0 took 0.00 ms for user")));
+	// Cycle timestamps map back to the wall clock the events were written at
+	int on_time = 0;
+	for (time_t t = started; t <= finished; ++t) {
+		on_time |= memcmp(line.data + 1, log_time_string(t), 19) == 0;
+	}
+	mu_check(on_time);
+	mu_check(sv_split_line_next(&rest, &line));
+	mu_check(sv_ends_with(line, sv_from_cstr("[INFO ] request 1 took 1.50 ms for user")));
+	mu_check(sv_split_line_next(&rest, &line));
+	mu_check(sv_split_line_next(&rest, &line));
+	mu_check(sv_ends_with(line, sv_from_cstr("[WARN ] no arguments at all")));
+	mu_check(sv_split_line_next(&rest, &line));
+	mu_check(sv_ends_with(line, sv_from_cstr("[ERROR] [   42] [ab  ] 7 -9 q ff tru 100%")));
+	mu_check(!sv_contains(sv_from_cstr(text), sv_from_cstr("filtered")));
+	free(text);
+
+	// Sites registered earlier are described again in a new file
+	mu_check(binlog_open(path));
+	for (int i = 0; i < 2; ++i) {
+		BINLOG_INFO("request %d took %.2f ms for %s", 9, 0.25, "again");
+	}
+	// Values longer than a small scratch buffer are decoded in full
+	char long_value[801];
+	memset(long_value, 'v', sizeof(long_value) - 1);
+	long_value[sizeof(long_value) - 1] = '\0';
+	BINLOG_INFO("long <%s> <%900d>", long_value, 7);
+	binlog_close();
+	text = decode_binlog_file(path, &events);
+	mu_assert_int_eq(3, events);
+	mu_check(strstr(text, "request 9 took 0.25 ms for again") != NULL);
+	char *value = strstr(text, "long <");
+	mu_check(value != NULL);
+	mu_check(strncmp(value + 6, long_value, 800) == 0);
+	mu_check(strncmp(value + 806, "> <", 3) == 0);
+	mu_check(strncmp(value + 809 + 899, "7>\n", 3) == 0);
+	free(text);
+	remove(path);
+}
+
+static void *binlog_producer(void *arg) {
+	int id = (int)(intptr_t)arg;
+	for (int i = 0; i < 1000; ++i) {
+		BINLOG_INFO("thread %d event %d", id, i);
+	}
+	// The thread's buffer is flushed when it exits
+	return NULL;
+}
+
+MU_TEST(test_binlog_threads) {
+	const char *path = "test_binlog_threads.bin";
+	set_log_level(LOG_INFO);
+	mu_check(binlog_open(path));
+	pthread_t threads[4];
+	for (int i = 0; i < 4; ++i) {
+		pthread_create(&threads[i], NULL, binlog_producer, (void *)(intptr_t)i);
+	}
+	for (int i = 0; i < 4; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	binlog_close();
+
+	long events = 0;
+	char *text = decode_binlog_file(path, &events);
+	mu_check(text != NULL);
+	mu_assert_int_eq(4000, events);
+
+	// Events come out sorted by time, so each thread's events stay in order
+	int next[4] = {0}, ordered = 1;
+	stringv rest = sv_from_cstr(text), line;
+	while (sv_split_line_next(&rest, &line)) {
+		int id, seq;
+		if (sscanf(strstr(line.data, "thread"), "thread %d event %d", &id, &seq) == 2) {
+			ordered &= seq == next[id]++;
+		}
+	}
+	mu_check(ordered);
+	free(text);
+	remove(path);
+
+	// Garbage is rejected
+	mu_assert_int_eq(-1, binlog_decode("not a binlog", 12, stdout));
+}
+
+// Timing tests
+MU_TEST(test_timing_clocks) {
+	u64 a = time_now_ns();
+	u64 c = cycles_now();
+	struct timespec pause = {0, 2 * 1000 * 1000};
+	nanosleep(&pause, NULL);
+	u64 b = time_now_ns();
+	u64 d = cycles_now();
+	mu_check(b - a >= 2 * 1000 * 1000);
+	mu_check(d > c);
+
+	double ratio = cycles_per_ns();
+	mu_check(ratio > 0.0);
+	mu_check(cycles_per_ns() == ratio);
+	// Converting the counter back lands near the monotonic measurement
+	u64 converted = cycles_to_ns(d - c);
+	mu_check(converted > (b - a) / 2 && converted < (b - a) * 2);
+}
+
+static void timing_scoped_work(int iterations) {
+	for (int i = 0; i < iterations; ++i) {
+		TIMER_SCOPE("test.work") {
+			volatile int sink = 0;
+			for (int j = 0; j < 100; ++j) {
+				sink += j;
+			}
+		}
+	}
+}
+
+MU_TEST(test_timing_scopes) {
+	timer_reset_all();
+	timing_scoped_work(10);
+	timing_scoped_work(5);
+
+	// Sites are linked into a global list on first use, so they must outlive it
+	static TimerSite manual = {"test.manual", __FILE__, __LINE__, 0, 0, UINT64_MAX, 0, 0, NULL};
+	timer_record(&manual, 30);
+	timer_record(&manual, 10);
+	timer_record(&manual, 20);
+	mu_assert_int_eq(3, (int)manual.count);
+	mu_assert_int_eq(60, (int)manual.total);
+	mu_assert_int_eq(10, (int)manual.min);
+	mu_assert_int_eq(30, (int)manual.max);
+
+	FILE *stream = tmpfile();
+	timer_summary(stream);
+	size_t size = 0;
+	char *text = read_stream(stream, &size);
+	fclose(stream);
+	mu_check(strstr(text, "avg us") != NULL);
+	mu_check(strstr(text, "test.manual") != NULL);
+	// Both calls share the one site of the macro
+	char *work = strstr(text, "test.work");
+	mu_check(work != NULL);
+	unsigned long long count = 0;
+	mu_check(sscanf(work, "test.work %llu", &count) == 1);
+	mu_assert_int_eq(15, (int)count);
+	free(text);
+
+	timer_reset_all();
+	mu_assert_int_eq(0, (int)manual.count);
+	mu_check(manual.min == UINT64_MAX);
+}
+
+static int timer_summary_count(const char *name) {
+	FILE *stream = tmpfile();
+	timer_summary(stream);
+	size_t size = 0;
+	char *text = read_stream(stream, &size);
+	fclose(stream);
+	unsigned long long count = 0;
+	char *line = strstr(text, name);
+	if (!line || sscanf(line + strlen(name), " %llu", &count) != 1) {
+		count = 0;
+	}
+	free(text);
+	return (int)count;
+}
+
+MU_TEST(test_timing_scope_statement) {
+	timer_reset_all();
+	volatile int sink = 0;
+
+	// A single statement, so it works as an unbraced body
+	for (int i = 0; i < 4; ++i)
+		if (i % 2 == 0)
+			TIMER_SCOPE("test.unbraced") sink += i;
+
+	// Two uses on one line get separate sites
+	TIMER_SCOPE("test.line.a") { sink += 1; } TIMER_SCOPE("test.line.b") { sink += 2; }
+
+	// Nested scopes each record into their own site
+	TIMER_SCOPE("test.outer") {
+		for (int i = 0; i < 3; ++i) {
+			TIMER_SCOPE("test.inner") { sink += i; }
+		}
+	}
+
+	mu_assert_int_eq(2, timer_summary_count("test.unbraced"));
+	mu_assert_int_eq(1, timer_summary_count("test.line.a"));
+	mu_assert_int_eq(1, timer_summary_count("test.line.b"));
+	mu_assert_int_eq(1, timer_summary_count("test.outer"));
+	mu_assert_int_eq(3, timer_summary_count("test.inner"));
+	mu_assert_int_eq(8, sink);
+}
+
+static void *trace_worker(void *arg) {
+	trace_set_thread_name((const char *)arg);
+	for (int i = 0; i < 3000; ++i) {
+		TRACE_SCOPE("work") {
+			TRACE_COUNTER("items", i);
+		}
+	}
+	return NULL;
+}
+
+static size_t count_occurrences(const char *text, const char *needle) {
+	size_t count = 0;
+	for (const char *p = strstr(text, needle); p; p = strstr(p + 1, needle)) {
+		++count;
+	}
+	return count;
+}
+
+MU_TEST(test_trace_events) {
+	trace_clear();
+	// Nothing is recorded before tracing starts
+	TRACE_INSTANT("ignored");
+	mu_assert_int_eq(0, (int)trace_event_count());
+
+	trace_start();
+	TRACE_BEGIN_ARG("frame", "index", -7);
+	TRACE_INSTANT_ARG("say \"hi\"", "n", 3);
+	TRACE_END("frame");
+
+	pthread_t threads[2];
+	pthread_create(&threads[0], NULL, trace_worker, "worker one");
+	pthread_create(&threads[1], NULL, trace_worker, "worker two");
+	pthread_join(threads[0], NULL);
+	pthread_join(threads[1], NULL);
+	trace_stop();
+	TRACE_INSTANT("ignored");
+
+	// Each worker fills more than one chunk
+	mu_assert_int_eq(3 + 2 * 9000, (int)trace_event_count());
+
+	const char *path = "test_trace.json";
+	mu_check(trace_write(path));
+	size_t size = 0;
+	char *json = read_entire_file(path, &size);
+	mu_check(json != NULL);
+	mu_check(strncmp(json, "{\"traceEvents\":[\n{", 18) == 0);
+	mu_check(strstr(json, "],\"displayTimeUnit\":\"ns\"}\n") != NULL);
+	mu_assert_int_eq(6001, (int)count_occurrences(json, "\"ph\":\"B\""));
+	mu_assert_int_eq(6001, (int)count_occurrences(json, "\"ph\":\"E\""));
+	mu_assert_int_eq(6000, (int)count_occurrences(json, "\"ph\":\"C\""));
+	mu_assert_int_eq(2, (int)count_occurrences(json, "\"ph\":\"M\""));
+	mu_assert_int_eq(0, (int)count_occurrences(json, "ignored"));
+	mu_check(strstr(json, "\"args\":{\"index\":-7}") != NULL);
+	mu_check(strstr(json, "{\"name\":\"say \\\"hi\\\"\",\"ph\":\"i\"") != NULL);
+	mu_check(strstr(json, "\"s\":\"t\",\"args\":{\"n\":3}") != NULL);
+	mu_check(strstr(json, "\"args\":{\"name\":\"worker two\"}") != NULL);
+
+	// Timestamps of one thread never go backwards
+	double last = -1.0;
+	int ordered = 1;
+	const char *main_tid = strstr(json, "\"tid\":");
+	stringv rest = sv_from_cstr(json), line;
+	while (sv_split_line_next(&rest, &line)) {
+		const char *ts = strstr(line.data, "\"ts\":");
+		if (ts && ts < line.data + line.length && strncmp(strstr(line.data, "\"tid\":"), main_tid, 8) == 0) {
+			double value = strtod(ts + 5, NULL);
+			ordered &= value >= last;
+			last = value;
+		}
+	}
+	mu_check(ordered);
+	free(json);
+	remove(path);
+
+	trace_clear();
+	mu_assert_int_eq(0, (int)trace_event_count());
+	// The main thread registers a fresh buffer after the clear
+	trace_start();
+	TRACE_INSTANT("again");
+	trace_stop();
+	mu_assert_int_eq(1, (int)trace_event_count());
+	trace_clear();
+}
+
+MU_TEST(test_hist_buckets) {
+	mu_assert_int_eq(1920, HIST_BUCKETS);
+	// Small values are exact
+	for (u64 v = 0; v < HIST_SUB_COUNT; ++v) {
+		mu_assert_int_eq((int)v, (int)hist_bucket_index(v));
+		mu_check(hist_bucket_low(v) == v && hist_bucket_high(v) == v);
+	}
+	mu_assert_int_eq(HIST_BUCKETS - 1, (int)hist_bucket_index(UINT64_MAX));
+	mu_check(hist_bucket_high(HIST_BUCKETS - 1) == UINT64_MAX);
+
+	// Buckets tile the range without gaps and every value lands in its own
+	int contiguous = 1;
+	for (size_t i = 1; i < HIST_BUCKETS; ++i) {
+		contiguous &= hist_bucket_low(i) == hist_bucket_high(i - 1) + 1;
+	}
+	mu_check(contiguous);
+
+	int within = 1;
+	u64 v = 1;
+	for (int i = 0; i < 100000; ++i) {
+		v = v * 6364136223846793005ull + 1442695040888963407ull;
+		u64 value = v >> (v & 63);
+		size_t index = hist_bucket_index(value);
+		u64 low = hist_bucket_low(index), high = hist_bucket_high(index);
+		within &= low <= value && value <= high;
+		// Relative error stays below 1/32
+		within &= (double)(high - low) <= (double)low / HIST_SUB_COUNT || high < HIST_SUB_COUNT;
+	}
+	mu_check(within);
+}
+
+MU_TEST(test_hist_percentiles) {
+	Histogram h;
+	hist_init(&h);
+	mu_check(hist_percentile(&h, 50.0) == 0);
+	for (u64 v = 1; v <= 100000; ++v) {
+		hist_record(&h, v);
+	}
+	mu_check(h.total == 100000);
+	mu_check(h.min == 1 && h.max == 100000);
+	mu_check(hist_mean(&h) == 50000.5);
+
+	double percentiles[] = {50.0, 90.0, 99.0, 99.9};
+	double p;
+	static_foreach(double, p, percentiles) {
+		double expected = p * 1000.0;
+		double got = (double)hist_percentile(&h, p);
+		mu_check(got >= expected && got <= expected * 1.04);
+	}
+	mu_check(hist_percentile(&h, 0.0) == 1);
+	mu_check(hist_percentile(&h, 100.0) == 100000);
+
+	// Merging equals recording everything into one histogram
+	Histogram a, b, all;
+	hist_init(&a);
+	hist_init(&b);
+	hist_init(&all);
+	for (u64 v = 0; v < 5000; ++v) {
+		hist_record(v % 2 ? &a : &b, v * 37);
+		hist_record(&all, v * 37);
+	}
+	hist_record_n(&a, 123456789, 3);
+	hist_record_n(&all, 123456789, 3);
+	hist_merge(&a, &b);
+	mu_check(memcmp(&a, &all, sizeof(Histogram)) == 0);
+
+	hist_reset(&a);
+	mu_check(a.total == 0 && a.min == UINT64_MAX);
+}
+
+MU_TEST(test_hist_dump) {
+	Histogram h;
+	hist_init(&h);
+	hist_record_n(&h, 10, 9);
+	hist_record(&h, 1000);
+
+	FILE *stream = tmpfile();
+	hist_dump(&h, stream);
+	size_t size = 0;
+	char *text = read_stream(stream, &size);
+	fclose(stream);
+	mu_check(strncmp(text, "count=10 min=10 mean=109.0 max=1000\n", 36) == 0);
+	mu_check(strstr(text, "10    90.000000              9\n") != NULL);
+	mu_check(strstr(text, "1000   100.000000             10\n") != NULL);
+	free(text);
+
+	set_log_level(LOG_INFO);
+	stream = tmpfile();
+	hist_log(&h, stream, LOG_INFO, "latency");
+	text = read_stream(stream, &size);
+	fclose(stream);
+	mu_check(strstr(text, "latency count=10 min=10 mean=109.0 p50=10 p90=10 p99=1000 p99.9=1000 max=1000") != NULL);
+	free(text);
+}
+
+static void *hist_worker(void *arg) {
+	HistogramSet *set = arg;
+	for (u64 v = 1; v <= 10000; ++v) {
+		hist_set_record(set, v);
+	}
+	return NULL;
+}
+
+MU_TEST(test_hist_set_threads) {
+	HistogramSet set;
+	mu_check(hist_set_init(&set));
+	pthread_t threads[4];
+	for (int i = 0; i < 4; ++i) {
+		pthread_create(&threads[i], NULL, hist_worker, &set);
+	}
+	// Merging while the workers record sees a consistent prefix
+	Histogram partial;
+	hist_set_merge(&set, &partial);
+	mu_check(partial.total <= 40000);
+	for (int i = 0; i < 4; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	hist_set_record(&set, 0);
+
+	Histogram merged;
+	hist_set_merge(&set, &merged);
+	mu_check(merged.total == 40001);
+	mu_check(merged.min == 0 && merged.max == 10000);
+	mu_check(merged.sum == 4 * 50005000ull);
+	mu_assert_int_eq(5, (int)set.parts.length);
+	hist_set_free(&set);
+}
+
+// Thread pool tests
+static void pool_increment(void *arg) {
+	__atomic_add_fetch((u64 *)arg, 1, __ATOMIC_RELAXED);
+}
+
+MU_TEST(test_pool_submit_wait) {
+	ThreadPool *pool = pool_create(4);
+	mu_check(pool != NULL);
+	mu_assert_int_eq(4, (int)pool_thread_count(pool));
+
+	u64 counter = 0;
+	WaitGroup wg;
+	wait_group_init(&wg);
+	for (int i = 0; i < 10000; ++i) {
+		pool_submit(pool, &wg, pool_increment, &counter);
+	}
+	pool_wait(pool, &wg);
+	mu_assert_int_eq(10000, (int)counter);
+
+	// Waiting on an empty group returns immediately, and groups can be reused
+	wait_group_wait(&wg);
+	for (int i = 0; i < 100; ++i) {
+		pool_submit(pool, &wg, pool_increment, &counter);
+	}
+	wait_group_wait(&wg);
+	mu_assert_int_eq(10100, (int)counter);
+	wait_group_destroy(&wg);
+
+	// Tasks without a group still run before destroy returns
+	for (int i = 0; i < 1000; ++i) {
+		pool_submit(pool, NULL, pool_increment, &counter);
+	}
+	pool_destroy(pool);
+	mu_assert_int_eq(11100, (int)counter);
+}
+
+typedef struct {
+	ThreadPool *pool;
+	int n;
+	u64 result;
+} PoolFib;
+
+// Spawns one subtask per call, so the deques grow and get stolen from
+static void pool_fib(void *arg) {
+	PoolFib *job = arg;
+	if (job->n < 2) {
+		job->result = (u64)job->n;
+		return;
+	}
+	PoolFib left = {job->pool, job->n - 1, 0};
+	PoolFib right = {job->pool, job->n - 2, 0};
+	WaitGroup wg;
+	wait_group_init(&wg);
+	pool_submit(job->pool, &wg, pool_fib, &left);
+	pool_fib(&right);
+	pool_wait(job->pool, &wg);
+	wait_group_destroy(&wg);
+	job->result = left.result + right.result;
+}
+
+MU_TEST(test_pool_nested_tasks) {
+	ThreadPool *pool = pool_create(3);
+	PoolFib job = {pool, 20, 0};
+	WaitGroup wg;
+	wait_group_init(&wg);
+	pool_submit(pool, &wg, pool_fib, &job);
+	pool_wait(pool, &wg);
+	wait_group_destroy(&wg);
+	mu_assert_int_eq(6765, (int)job.result);
+	pool_destroy(pool);
+}
+
+typedef struct {
+	u8 *hits;
+	size_t calls;
+	size_t max_chunk;
+} PoolForCtx;
+
+static void pool_for_mark(size_t begin, size_t end, void *ctx) {
+	PoolForCtx *c = ctx;
+	for (size_t i = begin; i < end; ++i) {
+		c->hits[i]++;
+	}
+	__atomic_add_fetch(&c->calls, 1, __ATOMIC_RELAXED);
+	size_t size = end - begin, max = __atomic_load_n(&c->max_chunk, __ATOMIC_RELAXED);
+	while (size > max && !__atomic_compare_exchange_n(&c->max_chunk, &max, size, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+
+static void *pool_for_submitter(void *arg) {
+	ThreadPool *pool = arg;
+	u64 counter = 0;
+	WaitGroup wg;
+	wait_group_init(&wg);
+	for (int i = 0; i < 500; ++i) {
+		pool_submit(pool, &wg, pool_increment, &counter);
+	}
+	pool_wait(pool, &wg);
+	wait_group_destroy(&wg);
+	return (void *)(uintptr_t)counter;
+}
+
+MU_TEST(test_pool_parallel_for) {
+	ThreadPool *pool = pool_create(4);
+	size_t n = 100003;
+	u8 *hits = calloc(n, 1);
+
+	// Every index is visited exactly once, in chunks of at most grain
+	size_t grains[] = {0, 1, 7, 1000, 200000};
+	size_t grain;
+	static_foreach(size_t, grain, grains) {
+		memset(hits, 0, n);
+		PoolForCtx ctx = {hits, 0, 0};
+		pool_parallel_for(pool, 3, n, grain, pool_for_mark, &ctx);
+		int exact = hits[0] == 0 && hits[1] == 0 && hits[2] == 0;
+		for (size_t i = 3; i < n; ++i) {
+			exact &= hits[i] == 1;
+		}
+		mu_check(exact);
+		if (grain) {
+			mu_check(ctx.max_chunk <= grain);
+			mu_assert_int_eq((int)((n - 3 + grain - 1) / grain), (int)ctx.calls);
+		}
+	}
+
+	// Empty ranges never call fn
+	PoolForCtx empty = {hits, 0, 0};
+	pool_parallel_for(pool, 10, 10, 4, pool_for_mark, &empty);
+	mu_assert_int_eq(0, (int)empty.calls);
+
+	// Several outside threads submitting at once go through the injector
+	pthread_t threads[3];
+	for (int i = 0; i < 3; ++i) {
+		pthread_create(&threads[i], NULL, pool_for_submitter, pool);
+	}
+	for (int i = 0; i < 3; ++i) {
+		void *result;
+		pthread_join(threads[i], &result);
+		mu_assert_int_eq(500, (int)(uintptr_t)result);
+	}
+	pool_destroy(pool);
+
+	// The default pool is created on first use
+	memset(hits, 0, n);
+	PoolForCtx ctx = {hits, 0, 0};
+	parallel_for(0, n, 0, pool_for_mark, &ctx);
+	int exact = 1;
+	for (size_t i = 0; i < n; ++i) {
+		exact &= hits[i] == 1;
+	}
+	mu_check(exact);
+	mu_check(pool_default() == pool_default());
+	free(hits);
+}
+
+SLICE_DEF(u64);
+
+static void parallel_test_double(u64 *item, void *ctx) {
+	*item *= *(u64 *)ctx;
+}
+
+static double parallel_test_half(const u64 *item, void *ctx) {
+	(void)ctx;
+	return (double)*item / 2.0;
+}
+
+#define PARALLEL_TEST_IS_EVEN(item, ctx) ((size_t)(*(item) % 2 == 0))
+#define PARALLEL_TEST_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+PARALLEL_REDUCE_DEF(parallel_test_sum, u64, 0, PARALLEL_SUM)
+PARALLEL_REDUCE_DEF(parallel_test_max, i32, INT32_MIN, MAX)
+PARALLEL_REDUCE_DEF(parallel_test_min, i32, INT32_MAX, PARALLEL_TEST_MIN)
+PARALLEL_REDUCE_DEF(parallel_test_fsum, double, 0.0, PARALLEL_SUM)
+PARALLEL_MAP_REDUCE_DEF(parallel_test_count_even, u64, size_t, 0, PARALLEL_TEST_IS_EVEN, PARALLEL_SUM)
+PARALLEL_FOREACH_DEF(parallel_test_scale, u64, parallel_test_double)
+PARALLEL_MAP_DEF(parallel_test_halves, u64, double, parallel_test_half)
+
+MU_TEST(test_parallel_map_reduce) {
+	// Longer than 64 chunks, so the partial results live on the heap
+	size_t n = 100 * PARALLEL_GRAIN + 17;
+	array(u64) numbers;
+	array_init_cap(numbers, n);
+	for (u64 i = 1; i <= n; ++i) {
+		array_push(numbers, i);
+	}
+	mu_check(parallel_test_sum(numbers.data, numbers.length) == (u64)n * (n + 1) / 2);
+	mu_assert_int_eq((int)(n / 2), (int)parallel_test_count_even(numbers.data, numbers.length, NULL));
+
+	// Slices work the same way, including empty and single-chunk ones
+	slice(u64) head = make_slice(u64, numbers.data, 10);
+	mu_check(parallel_test_sum(head.data, head.length) == 55);
+	mu_check(parallel_test_sum(head.data, 0) == 0);
+
+	u64 factor = 3;
+	parallel_test_scale(numbers.data, numbers.length, &factor);
+	int scaled = 1;
+	for (size_t i = 0; i < n; ++i) {
+		scaled &= numbers.data[i] == 3 * (i + 1);
+	}
+	mu_check(scaled);
+
+	double *halves = ALLOC(double, n);
+	parallel_test_halves(numbers.data, halves, n, NULL);
+	mu_check(halves[0] == 1.5 && halves[n - 1] == 1.5 * (double)n);
+
+	// Float sums match a serial sum over the same chunks bit for bit
+	double expected = 0.0;
+	for (size_t begin = 0; begin < n; begin += PARALLEL_GRAIN) {
+		double chunk = 0.0;
+		for (size_t i = begin; i < MIN(n, begin + PARALLEL_GRAIN); ++i) {
+			chunk += halves[i];
+		}
+		expected += chunk;
+	}
+	mu_check(parallel_test_fsum(halves, n) == expected);
+	mu_check(parallel_test_fsum(halves, n) == parallel_test_fsum(halves, n));
+	FREE(halves);
+	array_free(numbers);
+
+	i32 values[] = {5, -3, 99, 12, -40, 7};
+	mu_assert_int_eq(99, parallel_test_max(values, countof(values)));
+	mu_assert_int_eq(-40, parallel_test_min(values, countof(values)));
+	mu_assert_int_eq(INT32_MIN, parallel_test_max(values, 0));
+}
+
+// Sort tests
+typedef struct {
+	u32 key;
+	u32 order;
+} SortRecord;
+
+SLICE_DEF(SortRecord);
+
+#define SORT_RECORD_LESS(a, b) ((a).key < (b).key)
+#define SORT_RECORD_KEY(x) ((x).key)
+#define SORT_DOUBLE_KEY(x) SORT_KEY_F64(x)
+#define SORT_I64_KEY(x) SORT_KEY_I64(x)
+
+SORT_DEF(sort_test_u64, u64, SORT_LESS)
+SORT_DEF(sort_test_desc, int, SORT_GREATER)
+SORT_DEF(sort_test_records, SortRecord, SORT_RECORD_LESS)
+RADIX_SORT_DEF(radix_test_u64, u64, u64, SORT_IDENTITY_KEY)
+RADIX_SORT_DEF(radix_test_i64, i64, u64, SORT_I64_KEY)
+RADIX_SORT_DEF(radix_test_double, double, u64, SORT_DOUBLE_KEY)
+RADIX_SORT_DEF(radix_test_records, SortRecord, u32, SORT_RECORD_KEY)
+
+static int sort_test_compare_u64(const void *a, const void *b) {
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+	return (x > y) - (x < y);
+}
+
+static u64 sort_test_rng = 88172645463325252ull;
+
+static u64 sort_test_next(void) {
+	sort_test_rng ^= sort_test_rng << 13;
+	sort_test_rng ^= sort_test_rng >> 7;
+	sort_test_rng ^= sort_test_rng << 17;
+	return sort_test_rng;
+}
+
+// Fills values with one of several input shapes
+static void sort_test_fill(u64 *values, size_t n, int shape) {
+	for (size_t i = 0; i < n; ++i) {
+		if (shape == 0) {
+			values[i] = sort_test_next();
+		} else if (shape == 1) {
+			values[i] = sort_test_next() % 4;
+		} else if (shape == 2) {
+			values[i] = i;
+		} else if (shape == 3) {
+			values[i] = n - i;
+		} else {
+			values[i] = i < n / 2 ? i : n - i;
+		}
+	}
+}
+
+MU_TEST(test_sort_matches_qsort) {
+	size_t sizes[] = {0, 1, 2, 3, 5, 8, 9, 24, 25, 33, 100, 1000, 100000};
+	size_t n;
+	int ok = 1;
+	static_foreach(size_t, n, sizes) {
+		u64 *values = ALLOC(u64, n + 1);
+		u64 *expected = ALLOC(u64, n + 1);
+		u64 *copy = ALLOC(u64, n + 1);
+		for (int shape = 0; shape < 5; ++shape) {
+			sort_test_fill(values, n, shape);
+			memcpy(expected, values, n * sizeof(u64));
+			qsort(expected, n, sizeof(u64), sort_test_compare_u64);
+
+			memcpy(copy, values, n * sizeof(u64));
+			sort_test_u64(copy, n);
+			ok &= memcmp(copy, expected, n * sizeof(u64)) == 0;
+			memcpy(copy, values, n * sizeof(u64));
+			sort_test_u64_stable(copy, n);
+			ok &= memcmp(copy, expected, n * sizeof(u64)) == 0;
+			memcpy(copy, values, n * sizeof(u64));
+			sort_test_u64_parallel(copy, n);
+			ok &= memcmp(copy, expected, n * sizeof(u64)) == 0;
+			memcpy(copy, values, n * sizeof(u64));
+			radix_test_u64(copy, n);
+			ok &= memcmp(copy, expected, n * sizeof(u64)) == 0;
+		}
+		FREE(values);
+		FREE(expected);
+		FREE(copy);
+	}
+	mu_check(ok);
+
+	// Every permutation of up to 8 distinct values goes through the networks
+	int perm[8];
+	for (int length = 2; length <= 8; ++length) {
+		int total = 1;
+		for (int i = 2; i <= length; ++i) {
+			total *= i;
+		}
+		for (int p = 0; p < total; ++p) {
+			int pool[8] = {0, 1, 2, 3, 4, 5, 6, 7}, rest = p, left = length;
+			for (int i = 0; i < length; ++i) {
+				int pick = rest % left;
+				rest /= left;
+				perm[i] = pool[pick];
+				memmove(pool + pick, pool + pick + 1, (size_t)(left - pick - 1) * sizeof(int));
+				--left;
+			}
+			sort_test_desc(perm, (size_t)length);
+			for (int i = 0; i < length; ++i) {
+				ok &= perm[i] == length - 1 - i;
+			}
+		}
+	}
+	mu_check(ok);
+}
+
+MU_TEST(test_sort_stable_records) {
+	size_t n = 100000;
+	array(SortRecord) records;
+	array_init(records);
+	for (u32 i = 0; i < n; ++i) {
+		array_push(records, ((SortRecord){(u32)(sort_test_next() % 1000), i}));
+	}
+	SortRecord *copy = ALLOC(SortRecord, n);
+
+	// Equal keys keep their original order in the stable sorts, including
+	// the in-place fallback used when no buffer can be allocated
+	void (*sorts[])(SortRecord *, size_t) = {sort_test_records_stable, sort_test_records_parallel, radix_test_records,
+	                                         sort_test_records_stable_inplace, radix_test_records_stable_inplace};
+	for (size_t s = 0; s < countof(sorts); ++s) {
+		memcpy(copy, records.data, n * sizeof(SortRecord));
+		sorts[s](copy, n);
+		int stable = 1;
+		for (size_t i = 1; i < n; ++i) {
+			stable &= copy[i - 1].key < copy[i].key || (copy[i - 1].key == copy[i].key && copy[i - 1].order < copy[i].order);
+		}
+		mu_check(stable);
+	}
+
+	slice(SortRecord) view = make_slice(SortRecord, records.data, records.length);
+	sort_test_records(view.data, view.length);
+	int sorted = 1;
+	for (size_t i = 1; i < n; ++i) {
+		sorted &= records.data[i - 1].key <= records.data[i].key;
+	}
+	mu_check(sorted);
+	FREE(copy);
+	array_free(records);
+}
+
+MU_TEST(test_sort_parallel_chunk_bounds) {
+	// More chunks than the length fills: the trailing chunks are empty
+	u64 values[100], buffer[100];
+	sort_test_fill(values, countof(values), 0);
+	sort_test_u64_SortArgs args = {values, buffer, countof(values), 7};
+	sort_test_u64_sort_chunks(0, 16, &args);
+	int sorted = 1;
+	for (size_t lo = 0; lo < countof(values); lo += 7) {
+		for (size_t i = lo + 1; i < MIN(lo + 7, countof(values)); ++i) {
+			sorted &= values[i - 1] <= values[i];
+		}
+	}
+	mu_check(sorted);
+}
+
+MU_TEST(test_sort_radix_keys) {
+	i64 ints[] = {5, -1, INT64_MIN, 0, INT64_MAX, -1000000000000ll, 42, -42, 7, 7, 3, -3, 99, -99, 1, -1, 0,
+	              12, -12, 1 << 20, -(1 << 20), 8, -8, 6, -6, 500};
+	i64 expected_ints[countof(ints)];
+	memcpy(expected_ints, ints, sizeof(ints));
+	for (size_t i = 1; i < countof(ints); ++i) {
+		for (size_t j = i; j > 0 && expected_ints[j] < expected_ints[j - 1]; --j) {
+			i64 tmp = expected_ints[j];
+			expected_ints[j] = expected_ints[j - 1];
+			expected_ints[j - 1] = tmp;
+		}
+	}
+	radix_test_i64(ints, countof(ints));
+	mu_check(memcmp(ints, expected_ints, sizeof(ints)) == 0);
+
+	size_t n = 5000;
+	double *values = ALLOC(double, n);
+	for (size_t i = 0; i < n; ++i) {
+		values[i] = ((double)(sort_test_next() % 2000001) - 1000000.0) / 7.0;
+	}
+	values[0] = -1e300;
+	values[1] = 1e300;
+	values[2] = 0.0;
+	radix_test_double(values, n);
+	int sorted = values[0] == -1e300 && values[n - 1] == 1e300;
+	for (size_t i = 1; i < n; ++i) {
+		sorted &= values[i - 1] <= values[i];
+	}
+	mu_check(sorted);
+	FREE(values);
+}
+
 // Image tests
 MU_TEST(test_ppm_init_free) {
 	Canvas img = ppm_init(100, 100);
@@ -970,6 +3164,68 @@ MU_TEST(test_ppm_save_read) {
 	remove(tmp_ppm);
 }
 
+MU_TEST(test_ppm_save_read_binary) {
+	Canvas img = ppm_init(16, 9);
+	for (u32 y = 0; y < 9; ++y) {
+		for (u32 x = 0; x < 16; ++x) {
+			ppm_set_pixel(&img, x, y, (Color){(u8)(x * 15), (u8)(y * 25), (u8)(x ^ y)});
+		}
+	}
+
+	const char *tmp_ppm = "test_image_p6.ppm";
+	mu_check(ppm_save_binary(&img, tmp_ppm));
+
+	size_t size = 0;
+	char *raw = read_entire_file(tmp_ppm, &size);
+	mu_check(raw != NULL);
+	mu_check(strncmp(raw, "P6\n16 9\n255\n", 12) == 0);
+	mu_assert_int_eq(12 + 16 * 9 * 3, size);
+	FREE(raw);
+
+	Canvas read = ppm_read(tmp_ppm);
+	mu_assert_int_eq(16, (int)read.width);
+	mu_assert_int_eq(9, (int)read.height);
+	mu_check(read.pixels != NULL);
+	mu_check(memcmp(img.pixels, read.pixels, sizeof(Color) * 16 * 9) == 0);
+
+	ppm_free(&img);
+	ppm_free(&read);
+	remove(tmp_ppm);
+}
+
+MU_TEST(test_ppm_read_max_val) {
+	const char *tmp_ppm = "test_image_maxval.ppm";
+
+	// ASCII with comments and a 4-bit max value
+	const char *ascii = "P3\n# comment\n2 1\n15\n15 0 7\n0 15 15\n";
+	mu_check(write_entire_file(tmp_ppm, ascii, strlen(ascii)));
+	Canvas img = ppm_read(tmp_ppm);
+	mu_check(img.pixels != NULL);
+	mu_assert_int_eq(255, img.pixels[0].r);
+	mu_assert_int_eq(0, img.pixels[0].g);
+	mu_assert_int_eq(119, img.pixels[0].b);
+	mu_assert_int_eq(255, img.pixels[1].b);
+	ppm_free(&img);
+
+	// Binary with 16-bit big-endian samples
+	const u8 wide[] = {'P', '6', '\n', '1', ' ', '1', '\n', '6', '5', '5', '3', '5', '\n', 0xFF, 0xFF, 0x00, 0x00, 0x80, 0x00};
+	mu_check(write_entire_file(tmp_ppm, wide, sizeof(wide)));
+	img = ppm_read(tmp_ppm);
+	mu_check(img.pixels != NULL);
+	mu_assert_int_eq(255, img.pixels[0].r);
+	mu_assert_int_eq(0, img.pixels[0].g);
+	mu_assert_int_eq(128, img.pixels[0].b);
+	ppm_free(&img);
+
+	// Truncated binary payload
+	const char *truncated = "P6\n2 2\n255\nabc";
+	mu_check(write_entire_file(tmp_ppm, truncated, strlen(truncated)));
+	img = ppm_read(tmp_ppm);
+	mu_check(img.pixels == NULL);
+
+	remove(tmp_ppm);
+}
+
 MU_TEST(test_ppm_draw_helpers) {
 	Canvas img = ppm_init(100, 100);
 
@@ -1022,6 +3278,16 @@ MU_TEST_SUITE(test_suite_stringv) {
 	RUN_TEST_WITH_NAME(test_sv_ends_with_false);
 	RUN_TEST_WITH_NAME(test_sv_ends_with_empty_suffix);
 	RUN_TEST_WITH_NAME(test_sv_ends_with_longer_suffix);
+	RUN_TEST_WITH_NAME(test_sv_find_char);
+	RUN_TEST_WITH_NAME(test_sv_find_char_long);
+	RUN_TEST_WITH_NAME(test_sv_count_char_large);
+	RUN_TEST_WITH_NAME(test_sv_find_substring);
+	RUN_TEST_WITH_NAME(test_sv_find_substring_long);
+	RUN_TEST_WITH_NAME(test_sv_find_any);
+	RUN_TEST_WITH_NAME(test_sv_split_next);
+	RUN_TEST_WITH_NAME(test_sv_split_any_next);
+	RUN_TEST_WITH_NAME(test_sv_split_whitespace_next);
+	RUN_TEST_WITH_NAME(test_sv_split_line_next);
 }
 
 MU_TEST_SUITE(test_suite_stringb) {
@@ -1066,11 +3332,35 @@ MU_TEST_SUITE(test_suite_array) {
 	RUN_TEST_WITH_NAME(test_array_get_set);
 	RUN_TEST_WITH_NAME(test_array_insert);
 	RUN_TEST_WITH_NAME(test_array_remove);
+	RUN_TEST_WITH_NAME(test_array_insert_from_self);
+	RUN_TEST_WITH_NAME(test_array_push_n_extend);
+	RUN_TEST_WITH_NAME(test_array_insert_n);
+	RUN_TEST_WITH_NAME(test_array_remove_range_swap_remove);
 	RUN_TEST_WITH_NAME(test_array_growth);
 	RUN_TEST_WITH_NAME(test_array_reserve);
 	RUN_TEST_WITH_NAME(test_array_clear);
 	RUN_TEST_WITH_NAME(test_array_foreach);
 	RUN_TEST_WITH_NAME(test_array_foreach_idx);
+	RUN_TEST_WITH_NAME(test_stable_array);
+	RUN_TEST_WITH_NAME(test_stable_array_limit);
+	RUN_TEST_WITH_NAME(test_small_array);
+	RUN_TEST_WITH_NAME(test_small_array_copy);
+}
+
+MU_TEST_SUITE(test_suite_hash) {
+	printf("\n[Hash Tests]\n");
+	RUN_TEST_WITH_NAME(test_hash_bytes_basic);
+	RUN_TEST_WITH_NAME(test_hash_bytes_avalanche);
+	RUN_TEST_WITH_NAME(test_hash_streaming);
+}
+
+MU_TEST_SUITE(test_suite_hashmap) {
+	printf("\n[Hash Map Tests]\n");
+	RUN_TEST_WITH_NAME(test_hashmap_put_get);
+	RUN_TEST_WITH_NAME(test_hashmap_remove);
+	RUN_TEST_WITH_NAME(test_hashmap_growth_and_churn);
+	RUN_TEST_WITH_NAME(test_hashmap_sv_keys);
+	RUN_TEST_WITH_NAME(test_hashmap_foreach_reserve);
 }
 
 MU_TEST_SUITE(test_suite_slice) {
@@ -1092,6 +3382,14 @@ MU_TEST_SUITE(test_suite_arena) {
 	RUN_TEST_WITH_NAME(test_arena_growth);
 	RUN_TEST_WITH_NAME(test_arena_alignment);
 	RUN_TEST_WITH_NAME(test_arena_safety);
+	RUN_TEST_WITH_NAME(test_arena_reset_reuses_blocks);
+	RUN_TEST_WITH_NAME(test_arena_mark_rewind);
+	RUN_TEST_WITH_NAME(test_arena_geometric_growth);
+	RUN_TEST_WITH_NAME(test_arena_large_allocations);
+	RUN_TEST_WITH_NAME(test_arena_rewind_keeps_early_large);
+	RUN_TEST_WITH_NAME(test_arena_scratch_scope);
+	RUN_TEST_WITH_NAME(test_arena_virtual);
+	RUN_TEST_WITH_NAME(test_arena_virtual_hugepages);
 }
 
 MU_TEST_SUITE(test_suite_files) {
@@ -1100,6 +3398,8 @@ MU_TEST_SUITE(test_suite_files) {
 	RUN_TEST_WITH_NAME(test_file_io_sb);
 	RUN_TEST_WITH_NAME(test_file_io_read_missing);
 	RUN_TEST_WITH_NAME(test_file_io_read_missing_sb);
+	RUN_TEST_WITH_NAME(test_file_map_basic);
+	RUN_TEST_WITH_NAME(test_file_map_empty_and_missing);
 }
 
 MU_TEST_SUITE(test_suite_logging) {
@@ -1107,6 +3407,50 @@ MU_TEST_SUITE(test_suite_logging) {
 	RUN_TEST_WITH_NAME(test_logging_level_filtering);
 	RUN_TEST_WITH_NAME(test_logging_env_level);
 	RUN_TEST_WITH_NAME(test_logging_format);
+	RUN_TEST_WITH_NAME(test_logging_cached_timestamp);
+	RUN_TEST_WITH_NAME(test_logging_tty_cache_follows_stream);
+	RUN_TEST_WITH_NAME(test_logging_single_line_layout);
+	RUN_TEST_WITH_NAME(test_logging_call_sites);
+	RUN_TEST_WITH_NAME(test_logging_structured_json);
+	RUN_TEST_WITH_NAME(test_logging_structured_logfmt);
+	RUN_TEST_WITH_NAME(test_logging_rate_limit_gcra);
+	RUN_TEST_WITH_NAME(test_logging_rate_limit_storm_summary);
+	RUN_TEST_WITH_NAME(test_logging_rate_limited_macro);
+	RUN_TEST_WITH_NAME(test_logging_async_threads);
+	RUN_TEST_WITH_NAME(test_logging_async_stop_while_logging);
+	RUN_TEST_WITH_NAME(test_logging_async_drop);
+	RUN_TEST_WITH_NAME(test_logging_async_truncate_and_stop);
+	RUN_TEST_WITH_NAME(test_logging_async_stream_fallbacks);
+	RUN_TEST_WITH_NAME(test_binlog_roundtrip);
+	RUN_TEST_WITH_NAME(test_binlog_threads);
+}
+
+MU_TEST_SUITE(test_suite_timing) {
+	printf("\n[Timing Tests]\n");
+	RUN_TEST_WITH_NAME(test_timing_clocks);
+	RUN_TEST_WITH_NAME(test_timing_scopes);
+	RUN_TEST_WITH_NAME(test_timing_scope_statement);
+	RUN_TEST_WITH_NAME(test_trace_events);
+	RUN_TEST_WITH_NAME(test_hist_buckets);
+	RUN_TEST_WITH_NAME(test_hist_percentiles);
+	RUN_TEST_WITH_NAME(test_hist_dump);
+	RUN_TEST_WITH_NAME(test_hist_set_threads);
+}
+
+MU_TEST_SUITE(test_suite_threads) {
+	printf("\n[Thread Pool Tests]\n");
+	RUN_TEST_WITH_NAME(test_pool_submit_wait);
+	RUN_TEST_WITH_NAME(test_pool_nested_tasks);
+	RUN_TEST_WITH_NAME(test_pool_parallel_for);
+	RUN_TEST_WITH_NAME(test_parallel_map_reduce);
+}
+
+MU_TEST_SUITE(test_suite_sort) {
+	printf("\n[Sort Tests]\n");
+	RUN_TEST_WITH_NAME(test_sort_matches_qsort);
+	RUN_TEST_WITH_NAME(test_sort_stable_records);
+	RUN_TEST_WITH_NAME(test_sort_parallel_chunk_bounds);
+	RUN_TEST_WITH_NAME(test_sort_radix_keys);
 }
 
 MU_TEST_SUITE(test_suite_image) {
@@ -1114,6 +3458,8 @@ MU_TEST_SUITE(test_suite_image) {
 	RUN_TEST_WITH_NAME(test_ppm_init_free);
 	RUN_TEST_WITH_NAME(test_ppm_set_get_pixel);
 	RUN_TEST_WITH_NAME(test_ppm_save_read);
+	RUN_TEST_WITH_NAME(test_ppm_save_read_binary);
+	RUN_TEST_WITH_NAME(test_ppm_read_max_val);
 	RUN_TEST_WITH_NAME(test_ppm_draw_helpers);
 }
 
@@ -1125,11 +3471,16 @@ int main(int argc, char *argv[]) {
 	MU_RUN_SUITE(test_suite_stringb);
 	MU_RUN_SUITE(test_suite_macros);
 	MU_RUN_SUITE(test_suite_array);
+	MU_RUN_SUITE(test_suite_hash);
+	MU_RUN_SUITE(test_suite_hashmap);
 	MU_RUN_SUITE(test_suite_slice);
 	MU_RUN_SUITE(test_suite_types);
 	MU_RUN_SUITE(test_suite_arena);
 	MU_RUN_SUITE(test_suite_files);
 	MU_RUN_SUITE(test_suite_logging);
+	MU_RUN_SUITE(test_suite_timing);
+	MU_RUN_SUITE(test_suite_threads);
+	MU_RUN_SUITE(test_suite_sort);
 	MU_RUN_SUITE(test_suite_image);
 
 	MU_REPORT();